@@ -0,0 +1,337 @@
+/**
+ * @file bench.cpp
+ * @brief Benchmark suite running iSAM on the bundled data sets.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include <isam/isam.h>
+
+#include "Loader.h"
+#include "run_incremental.h"
+
+using namespace std;
+using namespace isam;
+
+const string usage = "\n"
+    "Usage:\n"
+    "  bench [options] [data set ...]\n"
+    "\n"
+    "Runs each data set (file name in the data directory, or a path) in each\n"
+    "mode, and reports per-step latency, total time, peak memory and the final\n"
+    "chi2. For batch modes the only step is the batch optimization.\n"
+    "\n"
+    "Options:\n"
+    "  -h, -?         show this help\n"
+    "  -d <dir>       data directory\n"
+    "  -m <mode>      only run this mode (repeat for several)\n"
+    "  -n <number>    max. number of lines to read from each data set, 0=all\n"
+    "  -o <fname>     write results as JSON\n"
+    "\n"
+    "Modes: incremental-gn, incremental-dogleg, batch-gn, batch-lm, batch-dogleg\n"
+    "\n";
+
+const char* default_datasets[] = {
+  "city10000.txt",
+  "manhattanOlson3500.txt",
+  "sphere2500.txt",
+  "torus10000.txt",
+  "victoriaPark.txt",
+  "cityTrees10000.txt"
+};
+
+struct Mode {
+  const char* name;
+  bool batch;
+  Method method;
+};
+
+const Mode modes[] = {
+  {"incremental-gn", false, GAUSS_NEWTON},
+  {"incremental-dogleg", false, DOG_LEG},
+  {"batch-gn", true, GAUSS_NEWTON},
+  {"batch-lm", true, LEVENBERG_MARQUARDT},
+  {"batch-dogleg", true, DOG_LEG}
+};
+const int num_modes = sizeof(modes)/sizeof(Mode);
+
+/**
+ * Results of one run; latencies in seconds.
+ */
+struct Result {
+  string dataset;
+  string mode;
+  bool ok;
+  int steps;
+  double load;
+  double total;
+  double final;
+  double p50;
+  double p95;
+  double p99;
+  double max;
+  long peak_kb;
+  double chi2;
+  double normalized_chi2;
+};
+
+// nearest rank percentile of sorted values
+double percentile(const vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0.;
+  int rank = (int)ceil(p/100. * sorted.size());
+  rank = std::max(1, std::min(rank, (int)sorted.size()));
+  return sorted[rank-1];
+}
+
+long peak_memory_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024; // bytes
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+/**
+ * Runs one data set in one mode, called in a separate process so
+ * that peak memory is measured per run and all memory is released.
+ */
+void run(const string& fname, const Mode& mode, int num_lines, Result& result) {
+  double t_load = tic();
+  Loader loader(fname.c_str(), num_lines, false);
+  result.load = toc(t_load);
+
+  Slam slam;
+  Properties prop = slam.properties();
+  prop.quiet = true;
+  prop.method = mode.method;
+  slam.set_properties(prop);
+
+  vector<double> latencies;
+  result.final = run_incremental(loader, slam, !mode.batch, &latencies);
+  if (mode.batch) {
+    double t0 = tic();
+    slam.batch_optimization();
+    result.final = toc(t0);
+    latencies.push_back(result.final);
+  }
+
+  result.steps = latencies.size();
+  result.total = 0.;
+  for (unsigned int i=0; i<latencies.size(); i++) {
+    result.total += latencies[i];
+  }
+  if (!mode.batch) {
+    result.total += result.final;
+  }
+  sort(latencies.begin(), latencies.end());
+  result.p50 = percentile(latencies, 50.);
+  result.p95 = percentile(latencies, 95.);
+  result.p99 = percentile(latencies, 99.);
+  result.max = latencies.empty() ? 0. : latencies.back();
+  result.peak_kb = peak_memory_kb();
+  result.chi2 = slam.chi2();
+  result.normalized_chi2 = slam.normalized_chi2();
+  result.ok = true;
+}
+
+/**
+ * Runs one data set in one mode in a child process.
+ */
+Result run_forked(const string& fname, const Mode& mode, int num_lines) {
+  Result result;
+  result.ok = false;
+  result.mode = mode.name;
+  int fd[2];
+  fflush(stdout); // not to be repeated by the child
+  require(pipe(fd)==0, "bench: cannot create pipe");
+  pid_t pid = fork();
+  require(pid>=0, "bench: cannot fork");
+  if (pid==0) {
+    close(fd[0]);
+    run(fname, mode, num_lines, result);
+    stringstream s;
+    s << setprecision(17) << result.steps << " " << result.load << " "
+      << result.total << " " << result.final << " " << result.p50 << " "
+      << result.p95 << " " << result.p99 << " " << result.max << " "
+      << result.peak_kb << " " << result.chi2 << " " << result.normalized_chi2;
+    string msg = s.str();
+    ssize_t written = write(fd[1], msg.c_str(), msg.size());
+    close(fd[1]);
+    _exit(written==(ssize_t)msg.size() ? 0 : 1);
+  }
+  close(fd[1]);
+  string msg;
+  char buf[256];
+  ssize_t n;
+  while ((n = read(fd[0], buf, sizeof(buf))) > 0) {
+    msg.append(buf, n);
+  }
+  close(fd[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  if (WIFEXITED(status) && WEXITSTATUS(status)==0) {
+    stringstream s(msg);
+    s >> result.steps >> result.load >> result.total >> result.final
+      >> result.p50 >> result.p95 >> result.p99 >> result.max
+      >> result.peak_kb >> result.chi2 >> result.normalized_chi2;
+    result.ok = !s.fail();
+  }
+  return result;
+}
+
+void print_header() {
+  printf("%-24s %-20s %6s %9s %9s %9s %9s %9s %9s %12s\n", "data set", "mode",
+      "steps", "total[s]", "p50[ms]", "p95[ms]", "p99[ms]", "max[ms]",
+      "peak[MB]", "chi2");
+}
+
+void print_result(const Result& r) {
+  if (!r.ok) {
+    printf("%-24s %-20s failed\n", r.dataset.c_str(), r.mode.c_str());
+    return;
+  }
+  printf("%-24s %-20s %6d %9.3f %9.3f %9.3f %9.3f %9.3f %9.1f %12.6g\n",
+      r.dataset.c_str(), r.mode.c_str(), r.steps, r.total, r.p50*1000.,
+      r.p95*1000., r.p99*1000., r.max*1000., r.peak_kb/1024., r.chi2);
+  fflush(stdout);
+}
+
+void save_json(const string& fname, const vector<Result>& results) {
+  ofstream out(fname.c_str());
+  require(out, "bench: cannot open JSON output file");
+  out << setprecision(10);
+  out << "{" << endl << "  \"runs\": [" << endl;
+  for (unsigned int i=0; i<results.size(); i++) {
+    const Result& r = results[i];
+    out << "    {\"dataset\": \"" << r.dataset << "\", \"mode\": \"" << r.mode
+        << "\", \"ok\": " << (r.ok ? "true" : "false");
+    if (r.ok) {
+      out << ", \"steps\": " << r.steps
+          << ", \"load_s\": " << r.load
+          << ", \"total_s\": " << r.total
+          << ", \"final_s\": " << r.final
+          << ", \"latency_s\": {\"p50\": " << r.p50 << ", \"p95\": " << r.p95
+          << ", \"p99\": " << r.p99 << ", \"max\": " << r.max << "}"
+          << ", \"peak_rss_kb\": " << r.peak_kb
+          << ", \"chi2\": " << r.chi2
+          << ", \"normalized_chi2\": " << r.normalized_chi2;
+    }
+    out << "}" << ((i+1<results.size()) ? "," : "") << endl;
+  }
+  out << "  ]" << endl << "}" << endl;
+}
+
+int main(int argc, char* argv[]) {
+#ifdef ISAM_DATA_DIR
+  string data_dir = ISAM_DATA_DIR;
+#else
+  string data_dir = "data";
+#endif
+  string fname_json;
+  vector<string> selected_modes;
+  int num_lines = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, ":h?d:m:n:o:")) != -1) {
+    switch (c) {
+    case 'd':
+      data_dir = optarg;
+      break;
+    case 'm':
+      selected_modes.push_back(optarg);
+      break;
+    case 'n':
+      num_lines = atoi(optarg);
+      require(num_lines>=0, "Number of lines (-n) must be positive or zero (>=0).");
+      break;
+    case 'o':
+      fname_json = optarg;
+      break;
+    case 'h':
+    case '?':
+    case ':':
+      cout << usage;
+      exit(c==':' ? 1 : 0);
+      break;
+    }
+  }
+
+  vector<string> datasets;
+  for (int i=optind; i<argc; i++) {
+    datasets.push_back(argv[i]);
+  }
+  if (datasets.empty()) {
+    datasets.assign(default_datasets,
+        default_datasets + sizeof(default_datasets)/sizeof(char*));
+  }
+  for (unsigned int i=0; i<selected_modes.size(); i++) {
+    bool found = false;
+    for (int m=0; m<num_modes; m++) {
+      found = found || (selected_modes[i]==modes[m].name);
+    }
+    require(found, ("bench: unknown mode " + selected_modes[i]).c_str());
+  }
+
+  vector<Result> results;
+  print_header();
+  for (unsigned int d=0; d<datasets.size(); d++) {
+    string fname = datasets[d];
+    if (fname.find('/')==string::npos) {
+      fname = data_dir + "/" + fname;
+    }
+    for (int m=0; m<num_modes; m++) {
+      if (!selected_modes.empty() && find(selected_modes.begin(),
+          selected_modes.end(), modes[m].name)==selected_modes.end()) {
+        continue;
+      }
+      Result result = run_forked(fname, modes[m], num_lines);
+      result.dataset = datasets[d];
+      print_result(result);
+      results.push_back(result);
+    }
+  }
+
+  if (fname_json != "") {
+    save_json(fname_json, results);
+    cout << "Saved results to " << fname_json << endl;
+  }
+
+  return 0;
+}
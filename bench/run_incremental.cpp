@@ -0,0 +1,69 @@
+/**
+ * @file run_incremental.cpp
+ * @brief Incremental processing of a data set, shared by the benchmarks.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <list>
+
+#include <isam/util.h>
+
+#include "run_incremental.h"
+
+using namespace std;
+using namespace isam;
+
+double run_incremental(Loader& loader, Slam& slam, bool incremental,
+                       vector<double>* latencies) {
+  unsigned int step = 0;
+  unsigned int next_step = step;
+  for (; loader.more_data(&next_step); step = next_step) {
+    double t0 = tic();
+    for (unsigned int s = step; s < next_step; s++) {
+      for (list<Node*>::const_iterator it = loader.nodes(s).begin();
+          it != loader.nodes(s).end(); it++) {
+        slam.add_node(*it);
+      }
+      for (list<Factor*>::const_iterator it = loader.factors(s).begin();
+          it != loader.factors(s).end(); it++) {
+        slam.add_factor(*it);
+      }
+    }
+    if (incremental) {
+      slam.update();
+      if (latencies) {
+        latencies->push_back(toc(t0));
+      }
+    }
+  }
+  if (!incremental) {
+    return 0.;
+  }
+
+  // end with a batch step/relinearization, as the isam executable
+  double t0 = tic();
+  Properties prop = slam.properties();
+  prop.mod_batch = 1;
+  slam.set_properties(prop);
+  slam.update();
+  return toc(t0);
+}
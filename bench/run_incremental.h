@@ -0,0 +1,46 @@
+/**
+ * @file run_incremental.h
+ * @brief Incremental processing of a data set, shared by the benchmarks.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <isam/Slam.h>
+
+#include "Loader.h"
+
+/**
+ * Adds the nodes and factors of each step of a data set to the Slam
+ * object, as the isam executable does. In incremental mode each step
+ * ends with update() and the run with a batch step/relinearization.
+ * @param loader Data set, read step by step.
+ * @param slam Slam object receiving nodes and factors.
+ * @param incremental Update after each step and at the end, otherwise
+ *   only builds the graph for a subsequent batch optimization.
+ * @param latencies If not NULL, returns the time of each incremental step.
+ * @return Time of the final batch step, 0 if not incremental.
+ */
+double run_incremental(Loader& loader, isam::Slam& slam, bool incremental = true,
+                       std::vector<double>* latencies = NULL);
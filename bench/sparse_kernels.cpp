@@ -0,0 +1,572 @@
+/**
+ * @file sparse_kernels.cpp
+ * @brief Microbenchmarks for the sparse linear algebra kernels.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <isam/isam.h>
+
+#include "Loader.h"
+
+using namespace std;
+using namespace isam;
+using namespace Eigen;
+
+const string usage = "\n"
+    "Usage:\n"
+    "  isam_microbench [options]\n"
+    "\n"
+    "Times the sparse vector/matrix kernels on synthetic R factors of 2D\n"
+    "and 3D pose graphs, and on the R factor of a data set, reporting ns/op,\n"
+    "allocations/op and throughput.\n"
+    "\n"
+    "Options:\n"
+    "  -h, -?         show this help\n"
+    "  -f <fname>     data set for the dataset-derived R factor\n"
+    "  -n <number>    max. number of lines to read from the data set, 0=all\n"
+    "  -D             skip the dataset-derived R factor\n"
+    "  -t <seconds>   minimum time per benchmark\n"
+    "  -o <fname>     write results as JSON\n"
+    "\n";
+
+// allocation counting: on glibc all allocations (including operator new
+// and Eigen) go through malloc, which is interposed here
+long num_allocations = 0;
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* malloc(size_t size) {
+  num_allocations++;
+  return __libc_malloc(size);
+}
+void* calloc(size_t n, size_t size) {
+  num_allocations++;
+  return __libc_calloc(n, size);
+}
+void* realloc(void* ptr, size_t size) {
+  num_allocations++;
+  return __libc_realloc(ptr, size);
+}
+}
+const bool count_allocations = true;
+#else
+const bool count_allocations = false;
+#endif
+
+// results are accumulated here so that the computations are not optimized away
+volatile double sink = 0.;
+
+double random_value() {
+  return 2. * (double)rand() / (double)RAND_MAX - 1.;
+}
+
+// column indices 0, 2, 4, ... in random order
+vector<int> random_indices(int n) {
+  vector<int> indices(n);
+  for (int k=0; k<n; k++) indices[k] = 2*k;
+  for (int k=n-1; k>0; k--) std::swap(indices[k], indices[rand()%(k+1)]);
+  return indices;
+}
+
+/**
+ * A benchmark performs ops() operations on items() entries (or rows)
+ * per call of run(); setup() is not timed.
+ */
+class Benchmark {
+public:
+  virtual ~Benchmark() {}
+  virtual string name() const = 0;
+  virtual void setup() {}
+  virtual void run() = 0;
+  virtual long ops() const {return 1;}
+  virtual double items() const = 0;
+  virtual const char* unit() const {return "entries";}
+};
+
+struct Measurement {
+  string name;
+  string matrix;
+  long ops;
+  double ns_per_op;
+  double allocs_per_op;
+  double throughput;
+  string unit;
+};
+
+vector<Measurement> measurements;
+double min_time = 0.2;
+
+void measure(Benchmark& b, const string& matrix) {
+  // warm up
+  b.setup();
+  b.run();
+  long ops = 0;
+  long allocs = 0;
+  double items = 0.;
+  double elapsed = 0.;
+  while (elapsed < min_time) {
+    b.setup();
+    long a0 = num_allocations;
+    double t0 = tic();
+    b.run();
+    elapsed += toc(t0);
+    allocs += num_allocations - a0;
+    ops += b.ops();
+    items += b.items();
+  }
+  Measurement m;
+  m.name = b.name();
+  m.matrix = matrix;
+  m.ops = ops;
+  m.ns_per_op = elapsed / ops * 1e9;
+  m.allocs_per_op = (double)allocs / ops;
+  m.throughput = items / elapsed;
+  m.unit = b.unit();
+  measurements.push_back(m);
+  printf("%-38s %-22s %12.1f ", m.name.c_str(), m.matrix.c_str(), m.ns_per_op);
+  if (count_allocations) {
+    printf("%10.2f", m.allocs_per_op);
+  } else {
+    printf("%10s", "n/a");
+  }
+  printf(" %10.2f M%s/s\n", m.throughput/1e6, m.unit.c_str());
+  fflush(stdout);
+}
+
+//-- SparseVector -----------------------------
+
+class VectorAppend : public Benchmark {
+  int _n;
+public:
+  VectorAppend(int n) : _n(n) {}
+  string name() const {return "SparseVector::append";}
+  void run() {
+    SparseVector v;
+    for (int k=0; k<_n; k++) {
+      v.append(2*k, 1.);
+    }
+    sink += v.nnz();
+  }
+  long ops() const {return _n;}
+  double items() const {return _n;}
+};
+
+class VectorSet : public Benchmark {
+  vector<int> _order;
+public:
+  VectorSet(int n) : _order(random_indices(n)) {}
+  string name() const {return "SparseVector::set (random)";}
+  void run() {
+    SparseVector v;
+    for (unsigned int k=0; k<_order.size(); k++) {
+      v.set(_order[k], 1.);
+    }
+    sink += v.nnz();
+  }
+  long ops() const {return _order.size();}
+  double items() const {return _order.size();}
+};
+
+class VectorRemove : public Benchmark {
+  vector<int> _order;
+  SparseVector _v;
+public:
+  VectorRemove(int n) : _order(random_indices(n)) {}
+  string name() const {return "SparseVector::remove (random)";}
+  void setup() {
+    _v = SparseVector(_order.size());
+    for (unsigned int k=0; k<_order.size(); k++) {
+      _v.append(2*k, 1.);
+    }
+  }
+  void run() {
+    for (unsigned int k=0; k<_order.size(); k++) {
+      _v.remove(_order[k]);
+    }
+    sink += _v.nnz();
+  }
+  long ops() const {return _order.size();}
+  double items() const {return _order.size();}
+};
+
+//-- matrix kernels -----------------------------
+
+class MatrixVector : public Benchmark {
+  const SparseSystem& _R;
+  VectorXd _x;
+public:
+  MatrixVector(const SparseSystem& R) : _R(R), _x(R.num_cols()) {
+    for (int i=0; i<_x.size(); i++) _x(i) = random_value();
+  }
+  string name() const {return "operator*(SparseMatrix, VectorXd)";}
+  void run() {
+    VectorXd y = _R * _x;
+    sink += y(0);
+  }
+  double items() const {return _R.nnz();}
+};
+
+class MatrixTransVector : public Benchmark {
+  const SparseSystem& _R;
+  VectorXd _x;
+public:
+  MatrixTransVector(const SparseSystem& R) : _R(R), _x(R.num_rows()) {
+    for (int i=0; i<_x.size(); i++) _x(i) = random_value();
+  }
+  string name() const {return "mul_SparseMatrixTrans_Vector";}
+  void run() {
+    VectorXd y = mul_SparseMatrixTrans_Vector(_R, _x);
+    sink += y(0);
+  }
+  double items() const {return _R.nnz();}
+};
+
+class BackSubstitution : public Benchmark {
+  const SparseSystem& _R;
+public:
+  BackSubstitution(const SparseSystem& R) : _R(R) {}
+  string name() const {return "SparseSystem::solve";}
+  void run() {
+    VectorXd x = _R.solve();
+    sink += x(0);
+  }
+  double items() const {return _R.nnz();}
+};
+
+/**
+ * New measurement rows as from loop closures: one block on an earlier
+ * variable and one on the last variable.
+ */
+void new_rows(int num_cols, int block, int num, vector<SparseVector>& rows) {
+  rows.clear();
+  int last = num_cols - block;
+  for (int k=0; k<num; k++) {
+    int earlier = (rand() % (num_cols/block - 1)) * block;
+    for (int r=0; r<block; r++) {
+      SparseVector row(2*block);
+      for (int c=0; c<block; c++) row.append(earlier+c, random_value());
+      for (int c=0; c<block; c++) row.append(last+c, random_value());
+      rows.push_back(row);
+    }
+  }
+}
+
+class AddRowGivens : public Benchmark {
+  const SparseSystem& _R;
+  SparseSystem _copy;
+  vector<SparseVector> _rows;
+  int _count;
+public:
+  AddRowGivens(const SparseSystem& R, int block)
+    : _R(R), _copy(1, 1), _count(0) {
+    new_rows(R.num_cols(), block, 10, _rows);
+  }
+  string name() const {return "SparseSystem::add_row_givens";}
+  void setup() {_copy = _R;}
+  void run() {
+    _count = 0;
+    for (unsigned int k=0; k<_rows.size(); k++) {
+      _count += _copy.add_row_givens(_rows[k], 1.);
+    }
+  }
+  long ops() const {return _rows.size();}
+  double items() const {return _count;}
+  const char* unit() const {return "rotations";}
+};
+
+// R with additional measurement rows below
+class WithNewRows : public Benchmark {
+protected:
+  const SparseSystem& _R;
+  SparseSystem _copy;
+  vector<SparseVector> _rows;
+  int _count;
+public:
+  WithNewRows(const SparseSystem& R, int block)
+    : _R(R), _copy(1, 1), _count(0) {
+    new_rows(R.num_cols(), block, 10, _rows);
+  }
+  void setup() {
+    _copy = _R;
+    for (unsigned int k=0; k<_rows.size(); k++) {
+      _copy.add_row(_rows[k], 1.);
+    }
+  }
+  double items() const {return _count;}
+  const char* unit() const {return "rotations";}
+};
+
+class ApplyGivens : public WithNewRows {
+public:
+  ApplyGivens(const SparseSystem& R, int block) : WithNewRows(R, block) {}
+  string name() const {return "SparseMatrix::apply_givens";}
+  void run() {
+    _count = 0;
+    for (int row=_R.num_rows(); row<_copy.num_rows(); row++) {
+      int col = _copy.get_row(row).first();
+      while (col>=0 && col<row) {
+        _copy.apply_givens(row, col);
+        _count++;
+        col = _copy.get_row(row).first();
+      }
+    }
+  }
+  long ops() const {return std::max(_count, 1);}
+};
+
+class TriangulateWithGivens : public WithNewRows {
+public:
+  TriangulateWithGivens(const SparseSystem& R, int block) : WithNewRows(R, block) {}
+  string name() const {return "SparseMatrix::triangulate_with_givens";}
+  void run() {
+    _count = _copy.triangulate_with_givens();
+  }
+};
+
+/**
+ * Conversion into the transposed compressed column format used by
+ * CHOLMOD and CSparse (see Cholesky.cpp), without the allocation.
+ */
+class ToCscTransp : public Benchmark {
+  const SparseSystem& _R;
+  vector<int> _p;
+  vector<int> _i;
+  vector<double> _x;
+public:
+  ToCscTransp(const SparseSystem& R)
+    : _R(R), _p(R.num_rows()+1), _i(R.nnz()), _x(R.nnz()) {}
+  string name() const {return "csc_transp_of_sparseMatrix";}
+  void run() {
+    csc_transp_of_sparseMatrix(_R, &_p[0], &_i[0], &_x[0]);
+    sink += _x[0];
+  }
+  double items() const {return _R.nnz();}
+  const vector<int>& p() const {return _p;}
+  const vector<int>& i() const {return _i;}
+  const vector<double>& x() const {return _x;}
+};
+
+/**
+ * Conversion from the transposed compressed column format used by
+ * CHOLMOD and CSparse (see Cholesky.cpp).
+ */
+class OfCscTransp : public Benchmark {
+  int _num_rows;
+  int _num_cols;
+  vector<int> _p;
+  vector<int> _i;
+  vector<double> _x;
+  vector<int> _order;
+  SparseSystem _A;
+public:
+  OfCscTransp(const SparseSystem& R) : _num_rows(R.num_rows()),
+    _num_cols(R.num_cols()), _order(R.num_cols()), _A(1, 1) {
+    ToCscTransp to(R);
+    to.run();
+    _p = to.p();
+    _i = to.i();
+    _x = to.x();
+    for (int k=0; k<_num_cols; k++) _order[k] = k;
+  }
+  string name() const {return "rows_of_csc_transp";}
+  void run() {
+    SparseVector_p* rows = new SparseVector_p[_num_rows];
+    rows_of_csc_transp(_num_rows, &_p[0], &_i[0], &_x[0], rows);
+    _A.import_rows_ordered(_num_rows, _num_cols, rows, &_order[0]);
+    delete [] rows;
+  }
+  double items() const {return _x.size();}
+};
+
+void run_matrix_benchmarks(const SparseSystem& R, const string& label, int block) {
+  MatrixVector mv(R);
+  measure(mv, label);
+  MatrixTransVector mtv(R);
+  measure(mtv, label);
+  BackSubstitution solve(R);
+  measure(solve, label);
+  AddRowGivens arg(R, block);
+  measure(arg, label);
+  ApplyGivens ag(R, block);
+  measure(ag, label);
+  TriangulateWithGivens twg(R, block);
+  measure(twg, label);
+  ToCscTransp to(R);
+  measure(to, label);
+  OfCscTransp of(R);
+  measure(of, label);
+}
+
+/**
+ * Square root information matrix R of a pose graph (chain of poses
+ * with local loop closures), built incrementally with Givens rotations.
+ */
+SparseSystem synthetic_R(int num_poses, int block) {
+  SparseSystem R(0, 0);
+  // prior
+  for (int r=0; r<block; r++) {
+    SparseVector row(1);
+    row.append(r, 1.);
+    R.add_row_givens(row, 0.);
+  }
+  for (int i=1; i<num_poses; i++) {
+    // odometry, followed by a loop closure to a recent pose every 5 steps
+    int num_constraints = (i%5==0 && i>10) ? 2 : 1;
+    for (int k=0; k<num_constraints; k++) {
+      int j = (k==0) ? i-1 : i - 2 - rand()%std::min(i-1, 50);
+      for (int r=0; r<block; r++) {
+        SparseVector row(2*block);
+        for (int c=0; c<block; c++) {
+          row.append(j*block+c, ((c==r) ? -1. : 0.) + 0.1*random_value());
+        }
+        for (int c=0; c<block; c++) {
+          row.append(i*block+c, ((c==r) ? 1. : 0.) + 0.1*random_value());
+        }
+        R.add_row_givens(row, random_value());
+      }
+    }
+  }
+  return R;
+}
+
+void save_json(const string& fname) {
+  ofstream out(fname.c_str());
+  require(out, "microbench: cannot open JSON output file");
+  out << setprecision(10);
+  out << "{" << endl << "  \"benchmarks\": [" << endl;
+  for (unsigned int k=0; k<measurements.size(); k++) {
+    const Measurement& m = measurements[k];
+    out << "    {\"name\": \"" << m.name << "\", \"matrix\": \"" << m.matrix
+        << "\", \"ops\": " << m.ops << ", \"ns_per_op\": " << m.ns_per_op;
+    if (count_allocations) {
+      out << ", \"allocs_per_op\": " << m.allocs_per_op;
+    }
+    out << ", \"throughput\": " << m.throughput << ", \"unit\": \"" << m.unit
+        << "/s\"}" << ((k+1<measurements.size()) ? "," : "") << endl;
+  }
+  out << "  ]" << endl << "}" << endl;
+}
+
+int main(int argc, char* argv[]) {
+#ifdef ISAM_DATA_DIR
+  string fname = string(ISAM_DATA_DIR) + "/manhattanOlson3500.txt";
+#else
+  string fname = "data/manhattanOlson3500.txt";
+#endif
+  string fname_json;
+  int num_lines = 0;
+  bool use_dataset = true;
+
+  int c;
+  while ((c = getopt(argc, argv, ":h?f:n:Dt:o:")) != -1) {
+    switch (c) {
+    case 'f':
+      fname = optarg;
+      break;
+    case 'n':
+      num_lines = atoi(optarg);
+      require(num_lines>=0, "Number of lines (-n) must be positive or zero (>=0).");
+      break;
+    case 'D':
+      use_dataset = false;
+      break;
+    case 't':
+      min_time = atof(optarg);
+      require(min_time>0, "Minimum time (-t) must be positive (>0).");
+      break;
+    case 'o':
+      fname_json = optarg;
+      break;
+    case 'h':
+    case '?':
+    case ':':
+      cout << usage;
+      exit(c==':' ? 1 : 0);
+      break;
+    }
+  }
+
+  srand(1);
+
+  printf("%-38s %-22s %12s %10s %17s\n", "kernel", "matrix", "ns/op",
+      "allocs/op", "throughput");
+
+  const int sizes[] = {32, 512};
+  for (int k=0; k<2; k++) {
+    char label[32];
+    sprintf(label, "vector nnz=%d", sizes[k]);
+    VectorAppend append(sizes[k]);
+    measure(append, label);
+    VectorSet set(sizes[k]);
+    measure(set, label);
+    VectorRemove remove(sizes[k]);
+    measure(remove, label);
+  }
+
+  SparseSystem R2 = synthetic_R(2000, 3);
+  run_matrix_benchmarks(R2, "synthetic 2D (6000)", 3);
+  SparseSystem R3 = synthetic_R(1000, 6);
+  run_matrix_benchmarks(R3, "synthetic 3D (6000)", 6);
+
+  if (use_dataset) {
+    Loader loader(fname.c_str(), num_lines, false);
+    Slam slam;
+    Properties prop = slam.properties();
+    prop.quiet = true;
+    slam.set_properties(prop);
+    for (unsigned int s=0; s<loader.num_steps(); s++) {
+      for (list<Node*>::const_iterator it = loader.nodes(s).begin();
+          it != loader.nodes(s).end(); it++) {
+        slam.add_node(*it);
+      }
+      for (list<Factor*>::const_iterator it = loader.factors(s).begin();
+          it != loader.factors(s).end(); it++) {
+        slam.add_factor(*it);
+      }
+    }
+    slam.batch_optimization();
+    const SparseSystem& R = slam.get_R();
+    string label = fname.substr(fname.find_last_of('/')+1);
+    label = label.substr(0, label.find_last_of('.'));
+    run_matrix_benchmarks(R, label, loader.is_3d() ? 6 : 3);
+  }
+
+  if (fname_json != "") {
+    save_json(fname_json);
+    cout << "Saved results to " << fname_json << endl;
+  }
+
+  return 0;
+}
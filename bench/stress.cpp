@@ -0,0 +1,241 @@
+/**
+ * @file stress.cpp
+ * @brief Runs many independent Slam instances concurrently.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include <isam/isam.h>
+
+#include "Loader.h"
+#include "run_incremental.h"
+
+using namespace std;
+using namespace isam;
+
+const string usage = "\n"
+    "Usage:\n"
+    "  stress [options] [data set ...]\n"
+    "\n"
+    "Runs each data set (file name in the data directory, or a path) once to\n"
+    "obtain reference results, then runs it repeatedly in concurrent threads,\n"
+    "each with its own Slam object, and checks that every concurrent run\n"
+    "reproduces the reference results exactly.\n"
+    "\n"
+    "Options:\n"
+    "  -h, -?         show this help\n"
+    "  -d <dir>       data directory\n"
+    "  -j <number>    number of threads (default 8)\n"
+    "  -r <number>    number of runs of each data set (default: threads)\n"
+    "  -n <number>    max. number of lines to read from each data set, 0=all\n"
+    "\n";
+
+const char* default_datasets[] = {
+  "manhattanOlson3500.txt",
+  "sphere400.txt",
+  "victoriaPark.txt",
+  "torus2000Points.txt"
+};
+
+/**
+ * Results of one run, compared for equality.
+ */
+struct Result {
+  int num_nodes;
+  double chi2;
+  double checksum; // sum of all estimates
+};
+
+/**
+ * Incremental processing of one data set as by the isam executable.
+ */
+Result run(const string& fname, int num_lines) {
+  Loader loader(fname.c_str(), num_lines, false);
+  Slam slam;
+  Properties prop = slam.properties();
+  prop.quiet = true;
+  slam.set_properties(prop);
+
+  run_incremental(loader, slam);
+
+  Result result;
+  result.num_nodes = slam.get_nodes().size();
+  result.chi2 = slam.chi2();
+  result.checksum = 0.;
+  for (list<Node*>::const_iterator it = slam.get_nodes().begin();
+      it != slam.get_nodes().end(); it++) {
+    result.checksum += (*it)->vector(ESTIMATE).sum();
+  }
+  return result;
+}
+
+/**
+ * Work shared by the threads: the runs are taken from the list in
+ * order, each thread checks its results against the reference.
+ */
+class Jobs {
+public:
+  Jobs(const vector<string>& fnames, const vector<Result>& reference,
+       int runs, int num_lines)
+    : _fnames(fnames), _reference(reference), _runs(runs),
+      _num_lines(num_lines), _next(0), _failed(0)
+  {
+    pthread_mutex_init(&_mutex, NULL);
+  }
+
+  ~Jobs() {
+    pthread_mutex_destroy(&_mutex);
+  }
+
+  int failed() const {return _failed;}
+
+  static void* worker(void* jobs) {
+    static_cast<Jobs*>(jobs)->work();
+    return NULL;
+  }
+
+private:
+  const vector<string>& _fnames;
+  const vector<Result>& _reference;
+  int _runs;
+  int _num_lines;
+  pthread_mutex_t _mutex;
+  int _next; // next job, protected by _mutex
+  int _failed; // protected by _mutex
+
+  void work() {
+    int num_jobs = _runs * _fnames.size();
+    while (true) {
+      pthread_mutex_lock(&_mutex);
+      int job = _next++;
+      pthread_mutex_unlock(&_mutex);
+      if (job >= num_jobs) break;
+
+      // interleave the data sets
+      int d = job % _fnames.size();
+      Result r = run(_fnames[d], _num_lines);
+      const Result& ref = _reference[d];
+      bool ok = (r.num_nodes==ref.num_nodes && r.chi2==ref.chi2
+                 && r.checksum==ref.checksum);
+
+      pthread_mutex_lock(&_mutex);
+      if (!ok) {
+        _failed++;
+        printf("Run %i of %s differs: chi2 %.17g, checksum %.17g\n",
+            job/(int)_fnames.size()+1, _fnames[d].c_str(), r.chi2, r.checksum);
+      }
+      pthread_mutex_unlock(&_mutex);
+    }
+  }
+};
+
+int main(int argc, char* argv[]) {
+#ifdef ISAM_DATA_DIR
+  string data_dir = ISAM_DATA_DIR;
+#else
+  string data_dir = "data";
+#endif
+  int num_threads = 8;
+  int runs = 0;
+  int num_lines = 0;
+
+  int c;
+  while ((c = getopt(argc, argv, ":h?d:j:r:n:")) != -1) {
+    switch (c) {
+    case 'd':
+      data_dir = optarg;
+      break;
+    case 'j':
+      num_threads = atoi(optarg);
+      require(num_threads>0, "Number of threads (-j) must be positive (>0).");
+      break;
+    case 'r':
+      runs = atoi(optarg);
+      require(runs>0, "Number of runs (-r) must be positive (>0).");
+      break;
+    case 'n':
+      num_lines = atoi(optarg);
+      require(num_lines>=0, "Number of lines (-n) must be positive or zero (>=0).");
+      break;
+    case 'h':
+    case '?':
+    case ':':
+      cout << usage;
+      exit(c==':' ? 1 : 0);
+      break;
+    }
+  }
+  if (runs==0) {
+    runs = num_threads;
+  }
+
+  vector<string> fnames;
+  for (int i=optind; i<argc; i++) {
+    fnames.push_back(argv[i]);
+  }
+  if (fnames.empty()) {
+    fnames.assign(default_datasets,
+        default_datasets + sizeof(default_datasets)/sizeof(char*));
+  }
+  for (unsigned int d=0; d<fnames.size(); d++) {
+    if (fnames[d].find('/')==string::npos) {
+      fnames[d] = data_dir + "/" + fnames[d];
+    }
+  }
+
+  vector<Result> reference;
+  for (unsigned int d=0; d<fnames.size(); d++) {
+    Result r = run(fnames[d], num_lines);
+    printf("%-40s %6i nodes, chi2 %.17g\n", fnames[d].c_str(), r.num_nodes, r.chi2);
+    reference.push_back(r);
+  }
+
+  printf("Running each data set %i times in %i threads\n", runs, num_threads);
+  fflush(stdout);
+  double t0 = tic();
+  Jobs jobs(fnames, reference, runs, num_lines);
+  vector<pthread_t> threads(num_threads);
+  for (int i=0; i<num_threads; i++) {
+    require(pthread_create(&threads[i], NULL, Jobs::worker, &jobs)==0,
+            "stress: Failed to create thread");
+  }
+  for (int i=0; i<num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  double t = toc(t0);
+
+  int total = runs * fnames.size();
+  if (jobs.failed() > 0) {
+    printf("FAILED: %i of %i runs differ (%gs)\n", jobs.failed(), total, t);
+    return 1;
+  }
+  printf("OK: %i runs reproduced the reference results (%gs)\n", total, t);
+  return 0;
+}
@@ -105,4 +105,15 @@ int main(int argc, const char* argv[]) {
   for (list<MatrixXd>::iterator it = cov_entries.begin(); it!=cov_entries.end(); it++) {
     cout << *it << endl;
   }
+
+  // gating of candidate measurements that are not part of the graph
+  cout << "Squared Mahalanobis distances:" << endl;
+  vector<Factor*> candidates;
+  candidates.push_back(new Pose2d_Pose2d_Factor(pose_node_1, pose_node_2, delta, noise));
+  candidates.push_back(new Pose2d_Pose2d_Factor(pose_node_1, pose_node_2, Pose2d(2., 0., 0.), noise));
+  vector<double> distances = covariances.mahalanobis(candidates);
+  for (unsigned int k=0; k<distances.size(); k++) {
+    cout << distances[k] << endl;
+    delete candidates[k];
+  }
 }
@@ -21,9 +21,7 @@ const double f = 360;  // focal length in pixels
 const double u0 = 240; // principal point in pixels
 const double v0 = 120;
 
-double robust_cost_function(double d) {
-  return cost_pseudo_huber(d, .5);
-}
+PseudoHuberKernel robust_kernel(.5);
 
 void simple_monocular() {
 
@@ -83,7 +81,7 @@ void simple_monocular() {
   Properties prop = slam.properties();
   prop.method = DOG_LEG;
   slam.set_properties(prop);
-//  slam.set_cost_function(robust_cost_function);
+//  slam.set_robust_kernel(&robust_kernel);
 
   // optimize
   slam.batch_optimization();
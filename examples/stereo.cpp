@@ -22,9 +22,7 @@ const double u0 = 240; // principal point in pixels
 const double v0 = 120;
 const double b = 0.12; // baseline in meters
 
-double robust_cost_function(double d) {
-  return cost_pseudo_huber(d, .5);
-}
+PseudoHuberKernel robust_kernel(.5);
 
 void simple_stereo() {
 
@@ -84,7 +82,7 @@ void simple_stereo() {
   Properties prop = slam.properties();
   prop.method = DOG_LEG;
   slam.set_properties(prop);
-//  slam.set_cost_function(robust_cost_function);
+//  slam.set_robust_kernel(&robust_kernel);
 
   // optimize
   slam.batch_optimization();
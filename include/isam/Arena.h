@@ -0,0 +1,158 @@
+/**
+ * @file Arena.h
+ * @brief Region based allocation of nodes, factors and their values.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <new>
+
+namespace isam {
+
+class Element;
+class Node;
+
+/**
+ * Allocates objects contiguously from large blocks of memory and
+ * releases them all at once when the arena is destroyed.
+ *
+ * Nodes and factors constructed by create() are owned by the arena:
+ * they are destroyed (in reverse order of creation) together with the
+ * arena and must not be deleted by the caller. Nodes created this way
+ * also take the storage for their estimate and linearization point
+ * from the arena, so that nodes created one after the other and their
+ * values end up next to each other in memory.
+ *
+ * Example:
+ *   Pose2d_Node* pose = slam.arena().create<Pose2d_Node>();
+ *   slam.add_node(pose);
+ */
+class Arena {
+  Arena(const Arena& rhs); // not allowed
+  const Arena& operator= (const Arena& rhs); // not allowed
+
+  size_t _block_size;
+  std::vector<char*> _blocks;
+  char* _next;
+  char* _end;
+  size_t _allocated;
+  size_t _reserved;
+
+  // objects to destroy, in order of creation
+  std::vector<Element*> _elements;
+
+  char* new_block(size_t size);
+  void adopt(Element* element);
+  void adopt(Node* node);
+
+public:
+
+  /**
+   * Alignment of all allocations, sufficient for Eigen's fixed size types.
+   */
+  static const size_t ALIGNMENT = 32;
+
+  /**
+   * @param block_size Size of the memory blocks requested from the system.
+   */
+  Arena(size_t block_size = 1<<20);
+
+  /**
+   * Destroys all nodes and factors created by the arena and frees its memory.
+   */
+  ~Arena();
+
+  /**
+   * Raw allocation, only released when the arena is destroyed.
+   * @param size Number of bytes.
+   * @return Aligned memory.
+   */
+  void* allocate(size_t size);
+
+  /**
+   * @return Number of bytes handed out so far.
+   */
+  size_t allocated() const {return _allocated;}
+
+  /**
+   * @return Number of bytes reserved from the system.
+   */
+  size_t reserved() const {return _reserved;}
+
+  /**
+   * Constructs a node or factor in the arena, passing on the arguments
+   * to its constructor.
+   */
+  template <class T>
+  T* create() {
+    T* object = new (allocate(sizeof(T))) T();
+    adopt(object);
+    return object;
+  }
+
+  template <class T, class A1>
+  T* create(const A1& a1) {
+    T* object = new (allocate(sizeof(T))) T(a1);
+    adopt(object);
+    return object;
+  }
+
+  template <class T, class A1, class A2>
+  T* create(const A1& a1, const A2& a2) {
+    T* object = new (allocate(sizeof(T))) T(a1, a2);
+    adopt(object);
+    return object;
+  }
+
+  template <class T, class A1, class A2, class A3>
+  T* create(const A1& a1, const A2& a2, const A3& a3) {
+    T* object = new (allocate(sizeof(T))) T(a1, a2, a3);
+    adopt(object);
+    return object;
+  }
+
+  template <class T, class A1, class A2, class A3, class A4>
+  T* create(const A1& a1, const A2& a2, const A3& a3, const A4& a4) {
+    T* object = new (allocate(sizeof(T))) T(a1, a2, a3, a4);
+    adopt(object);
+    return object;
+  }
+
+  template <class T, class A1, class A2, class A3, class A4, class A5>
+  T* create(const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5) {
+    T* object = new (allocate(sizeof(T))) T(a1, a2, a3, a4, a5);
+    adopt(object);
+    return object;
+  }
+
+  template <class T, class A1, class A2, class A3, class A4, class A5, class A6>
+  T* create(const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6) {
+    T* object = new (allocate(sizeof(T))) T(a1, a2, a3, a4, a5, a6);
+    adopt(object);
+    return object;
+  }
+};
+
+}
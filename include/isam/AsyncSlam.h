@@ -0,0 +1,222 @@
+/**
+ * @file AsyncSlam.h
+ * @brief Runs Slam updates on a background solver thread.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <pthread.h>
+#include <Eigen/Dense>
+
+#include "Slam.h"
+
+namespace isam {
+
+/**
+ * Result of an update requested from AsyncSlam, available once the
+ * solver thread has performed the update. Copies refer to the same
+ * result.
+ */
+class UpdateFuture {
+public:
+  struct State;
+
+  UpdateFuture();
+  UpdateFuture(const UpdateFuture& rhs);
+  const UpdateFuture& operator= (const UpdateFuture& rhs);
+  ~UpdateFuture();
+
+  /**
+   * @return True if this refers to a requested update.
+   */
+  bool valid() const {return _state != NULL;}
+
+  /**
+   * @return True if the update has been performed, does not block.
+   */
+  bool ready() const;
+
+  /**
+   * Waits until the update has been performed.
+   * @return Statistics returned by Slam::update().
+   */
+  const UpdateStats& get() const;
+
+private:
+  friend class AsyncSlam;
+  explicit UpdateFuture(State* state);
+  State* _state;
+};
+
+/**
+ * Asynchronous interface to a Slam object: nodes, factors and update
+ * requests are queued and processed in order by a dedicated solver
+ * thread, so that the threads adding measurements only ever wait for
+ * the queue, never for an update in progress.
+ *
+ * After each update the estimates of all nodes are copied into a back
+ * buffer that is then swapped with the front buffer read by estimate(),
+ * so that readers always see the consistent result of one update.
+ *
+ * While the solver thread runs, the Slam object and the values of its
+ * nodes must not be accessed directly; use estimate() instead. Once
+ * flush() has returned, and as long as nothing new is queued, the Slam
+ * object may be used directly (for example for covariances or saving),
+ * except that nodes must only be removed through remove_node(). The
+ * sliding window (Properties::window) is not supported, as it removes
+ * nodes during updates.
+ *
+ * Example:
+ *   AsyncSlam async(slam);
+ *   async.add_node(pose);
+ *   async.add_factor(odometry);
+ *   UpdateFuture f = async.update();
+ *   ...
+ *   VectorXd x;
+ *   if (async.estimate(pose, x)) ...
+ *   cout << f.get().step << endl;
+ */
+class AsyncSlam {
+  AsyncSlam(const AsyncSlam& rhs); // not allowed
+  const AsyncSlam& operator= (const AsyncSlam& rhs); // not allowed
+
+public:
+
+  /**
+   * Called on the solver thread after an update has been performed and
+   * its estimates published, before its future becomes ready.
+   */
+  typedef void (*callback_t)(const UpdateStats& stats, void* data);
+
+  /**
+   * Starts the solver thread.
+   * @param slam Slam object, only accessed by the solver thread from now on.
+   */
+  AsyncSlam(Slam& slam);
+
+  /**
+   * Processes all queued work and stops the solver thread.
+   */
+  ~AsyncSlam();
+
+  /**
+   * Queues a node to be added, see Slam::add_node().
+   */
+  void add_node(Node* node);
+
+  /**
+   * Queues a factor to be added, see Slam::add_factor().
+   */
+  void add_factor(Factor* factor);
+
+  /**
+   * Queues a node to be removed together with its factors, see
+   * Slam::remove_node(); its estimate is no longer available once the
+   * removal has been processed. The node may only be deallocated after
+   * that, for example after flush().
+   */
+  void remove_node(Node* node);
+
+  /**
+   * Queues an update after the nodes and factors queued so far, see
+   * Slam::update().
+   * @param callback Optional, called on the solver thread when done.
+   * @param data Passed on to the callback.
+   * @return Future for the statistics of the update.
+   */
+  UpdateFuture update(callback_t callback = NULL, void* data = NULL);
+
+  /**
+   * Waits until all queued work has been processed.
+   */
+  void flush();
+
+  /**
+   * Latest published estimate of a node.
+   * @param node Node added through this object.
+   * @param value Returns the estimate (see Node::vector()).
+   * @return False if no update has been published since the node was added.
+   */
+  bool estimate(Node* node, Eigen::VectorXd& value) const;
+
+  /**
+   * @return Step of the last published update (see UpdateStats::step),
+   *   0 if none.
+   */
+  int published_step() const;
+
+  /**
+   * @return Number of queued nodes, factors and updates not yet processed.
+   */
+  unsigned int pending() const;
+
+private:
+
+  enum Type {NODE, FACTOR, REMOVE_NODE, UPDATE};
+
+  struct Command {
+    Type type;
+    Node* node;
+    Factor* factor;
+    UpdateFuture::State* future;
+    callback_t callback;
+    void* data;
+  };
+
+  Slam& _slam;
+
+  // queue, protected by _mutex
+  std::deque<Command> _queue;
+  bool _busy; // solver thread processing a command
+  bool _stop;
+  mutable pthread_mutex_t _mutex;
+  pthread_cond_t _cond_queued;
+  pthread_cond_t _cond_idle;
+  pthread_t _thread;
+
+  // published estimates: _front, _index (offset and dimension of each
+  // node in the buffers) and _published_step are protected by
+  // _publish_mutex; _back, _nodes, their offsets (-1 until initialized),
+  // the size of the buffers and whether they have to be laid out again
+  // after a removal are only used by the solver thread
+  std::vector<double> _front;
+  std::vector<double> _back;
+  std::map<Node*, std::pair<int, int> > _index;
+  int _published_step;
+  std::vector<Node*> _nodes;
+  std::vector<int> _offsets;
+  int _size;
+  bool _relayout;
+  mutable pthread_mutex_t _publish_mutex;
+
+  void enqueue(const Command& command);
+  void remove(Node* node);
+  void publish(int step);
+  void run();
+  static void* solver_thread(void* async);
+};
+
+}
@@ -30,6 +30,7 @@
 #include <Eigen/Dense>
 
 #include "SparseSystem.h"
+#include "Properties.h"
 
 namespace isam {
 
@@ -61,6 +62,12 @@ public:
 
   static Cholesky* Create();
 
+  /**
+   * Creates the linear solver selected in the properties, see
+   * Properties::linear_solver.
+   */
+  static Cholesky* Create(const Properties& prop);
+
 protected:
   Cholesky() {}
 };
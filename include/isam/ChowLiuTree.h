@@ -45,6 +45,9 @@ namespace isam {
  * ChowLiuTreeInfo
  * Information for Gaussian distribtuion for chow liu tree
  *
+ * The covariance is computed once, so that the marginal of a node or
+ * pair of nodes only requires operations on matrices of the size of
+ * the nodes.
  */
 class ChowLiuTreeInfo {
 
@@ -52,6 +55,14 @@ private:
 
   const Eigen::MatrixXd& _L;
   const std::vector<Node *>& _nodes;
+  std::vector<int> _offsets;  // offset of each node in _L
+  int _root;                  // node with a prior in _cov
+  double _prior;
+  Eigen::MatrixXd _cov;       // covariance for _L with the prior, if well-conditioned
+  std::vector<Eigen::MatrixXd> _marginals;
+
+  std::vector<int> _indices(int id) const;
+  Eigen::MatrixXd _marginalize(const std::vector<int>& ii) const;
 
 public:
 
@@ -60,29 +71,28 @@ public:
    * @param L the information matrix
    * @param nodes the nodes in the information matrix
    */
-  ChowLiuTreeInfo (const Eigen::MatrixXd& L, const std::vector<Node *>& nodes)
-      : _L(L), _nodes(nodes) { }
+  ChowLiuTreeInfo (const Eigen::MatrixXd& L, const std::vector<Node *>& nodes);
 
   //const std::vector<Node *>& nodes() {return _nodes;}
-  int num_nodes() {return _nodes.size();}
+  int num_nodes() const {return _nodes.size();}
 
   /**
    * Marginal distribution
    * @return Information matrix P(node[id])
    */
-  Eigen::MatrixXd marginal(int id);
+  const Eigen::MatrixXd& marginal(int id) const {return _marginals[id];}
 
   /**
    * Joint distribution
    * @return Information matrix P(node[ida], node[idb])
    */
-  Eigen::MatrixXd joint(int ida, int idb); // a, b
+  Eigen::MatrixXd joint(int ida, int idb) const; // a, b
 
   /**
    * Conditional distribution
    * @return Information matrix P(node[ida] | node[idb])
    */
-  Eigen::MatrixXd conditional(int ida, int idb);
+  Eigen::MatrixXd conditional(int ida, int idb) const;
 
 };
 
@@ -130,18 +140,23 @@ public:
 class ChowLiuTree {
 
   ChowLiuTreeInfo _clt_info;
-  std::list<MI> _edges;
+  std::vector<MI> _edges;
 
   void _calc_edges();
   double _calc_mi(int ida, int idb);
   void _max_span_tree();
-  void _build_tree_rec(int id, int pid);
+  void _build_tree_rec(int id, int pid, const std::vector<std::vector<int> >& adjacent);
 
 public:
 
   // the resulting chow-liu tree
   std::map<int, ChowLiuTreeNode> tree;
 
+  /**
+   * Constructor.
+   * @param L the information matrix
+   * @param nodes the nodes in the information matrix
+   */
   ChowLiuTree (const Eigen::MatrixXd &L, const std::vector<Node *>& nodes);
   
 };
@@ -0,0 +1,100 @@
+/**
+ * @file ConjugateGradient.h
+ * @brief Preconditioned conjugate gradient solver for least squares problems.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <Eigen/Dense>
+
+#include "SparseSystem.h"
+#include "Cholesky.h"
+
+namespace isam {
+
+/**
+ * Iterative alternative to Cholesky for batch optimization of problems
+ * where the fill-in of a factorization does not fit into memory.
+ * Conjugate gradient on the normal equations (CGLS) works on the rows
+ * of the Jacobian directly and only needs a few vectors of the size of
+ * the system. The preconditioner is built from blocks of variables that
+ * always appear together in a row (normally the variables of one node).
+ *
+ * The system is solved only up to the given tolerance (inexact Newton
+ * steps), and no factor R is available.
+ */
+class ConjugateGradient : public Cholesky {
+  double _tolerance;
+  int _max_iterations;
+  Preconditioner _preconditioner;
+
+  // first variable of each block of the preconditioner, plus one entry
+  // for the end of the last block
+  std::vector<int> _block_starts;
+  // Cholesky factors of the diagonal blocks of A'A
+  std::vector<Eigen::MatrixXd> _blocks;
+
+  // identity, as variables are not reordered
+  std::vector<int> _order;
+
+  int _iterations;
+
+  void find_blocks(const SparseSystem& Ab);
+  void build_preconditioner(const SparseSystem& Ab, const Eigen::VectorXd& damping);
+  void precondition(const Eigen::VectorXd& s, Eigen::VectorXd& z) const;
+
+public:
+
+  /**
+   * @param tolerance Stop when the residual of the normal equations
+   *        is reduced by this factor.
+   * @param max_iterations Maximum number of iterations, 0 for the
+   *        number of variables.
+   * @param preconditioner Diagonal or block diagonal preconditioner.
+   */
+  ConjugateGradient(double tolerance = 1e-6, int max_iterations = 0,
+      Preconditioner preconditioner = BLOCK_JACOBI);
+
+  virtual ~ConjugateGradient() {}
+
+  /**
+   * Solves the least squares problem Ax=b, see Cholesky::factorize().
+   * Requires delta, as nothing is factored.
+   */
+  void factorize(const SparseSystem& Ab, Eigen::VectorXd* delta = NULL, double lambda = 0.);
+
+  /**
+   * Not available, fails.
+   */
+  void get_R(SparseSystem& R);
+
+  int* get_order();
+
+  /**
+   * Number of iterations of the last solve.
+   */
+  int iterations() const {return _iterations;}
+};
+
+}
@@ -29,10 +29,12 @@
 
 #include <list>
 #include <map>
+#include <vector>
 #include <Eigen/Dense>
 
 #include "SparseSystem.h"
 #include "Node.h"
+#include "Factor.h"
 #include "covariance.h"
 
 namespace isam {
@@ -109,6 +111,28 @@ public:
   */
   virtual std::list<Eigen::MatrixXd> access(const node_pair_list_t& node_pair_list) const;
 
+  /**
+  * Calculates squared Mahalanobis distances of candidate measurements,
+  * as needed for gating in data association. Each candidate is a factor
+  * (typically between the current pose and one landmark) that has been
+  * constructed but not added to the graph. All required covariance
+  * entries are recovered in a single pass, so that entries shared
+  * between candidates, such as the pose block, are only calculated once.
+  * Measurement Jacobian and innovation are both evaluated at the current
+  * estimate; the linearization point of the candidate's nodes is
+  * temporarily exchanged with the estimate for this.
+  * @param candidates List of measurement factors, not part of the graph.
+  * @return Squared Mahalanobis distance of the innovation of each candidate.
+  */
+  virtual std::vector<double> mahalanobis(const std::vector<Factor*>& candidates) const;
+
+  /**
+  * Memory used by the cache of recovered entries and rows and, for a
+  * stand-alone copy, the copy of R and the variable index.
+  * @return Number of bytes (the map is estimated).
+  */
+  virtual size_t memory() const;
+
 };
 
 }
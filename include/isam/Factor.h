@@ -28,6 +28,7 @@
 #pragma once
 
 #include <vector>
+#include <list>
 #include <string>
 
 #include <math.h> // for sqrt
@@ -39,6 +40,7 @@
 #include "Node.h"
 #include "Noise.h"
 #include "numericalDiff.h"
+#include "robust.h"
 
 namespace isam {
 
@@ -52,10 +54,23 @@ class Factor : public Element, Function {
     return output;
   }
 
-  cost_func_t *ptr_cost_func;
+  // robust kernel of this factor, otherwise the one shared by all
+  // factors of the graph (not set for factors outside of a graph)
+  const RobustKernel* _kernel;
+  const RobustKernel* const* ptr_default_kernel;
 
+  // shared by all threads, only changed atomically
   static int _next_id;
   bool _deleted;
+
+  // positions in the factor list of the graph and in the factor lists
+  // of the adjacent nodes, for constant time removal
+  friend class Graph;
+  friend class Node;
+  std::list<Factor*>::iterator _graph_position;
+  bool _in_graph;
+  std::vector<std::list<Factor*>::iterator> _node_positions;
+
 protected:
 
   const Noise _noise;
@@ -64,13 +79,14 @@ protected:
 
 public:
 
+  // the squared norm of the error is the (optionally robust) cost
   virtual Eigen::VectorXd error(Selector s = ESTIMATE) const {
     Eigen::VectorXd err = _noise.sqrtinf() * basic_error(s);
-    // optional modified cost function
-    if (*ptr_cost_func) {
-      for (int i=0; i<err.size(); i++) {
-        double val = err(i);
-        err(i) = ((val>=0)?1.:(-1.)) * sqrt((*ptr_cost_func)(val));
+    const RobustKernel* kernel = robust_kernel();
+    if (kernel) {
+      double d = err.norm();
+      if (d > 0.) {
+        err *= sqrt(kernel->cost(d)) / d;
       }
     }
     return err;
@@ -79,7 +95,7 @@ public:
   std::vector<Node*>& nodes() {return _nodes;}
 
   Factor(const char* name, int dim, const Noise& noise)
-    : Element(name, dim), ptr_cost_func(NULL), _deleted(false), _noise(noise) {
+    : Element(name, dim), _kernel(NULL), ptr_default_kernel(NULL), _deleted(false), _in_graph(false), _noise(noise) {
 #ifndef NDEBUG
     // all lower triagular entries below the diagonal must be 0
     for (int r=0; r<_noise.sqrtinf().rows(); r++) {
@@ -88,7 +104,7 @@ public:
       }
     }
 #endif
-    _id = _next_id++;
+    _id = __sync_fetch_and_add(&_next_id, 1);
   }
 
   virtual ~Factor() {}
@@ -96,35 +112,70 @@ public:
   virtual void initialize() = 0;
 
   virtual void initialize_internal() {
+    _node_positions.resize(_nodes.size());
     for (unsigned int i=0; i<_nodes.size(); i++) {
-      _nodes[i]->add_factor(this);
+      _node_positions[i] = _nodes[i]->add_factor(this);
     }
     initialize();
   }
 
-  virtual void set_cost_function(cost_func_t* ptr) {ptr_cost_func = ptr;}
+  virtual void set_default_kernel(const RobustKernel* const* ptr) {ptr_default_kernel = ptr;}
+
+  /**
+   * Sets a robust kernel for this factor only, overriding the one set by
+   * Slam::set_robust_kernel(); NULL reverts to that one. The kernel is
+   * not copied. For a factor that is already part of a graph use
+   * Slam::set_robust_kernel(Factor*, const RobustKernel*) instead.
+   */
+  void set_robust_kernel(const RobustKernel* kernel) {_kernel = kernel;}
+
+  /**
+   * @return True if a kernel was set for this factor only.
+   */
+  bool has_own_robust_kernel() const {return _kernel != NULL;}
+
+  const RobustKernel* robust_kernel() const {
+    if (_kernel) return _kernel;
+    return ptr_default_kernel ? *ptr_default_kernel : NULL;
+  }
 
   virtual Eigen::VectorXd basic_error(Selector s = ESTIMATE) const = 0;
 
   virtual const Eigen::MatrixXd& sqrtinf() const {return _noise.sqrtinf();}
 
+  // whitened error without robust kernel, used for numerical derivatives
   Eigen::VectorXd evaluate() const {
-    return error(LINPOINT);
+    return _noise.sqrtinf() * basic_error(LINPOINT);
+  }
+
+  /**
+   * Square root of the IRLS weight of the robust kernel for the given
+   * whitened error, 1 if there is no kernel.
+   */
+  double sqrt_weight(const Eigen::VectorXd& err) const {
+    const RobustKernel* kernel = robust_kernel();
+    if (kernel) {
+      return sqrt(kernel->weight(err.norm()));
+    }
+    return 1.;
   }
 
   virtual Jacobian jacobian_internal(bool force_numerical) {
-    if (force_numerical) {
-      // ignore any symbolic derivative provided by user
-      return Factor::jacobian();
-    } else {
-      return jacobian();
+    // ignore any symbolic derivative provided by user if force_numerical
+    Jacobian jac = force_numerical ? Factor::jacobian() : jacobian();
+    if (robust_kernel()) {
+      // residual and all blocks are reweighted together, the residual
+      // of jacobian() is the whitened error without robust kernel
+      jac.scale(sqrt_weight(jac.rhs()));
     }
+    return jac;
   }
 
-  // can be replaced by symbolic derivative by user
+  // can be replaced by symbolic derivative by user; the residual is
+  // the whitened error without robust kernel (see evaluate())
   virtual Jacobian jacobian() {
     Eigen::MatrixXd H = numerical_jacobian();
-    Eigen::VectorXd r = error(LINPOINT);
+    Eigen::VectorXd r = evaluate();
     Jacobian jac(r);
     int position = 0;
     int n_measure = dim();
@@ -46,6 +46,8 @@ class GLC_Reparam {
 
 public:
 
+  virtual ~GLC_Reparam() {}
+
   /**
    * set_nodes()
    * @param nodes Vector of Node pointers which support the factor
@@ -86,6 +88,8 @@ private:
   Eigen::VectorXb _is_angle;
   int _dim; // input and output dim
 
+  int _root();
+
 public:
 
   void set_nodes (std::vector<Node*> nodes) {
@@ -107,6 +111,9 @@ public:
   Eigen::MatrixXd jacobian();
   Eigen::VectorXd reparameterize (Selector s);
   Eigen::VectorXd root_shift (Node* node_i, Node* node_j, Selector s);
+  // Jacobians of root_shift() wrt the vectors of node_i and node_j
+  void root_shift_jacobian (Node* node_i, Node* node_j, Selector s,
+                            Eigen::MatrixXd& J_i, Eigen::MatrixXd& J_j);
 
 };
 
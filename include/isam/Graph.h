@@ -46,17 +46,29 @@ protected:
 public:
   Graph() {}
   virtual ~Graph() {}
+  // nodes and factors remember their list position, so that removal
+  // does not require a search and the order of the lists is preserved
   virtual void add_node(Node* node) {
     _nodes.push_back(node);
+    node->_graph_position = --_nodes.end();
+    node->_in_graph = true;
   }
   virtual void add_factor(Factor* factor) {
     _factors.push_back(factor);
+    factor->_graph_position = --_factors.end();
+    factor->_in_graph = true;
   }
   virtual void remove_node(Node* node) {
-    _nodes.remove(node);
+    if (node->_in_graph) {
+      _nodes.erase(node->_graph_position);
+      node->_in_graph = false;
+    }
   }
   virtual void remove_factor(Factor* factor) {
-    _factors.remove(factor);
+    if (factor->_in_graph) {
+      _factors.erase(factor->_graph_position);
+      factor->_in_graph = false;
+    }
   }
   const std::list<Node*>& get_nodes() const {return _nodes;}
   const std::list<Factor*>& get_factors() const {return _factors;}
@@ -72,6 +84,7 @@ public:
     {
       if ((*node)->deleted()) {
         variables_deleted += (*node)->dim();
+        (*node)->_in_graph = false;
         node = _nodes.erase(node);
       } else ++node;
     }
@@ -83,6 +96,7 @@ public:
         for (std::vector<Node*>::iterator node = nodes.begin(); node != nodes.end(); ++node)
           nodes_affected.insert(*node);
         measurements_deleted += (*factor)->dim();
+        (*factor)->_in_graph = false;
         factor = _factors.erase(factor);
       } else ++factor;
     }
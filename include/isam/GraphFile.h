@@ -0,0 +1,192 @@
+/**
+ * @file GraphFile.h
+ * @brief Compact binary file format for graphs (nodes, factors, estimates).
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <list>
+#include <vector>
+#include <cstring>
+#include <Eigen/Dense>
+
+#include "util.h"
+#include "Node.h"
+#include "Factor.h"
+
+namespace isam {
+
+class StereoCamera;
+
+/**
+ * Collects binary data (native byte order) in a memory buffer.
+ */
+class BinaryWriter {
+  std::vector<char> _buffer;
+public:
+  template <class T>
+  void put(const T& value) {
+    const char* p = (const char*)&value;
+    _buffer.insert(_buffer.end(), p, p+sizeof(T));
+  }
+
+  template <class T>
+  void put_array(const T* values, unsigned int n) {
+    const char* p = (const char*)values;
+    _buffer.insert(_buffer.end(), p, p+n*sizeof(T));
+  }
+
+  void put_vector(const Eigen::VectorXd& v) {
+    put<unsigned int>(v.size());
+    put_array(v.data(), v.size());
+  }
+
+  /**
+   * Writes the buffer into a file.
+   * @param fname File name.
+   */
+  void save(const std::string& fname) const;
+};
+
+/**
+ * Extracts binary data from a memory block, checking for truncation.
+ */
+class BinaryReader {
+  const char* _p;
+  const char* _end;
+public:
+  BinaryReader(const char* data, size_t size) : _p(data), _end(data+size) {}
+
+  template <class T>
+  T get() {
+    T value;
+    get_array(&value, 1);
+    return value;
+  }
+
+  template <class T>
+  void get_array(T* values, unsigned int n) {
+    require((size_t)(_end-_p)>=n*sizeof(T), "BinaryReader: unexpected end of data");
+    memcpy(values, _p, n*sizeof(T));
+    _p += n*sizeof(T);
+  }
+
+  Eigen::VectorXd get_vector() {
+    unsigned int n = get<unsigned int>();
+    // check before allocating, a corrupt length must not cause a huge allocation
+    require((size_t)(_end-_p)/sizeof(double)>=n, "BinaryReader: unexpected end of data");
+    Eigen::VectorXd v(n);
+    get_array(v.data(), v.size());
+    return v;
+  }
+
+  /**
+   * Reads a complete file into memory.
+   * @param fname File name.
+   * @param data Returns file contents.
+   */
+  static void load(const std::string& fname, std::vector<char>& data);
+};
+
+/**
+ * Version of the binary graph format written by write_graph_file();
+ * files with a different version are rejected when reading.
+ *
+ * Layout (native byte order): 8 byte magic "iSAMgrph", version, number
+ * of cameras, nodes and factors (uint32 each), followed by the camera
+ * parameters, the nodes (type, initialized flag, estimate and
+ * linearization point) and the factors (type, node indices into the
+ * node list, measurement, upper triangular square root information
+ * matrix and type specific data such as the camera index). Vectors are
+ * stored as a uint32 length followed by the entries.
+ */
+const unsigned int GRAPH_FILE_VERSION = 1;
+
+/**
+ * Nodes, factors and cameras constructed from a binary graph file. All
+ * objects are owned by the caller, as with any other nodes and factors.
+ * Nodes and factors are listed in the order in which they were saved.
+ */
+class GraphFileContents {
+public:
+  std::vector<Node*> nodes;
+  std::vector<Factor*> factors;
+  std::vector<StereoCamera*> cameras;
+};
+
+/**
+ * Serializes nodes and factors, see write_graph_file().
+ */
+void write_graph(BinaryWriter& out,
+    const std::list<Node*>& nodes, const std::list<Factor*>& factors);
+
+/**
+ * Constructs nodes and factors from serialized data, see read_graph_file().
+ */
+void read_graph(BinaryReader& in, GraphFileContents& contents);
+
+/**
+ * Checks if a memory block starts with the binary graph file signature.
+ * @param data Start of data.
+ * @param size Number of bytes available.
+ */
+bool is_graph_file(const char* data, size_t size);
+
+/**
+ * Checks if a file is a binary graph file.
+ * @param fname File name.
+ */
+bool is_graph_file(const std::string& fname);
+
+/**
+ * Writes nodes and factors into a binary graph file. All nodes adjacent
+ * to a factor have to be in the node list. Supported are the node and
+ * factor types of slam2d.h, slam3d.h and slam_stereo.h (without anchors
+ * and relative parameterization), factors must not have a robust kernel
+ * of their own.
+ * @param fname File name.
+ * @param nodes Nodes to save.
+ * @param factors Factors to save.
+ */
+void write_graph_file(const std::string& fname,
+    const std::list<Node*>& nodes, const std::list<Factor*>& factors);
+
+/**
+ * Constructs nodes and factors from a binary graph file in memory. Nodes
+ * are initialized with the saved estimates and linearization points.
+ * Factors are not connected to their nodes until added to a graph.
+ * @param data Start of file contents.
+ * @param size Size of file contents in bytes.
+ * @param contents Newly created objects.
+ */
+void read_graph_file(const char* data, size_t size, GraphFileContents& contents);
+
+/**
+ * Constructs nodes and factors from a binary graph file.
+ * @param fname File name.
+ * @param contents Newly created objects.
+ */
+void read_graph_file(const std::string& fname, GraphFileContents& contents);
+
+}
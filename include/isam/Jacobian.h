@@ -62,6 +62,8 @@ public:
     }
   }
 
+  void scale(double s) {_term *= s;}
+
   void write(std::ostream &out) const {
     out << _term << std::endl;
   }
@@ -109,6 +111,14 @@ public:
   
   int dimtotal() const { return _dimtotal; }
 
+  // scales residual and all terms, used for reweighting by robust kernels
+  void scale(double s) {
+    _residual *= s;
+    for (Terms::iterator it = _terms.begin(); it != _terms.end(); it++) {
+      it->scale(s);
+    }
+  }
+
   void write(std::ostream &out) const {
     int i=1;
     for (Terms::const_iterator it = _terms.begin(); it != _terms.end(); it++, i++) {
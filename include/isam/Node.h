@@ -31,6 +31,8 @@
 #include <Eigen/Dense>
 
 #include "Element.h"
+#include "Arena.h"
+#include "StateBuffer.h"
 
 namespace Eigen {
   typedef Matrix<bool, Dynamic, 1> VectorXb;
@@ -42,6 +44,24 @@ enum Selector {LINPOINT, ESTIMATE};
 
 class Factor; // Factor.h not included here to avoid circular dependency
 
+/**
+ * Value types that can be copied byte by byte (no pointers or resources),
+ * which allows storing them in a StateBuffer.
+ */
+template <class T>
+struct is_plain_value {static const bool value = false;};
+
+class Point2d;
+class Pose2d;
+class Point3d;
+class Point3dh;
+class Pose3d;
+template <> struct is_plain_value<Point2d> {static const bool value = true;};
+template <> struct is_plain_value<Pose2d> {static const bool value = true;};
+template <> struct is_plain_value<Point3d> {static const bool value = true;};
+template <> struct is_plain_value<Point3dh> {static const bool value = true;};
+template <> struct is_plain_value<Pose3d> {static const bool value = true;};
+
 // Node of the graph also containing measurements (Factor).
 class Node : public Element {
   friend std::ostream& operator<<(std::ostream& output, const Node& n) {
@@ -49,17 +69,40 @@ class Node : public Element {
     return output;
   }
 
+  // shared by all threads, only changed atomically
   static int _next_id;
   bool _deleted;
 
+  // position in the node list of the graph, for constant time removal
+  friend class Graph;
+  std::list<Node*>::iterator _graph_position;
+  bool _in_graph;
+
 protected:
 
   std::list<Factor*> _factors; // list of adjacent factors
 
+  // arena providing the value storage, NULL if allocated on the heap
+  friend class Arena;
+  Arena* _arena;
+
+  // contiguous storage the values are kept in, if any, and slot in it
+  friend class StateBuffer;
+  StateBuffer* _state;
+  int _state_slot;
+
+  // size of the value if it can be kept in a StateBuffer, 0 otherwise
+  virtual size_t value_size() const {return 0;}
+
+  // moves estimate and linearization point to the given locations, or
+  // into storage of its own if NULL
+  virtual void relocate(char* estimate, char* linpoint) {}
+
 public:
 
-  Node(const char* name, int dim) : Element(name, dim), _deleted(false) {
-    _id = _next_id++;
+  Node(const char* name, int dim)
+    : Element(name, dim), _deleted(false), _in_graph(false), _arena(NULL), _state(NULL), _state_slot(-1) {
+    _id = __sync_fetch_and_add(&_next_id, 1);
   }
 
   virtual ~Node() {};
@@ -71,6 +114,17 @@ public:
   virtual Eigen::VectorXd vector0() const = 0;
   virtual Eigen::VectorXb is_angle() const {return Eigen::VectorXb::Zero(_dim);}
 
+  // landmarks can be eliminated first in batch optimization, see
+  // Properties::eliminate_landmarks
+  virtual bool landmark() const {return false;}
+
+  // is the node part of a graph (not yet removed or marginalized)?
+  bool in_graph() const {return _in_graph;}
+
+  // bytes of estimate and linearization point on the heap, 0 if they
+  // are stored in an arena or a StateBuffer
+  virtual size_t value_memory() const {return 0;}
+
   virtual void update(const Eigen::VectorXd& v) = 0;
   virtual void update0(const Eigen::VectorXd& v) = 0;
 
@@ -81,8 +135,11 @@ public:
   virtual void apply_exmap(const Eigen::VectorXd& v) = 0;
   virtual void self_exmap(const Eigen::VectorXd& v) = 0;
 
-  void add_factor(Factor* e) {_factors.push_back(e);}
-  void remove_factor(Factor* e) {_factors.remove(e);}
+  std::list<Factor*>::iterator add_factor(Factor* e) {
+    _factors.push_back(e);
+    return --_factors.end();
+  }
+  void remove_factor(Factor* e);
 
   const std::list<Factor*>& factors() {return _factors;}
 
@@ -107,25 +164,48 @@ public:
   NodeT() : Node(T::name(), T::dim) {
     _value = NULL;
     _value0 = NULL;
+    _storage = NULL;
   }
 
   NodeT(const char* name) : Node(name, T::dim) {
     _value = NULL;
     _value0 = NULL;
+    _storage = NULL;
   }
 
   virtual ~NodeT() {
-    delete _value;
-    delete _value0;
+    if (_state) {
+      _state->remove(this);
+    }
+    release();
   }
 
   void init(const T& t) {
-    delete _value; delete _value0;
-    _value = new T(t); _value0 = new T(t);
+    init(t, t);
+  }
+
+  // separate linearization point, for restoring a saved state
+  void init(const T& t, const T& t0) {
+    if (_value != NULL) {
+      // reuse existing storage
+      *_value = t;
+      *_value0 = t0;
+      return;
+    }
+    // estimate and linearization point share one allocation
+    T* storage = allocate();
+    if (_arena == NULL) _storage = storage;
+    _value = new (storage) T(t);
+    _value0 = new (storage+1) T(t0);
+    if (_state) {
+      _state->insert(this);
+    }
   }
 
   bool initialized() const {return _value != NULL;}
 
+  size_t value_memory() const {return _storage ? 2*sizeof(T) : 0;}
+
   T value(Selector s = ESTIMATE) const {return (s==ESTIMATE)?*_value:*_value0;}
   T value0() const {return *_value0;}
 
@@ -149,6 +229,50 @@ public:
       out << " " << value();
     }
   }
+
+protected:
+
+  size_t value_size() const {return is_plain_value<T>::value ? sizeof(T) : 0;}
+
+  void relocate(char* estimate, char* linpoint) {
+    T* storage = NULL;
+    if (estimate == NULL) {
+      T* values = allocate();
+      if (_arena == NULL) storage = values;
+      estimate = (char*)values;
+      linpoint = (char*)(values+1);
+    }
+    T* value = new (estimate) T(*_value);
+    T* value0 = new (linpoint) T(*_value0);
+    release();
+    _value = value;
+    _value0 = value0;
+    _storage = storage;
+  }
+
+private:
+
+  // heap storage owned by this node, NULL if provided by an arena or state buffer
+  T* _storage;
+
+  // storage for estimate and linearization point
+  T* allocate() const {
+    return _arena ? (T*)_arena->allocate(2*sizeof(T)) : Eigen::aligned_allocator<T>().allocate(2);
+  }
+
+  void release() {
+    if (_value != NULL) {
+      _value->~T();
+      _value0->~T();
+      // arena storage is only released together with the arena
+      if (_storage != NULL) {
+        Eigen::aligned_allocator<T>().deallocate(_storage, 2);
+      }
+      _value = NULL;
+      _value0 = NULL;
+      _storage = NULL;
+    }
+  }
 };
 
 }
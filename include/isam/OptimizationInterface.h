@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <vector>
 #include <Eigen/Dense>
 
 #include "SparseSystem.h"
@@ -51,12 +52,43 @@ protected:
 public:
   virtual SparseSystem jacobian() = 0;
   virtual void apply_exmap(const Eigen::VectorXd& delta) = 0;
+
+  /**
+   * Same as apply_exmap(), but only nodes containing one of the given
+   * variables need to be updated.
+   */
+  virtual void apply_exmap_partial(const Eigen::VectorXd& delta,
+      const std::vector<int>& variables) {
+    apply_exmap(delta);
+  }
   virtual void self_exmap(const Eigen::VectorXd& delta) = 0;
   virtual void estimate_to_linpoint() = 0;
   virtual void linpoint_to_estimate() = 0;
   virtual void swap_estimates() = 0;
+
+  /**
+   * Moves the linearization point to the current estimate and returns the
+   * Jacobian about it. With threshold>0, only nodes whose estimate changed
+   * by more than threshold need to be moved, and the Jacobian of factors
+   * not adjacent to any of them can be reused from the last call.
+   */
+  virtual SparseSystem jacobian_relinearized(double threshold) {
+    estimate_to_linpoint();
+    return jacobian();
+  }
   virtual Eigen::VectorXd weighted_errors(Selector s = ESTIMATE) = 0;
 
+  /**
+   * Returns the variables of nodes that can be eliminated first in batch
+   * optimization (start column and dimension of each node); no factor
+   * may connect two of them, and each needs at least as many measurement
+   * rows as it has dimensions.
+   */
+  virtual void landmark_blocks(std::vector<int>& starts, std::vector<int>& dims) {
+    starts.clear();
+    dims.clear();
+  }
+
   OptimizationInterface(): _R(1,1) {}
 
   virtual ~OptimizationInterface() {}
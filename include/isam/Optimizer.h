@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <vector>
 #include <Eigen/Dense>
 
 #include "Properties.h"
@@ -38,6 +39,10 @@
 
 namespace isam {
 
+class BinaryWriter;
+class BinaryReader;
+class UpdateStats;
+
 class Optimizer {
 
 private:
@@ -54,6 +59,13 @@ private:
    */
   Cholesky* _cholesky;
 
+  /**
+   * Linear solver used for computing Gauss-Newton steps: _cholesky, or
+   * during batch optimization the one selected by
+   * Properties::linear_solver.
+   */
+  Cholesky* _solver;
+
   /**
    * Cached gradient vector; only used with increment Powell's Dog-Leg.
    */
@@ -76,6 +88,53 @@ private:
    */
   double current_SSE_at_linpoint;
 
+  /**
+   * Running sum of the robust cost (see Slam::weighted_errors()) at the
+   * linearization point, used as F(0) of the gain ratio. Equals
+   * current_SSE_at_linpoint without robust kernel; only used with
+   * Powell's Dog-Leg in incremental mode.
+   */
+  double current_cost_at_linpoint;
+
+  /**
+   * State of the partial back-substitution (see
+   * Properties::partial_solve_threshold), only valid while R is updated
+   * incrementally: the last Gauss-Newton step in the variable orderings
+   * of R and of the nodes, for each column of R the rows above the
+   * diagonal with an entry in that column (possibly with duplicates and
+   * rows whose entry was dropped since, and the list size after the
+   * last cleanup), and the rows of R modified since the last solve.
+   */
+  bool _partial_valid;
+  Eigen::VectorXd _h_gn_ordered;
+  Eigen::VectorXd _h_gn;
+  std::vector<std::vector<int> > _col_rows;
+  std::vector<int> _col_compacted;
+  std::vector<int> _modified_rows;
+  std::vector<char> _queued;
+
+  /**
+   * Number of entries in R, maintained by incremental updates to avoid
+   * a pass over all rows; -1 if unknown.
+   */
+  int _nnz_R;
+
+  void start_partial_solve(const Eigen::VectorXd& h_gn_ordered,
+      const Eigen::VectorXd& h_gn);
+
+  /**
+   * Updates _h_gn for the modified rows of R, continuing into rows that
+   * depend on a variable whose value changed by more than threshold.
+   * @param threshold Minimum change of a variable to be propagated.
+   * @param changed Returns the updated variables (node ordering).
+   */
+  void partial_solve(double threshold, std::vector<int>& changed);
+
+  /**
+   * Applies the update to the estimate, timed if stats is not NULL.
+   */
+  void apply_exmap(const Eigen::VectorXd& delta, UpdateStats* stats);
+
 
   void update_trust_radius(double rho, double hdl_norm);
 
@@ -120,6 +179,45 @@ private:
   Eigen::VectorXd compute_gauss_newton_step(const SparseSystem& jacobian,
       SparseSystem* R = NULL, double lambda = 0.);
 
+  /**
+   * Landmarks eliminated during the current batch optimization (start
+   * column and dimension), see Properties::eliminate_landmarks.
+   */
+  std::vector<int> _landmark_starts;
+  std::vector<int> _landmark_dims;
+
+  /**
+   * Computes the Gauss-Newton step by first eliminating each landmark
+   * with a dense QR factorization of its measurement rows, which leaves
+   * rows over the remaining variables only (square root form of the
+   * Schur complement). The reduced system is factored as usual, and the
+   * landmarks are recovered by back-substitution. Used instead of
+   * compute_gauss_newton_step() while _landmark_starts is not empty,
+   * R of the full system is only available through get_R_schur().
+   */
+  Eigen::VectorXd compute_gauss_newton_step_schur(const SparseSystem& jacobian,
+      double lambda);
+
+  /**
+   * Factors of the landmarks eliminated in the last call of
+   * compute_gauss_newton_step_schur(): for each landmark the rows
+   * [R_l S_l z_l] and the remaining variables of S_l, and the number of
+   * variables of the reduced system factored by _solver (-1 if it was
+   * not factored).
+   */
+  std::vector<Eigen::MatrixXd> _landmark_factors;
+  std::vector<std::vector<int> > _landmark_cols;
+  int _num_reduced;
+
+  /**
+   * Assembles R of the full system from the landmark factors and the
+   * factor of the reduced system of the last Schur complement step, with
+   * the landmarks ordered first.
+   * @param R Returns the factor.
+   * @return False if there is no factor of the reduced system.
+   */
+  bool get_R_schur(SparseSystem& R);
+
   void gauss_newton(const Properties& prop, int* num_iterations = NULL);
 
   /**
@@ -144,17 +242,21 @@ private:
    * @param epsilon1
    * @param epsilon2
    * @param epsilon3
+   * @param quiet No textual output if true.
    */
   void powells_dog_leg(int* num_iterations = NULL, double delta0 = 1.0,
       int max_iterations = 0, double epsilon1 = 1e-4, double epsilon2 = 1e-4,
-      double epsilon3 = 1e-4);
+      double epsilon3 = 1e-4, bool quiet = false);
 
 public:
 
   Optimizer(OptimizationInterface& fs)
-      : function_system(fs), Delta(1.0) {
+      : function_system(fs), Delta(1.0), current_SSE_at_linpoint(0.),
+        current_cost_at_linpoint(0.), _partial_valid(false), _nnz_R(-1),
+        _num_reduced(-1) {
     //Initialize the Cholesky object
     _cholesky = Cholesky::Create();
+    _solver = _cholesky;
   }
 
   /**
@@ -165,8 +267,13 @@ public:
   /**
    * Used to augment the sparse linear system by adding new measurements.
    * Only useful in incremental mode.
+   * @param cost_new Robust cost of the new measurements at the
+   *   linearization point, only used with Powell's Dog-Leg.
+   * @param stats Optional, rows added, Givens rotations, fill-in and
+   *   time are recorded.
    */
-  void augment_sparse_linear_system(SparseSystem& W, const Properties& prop);
+  void augment_sparse_linear_system(SparseSystem& W, double cost_new,
+      const Properties& prop, UpdateStats* stats = NULL);
 
   /**
    * Computes the Jacobian J(x_est) of the residual error function about the
@@ -207,15 +314,58 @@ public:
    * const int* inverse_order = function_system._R.r_to_a();
    *
    * retrieves the inverse permutation.
+   *
+   * @param stats Optional, size of the system, time and dog-leg step
+   *   rejection are recorded.
    */
-  void relinearize(const Properties& prop);
+  void relinearize(const Properties& prop, UpdateStats* stats = NULL);
 
   /**
    * Updates the current estimated solution
+   * @param stats Optional, number of variables solved for, time and
+   *   dog-leg step rejection are recorded.
+   */
+  void update_estimate(const Properties& prop, UpdateStats* stats = NULL);
+
+  /**
+   * Marginalizes variables out of the factor R, so that R remains the
+   * square root information matrix of the other variables without
+   * refactoring: the rows of R with an entry in a marginalized column are
+   * triangulated with these columns first, and the remaining rows are
+   * merged back by Givens rotations. Only valid for Gauss-Newton, as the
+   * dog-leg state refers to all variables.
+   * @param cols Marginalized variables in node ordering (the columns of
+   *   the Jacobian); the remaining variables keep their order.
+   * @return False if R became singular, it then has to be recalculated.
+   */
+  bool marginalize(const std::vector<int>& cols);
+
+  /**
+   * Number of entries in the factor R, cached between calls.
+   */
+  int nnz_R();
+
+  /**
+   * Bytes used by the cached dog-leg gradient and step, and by the
+   * state of the partial back-substitution.
+   */
+  size_t memory() const;
+
+  /**
+   * Saves the internal state (dog-leg trust region, cached gradient and
+   * last accepted step) for Slam::save_checkpoint().
+   */
+  void save_state(BinaryWriter& out) const;
+
+  /**
+   * Restores the internal state saved by save_state().
    */
-  void update_estimate(const Properties& prop);
+  void load_state(BinaryReader& in);
 
   ~Optimizer() {
+    if (_solver != _cholesky) {
+      delete _solver;
+    }
     delete _cholesky;
   }
 
@@ -151,6 +151,8 @@ public:
    */
   virtual const int* r_to_a() const;
 
+  virtual size_t memory(size_t* unused = NULL) const;
+
 };
 
 }
@@ -31,6 +31,10 @@ namespace isam {
 
 enum Method {GAUSS_NEWTON, LEVENBERG_MARQUARDT, DOG_LEG};
 
+enum LinearSolver {CHOLESKY, CONJUGATE_GRADIENT};
+
+enum Preconditioner {JACOBI, BLOCK_JACOBI};
+
 /**
  * User changeable default parameters.
  */
@@ -70,6 +74,21 @@ public:
 
   /** Maximum number of iterations */
   int max_iterations;
+
+  /** Linear solver for batch optimization; conjugate gradient needs far
+   * less memory than a factorization, but provides no factor R, so that
+   * the next incremental update performs a batch step and covariances
+   * are not available until then */
+  LinearSolver linear_solver;
+  /** Conjugate gradient: stop when the residual of the normal equations
+   * is reduced by this factor (inexact Newton steps) */
+  double cg_tolerance;
+  /** Conjugate gradient: maximum number of iterations (0 for the number
+   * of variables) */
+  int cg_max_iterations;
+  /** Conjugate gradient: preconditioner */
+  Preconditioner cg_preconditioner;
+
   /** Starting value for lambda in LM */
   double lm_lambda0;
   /** Factor for multiplying (failure) or dividing (success) lambda */
@@ -82,6 +101,44 @@ public:
   /** For incremental steps, solve by backsubstitution every mod_solve steps */
   int mod_solve;
 
+  /** Batch optimization eliminates landmarks (3D points) first and only
+   * factors the reduced system over the remaining variables; for
+   * Levenberg-Marquardt the damping of the remaining variables is then
+   * relative to the reduced system */
+  bool eliminate_landmarks;
+
+  /** For batch steps, only move the linearization point of nodes whose
+   * estimate changed by more than this threshold (largest component,
+   * angles wrapped), and only relinearize factors adjacent to such nodes
+   * (0 relinearizes all) */
+  double relinearize_threshold;
+
+  /** For incremental Gauss-Newton steps, only recompute the parts of the
+   * solution affected by new measurements: back-substitution does not
+   * continue into variables whose change stays below this threshold, and
+   * only nodes with changed variables are updated (0 solves for all) */
+  double partial_solve_threshold;
+
+  /** Keep estimates and linearization points of all nodes in contiguous
+   * buffers owned by Slam (only built-in node types) */
+  bool contiguous_state;
+
+  /** Sliding window (fixed-lag smoothing): after each update, poses
+   * (Pose2d_Node, Pose3d_Node) are marginalized in the order they were
+   * added until at most this many remain, together with the older
+   * landmarks (all other nodes) that no remaining pose observes; each is
+   * replaced by GLC factors on its neighbors (see glc.h), so that graph,
+   * factor R and update time stay bounded (0 keeps all nodes). No factors
+   * may be added to marginalized nodes. With Gauss-Newton the nodes are
+   * marginalized out of R directly (see Slam::marginalize_nodes()), so
+   * updates remain incremental; otherwise, or if measurements are still
+   * pending, the next update is a batch step over the window. The GLC
+   * factors cannot be saved, see Slam::save_binary() */
+  int window;
+  /** Sliding window: approximate the marginal of each removed node by
+   * sparse GLC factors (Chow-Liu tree) instead of one dense factor */
+  bool window_sparse;
+
   // default parameters
   Properties() :
     verbose(false),
@@ -100,12 +157,28 @@ public:
 
     max_iterations(500),
 
+    linear_solver(CHOLESKY),
+    cg_tolerance(1e-6),
+    cg_max_iterations(0),
+    cg_preconditioner(BLOCK_JACOBI),
+
     lm_lambda0(1e-6),
     lm_lambda_factor(10.),
 
     mod_update(1),
     mod_batch(100),
-    mod_solve(1)
+    mod_solve(1),
+
+    eliminate_landmarks(false),
+
+    relinearize_threshold(0.),
+
+    partial_solve_threshold(0.),
+
+    contiguous_state(false),
+
+    window(0),
+    window_sparse(true)
   {}
 };
 
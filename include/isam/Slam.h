@@ -29,6 +29,7 @@
 
 #include <string>
 #include <list>
+#include <set>
 #include <Eigen/Dense>
 
 #include "SparseSystem.h"
@@ -36,36 +37,36 @@
 #include "Factor.h"
 #include "Graph.h"
 #include "Properties.h"
+#include "UpdateStats.h"
 #include "OptimizationInterface.h"
 #include "Optimizer.h"
 #include "Covariances.h"
+#include "GraphFile.h"
+#include "Arena.h"
+#include "StateBuffer.h"
 
 
 namespace isam {
 
 
-/**
-* Return type of Slam::update() to allow future extensions without
-* having to change the interface.
-*/
-class UpdateStats {
-public:
-  // current step number
-  int step;
-
-  // was batch performed?
-  bool batch;
-
-  // was the solution updated?
-  bool solve;
-};
-
 /**
 * The actual SLAM interface.
+*
+* Thread safety: independent Slam objects, together with their nodes and
+* factors, may be used concurrently by different threads; the library
+* keeps no unsynchronized global state. A single Slam object must only
+* be used by one thread at a time (see AsyncSlam for updating it in the
+* background).
 */
 class Slam: public Graph, OptimizationInterface {
   // Graph prohibits copy construction and assignment operator
 
+  // destroyed last, after all other members
+  Arena _arena;
+
+  // used if _prop.contiguous_state is set
+  StateBuffer _state;
+
   int _step;
 
   Properties _prop;
@@ -96,9 +97,7 @@ public:
   /**
   * Sets new properties.
   */
-  void set_properties(Properties prop) {
-    _prop = prop;
-  }
+  void set_properties(Properties prop);
 
   /**
   * Saves the graph (nodes and factors).
@@ -106,6 +105,50 @@ public:
   */
   void save(const std::string fname) const;
 
+  /**
+  * Saves the graph (nodes, factors and current estimates) in the
+  * compact binary format of GraphFile.h. Robust kernels are not saved,
+  * factors with a kernel of their own are rejected, and so is a sliding
+  * window (Properties::window), as GLC factors are not supported.
+  * @param fname Filename with optional path to save graph to.
+  */
+  void save_binary(const std::string fname) const;
+
+  /**
+  * Loads a graph saved by save_binary() and adds all nodes and factors.
+  * Estimates are restored, the next update() performs a batch step.
+  * @param fname Filename with optional path to load graph from.
+  * @param contents Returns the newly created objects, owned by the caller.
+  */
+  void load_binary(const std::string fname, GraphFileContents& contents);
+
+  /**
+  * Saves the complete solver state: the graph with estimates and
+  * linearization points, the factor matrix R with its variable ordering
+  * and right hand side, the optimizer state and the step counters.
+  * Properties and the robust kernel of set_robust_kernel() or
+  * set_cost_function() are not saved, factors with a kernel of their
+  * own are rejected, and so is a sliding window (Properties::window).
+  * @param fname Filename with optional path to save checkpoint to.
+  */
+  void save_checkpoint(const std::string fname) const;
+
+  /**
+  * Restores a checkpoint saved by save_checkpoint() into an empty Slam
+  * object. Incremental updates continue without a batch step.
+  * @param fname Filename with optional path to load checkpoint from.
+  * @param contents Returns the newly created objects, owned by the caller.
+  */
+  void load_checkpoint(const std::string fname, GraphFileContents& contents);
+
+  /**
+  * Arena for nodes and factors that live as long as this object, see
+  * Arena.h. Nodes and factors can also be allocated individually.
+  */
+  Arena& arena() {
+    return _arena;
+  }
+
   /**
   * Adds a node (variable) to the graph.
   * @param node Pointer to new node.
@@ -121,6 +164,7 @@ public:
   /**
   * Removes a node (variable) and all adjacent factors from the graph.
   * Note that the node itself is not deallocated.
+  * Runs in time linear in the number of adjacent factors.
   * @param node Pointer to node.
   */
   void remove_node(Node* node);
@@ -133,6 +177,34 @@ public:
   */
   void remove_factor(Factor* factor);
 
+  /**
+  * Replaces nodes by factors that carry their marginal information, as
+  * created by GLC (see glc_remove_nodes()): removes the nodes with all
+  * adjacent factors, then the given factors, and adds the new factors.
+  * Unlike remove_node(), this keeps the factor R valid if it is up to
+  * date and Gauss-Newton is used: the nodes are marginalized out of R,
+  * which then already holds the information of the new factors, so the
+  * next update remains incremental. Otherwise the next update is a batch
+  * step. The new factors have to be linearized at the linearization
+  * point; sparse GLC factors only approximate the marginal, R is
+  * consistent with them again after the next batch step.
+  * @param nodes Nodes to be removed.
+  * @param factors Further factors to be removed.
+  * @param new_factors Factors replacing the removed nodes and factors.
+  */
+  void marginalize_nodes(const std::vector<Node*>& nodes,
+      const std::vector<Factor*>& factors, const std::vector<Factor*>& new_factors);
+
+  /**
+  * Hands over the nodes marginalized by the sliding window (see
+  * Properties::window) and the factors removed with them, in the order of
+  * removal, appending them to the given lists; they are no longer used
+  * by this object and can for example be deleted, unless allocated from
+  * arena(). The GLC factors created for the window are owned by this
+  * object. Call regularly on unbounded runs.
+  */
+  void release_marginalized(std::list<Node*>& nodes, std::list<Factor*>& factors);
+
   //-- solving the system -----------------------------
 
   /**
@@ -151,10 +223,27 @@ public:
 
   //-- misc -----------------------------
 
+  /**
+  * Sets a robust kernel for all factors that do not have their own
+  * (see Factor::set_robust_kernel()); NULL for the default (quadratic)
+  * cost. The kernel is not copied and has to stay valid.
+  * @param kernel Robust kernel, see robust.h.
+  */
+  void set_robust_kernel(const RobustKernel* kernel);
+
+  /**
+  * Sets the robust kernel of a single factor that is part of the graph,
+  * see Factor::set_robust_kernel().
+  */
+  void set_robust_kernel(Factor* factor, const RobustKernel* kernel);
+
   /**
   * Sets a cost function different from the default (quadratic).
-  * @param cost_func Pointer to cost function, see util.h for a list of robust
-  * cost functions. Instead of cost_squared, use NULL, which avoids calculating square roots.
+  * @param cost_func Pointer to cost function, see robust.h for a list of robust
+  * cost functions, applied to the norm of the whitened error of each factor.
+  * Instead of cost_squared, use NULL, which avoids calculating square roots.
+  * Prefer set_robust_kernel(), which does not need numerical derivatives of
+  * the cost function.
   */
   void set_cost_function(cost_func_t cost_func);
 
@@ -209,6 +298,12 @@ public:
    */
   const Covariances& covariances();
 
+  /**
+  * Memory used by the solver data structures, and high-water marks.
+  * Takes a pass over R and the nodes.
+  */
+  MemoryStats memory_stats();
+
   /**
   * Print statistics for debugging.
   */
@@ -221,6 +316,11 @@ private:
   */
   void apply_exmap(const Eigen::VectorXd& x);
 
+  /**
+  * Apply a delta vector only to the nodes containing the given variables.
+  */
+  void apply_exmap_partial(const Eigen::VectorXd& x, const std::vector<int>& variables);
+
   /**
   * Apply a delta vector directly to the linearization point.
   */
@@ -241,29 +341,87 @@ private:
   */
   void swap_estimates();
 
+  /**
+  * Set linearization point to current estimate, either for all nodes or
+  * only for those that changed by more than threshold, and return the
+  * Jacobian about it.
+  */
+  SparseSystem jacobian_relinearized(double threshold);
+
+  /**
+  * Collect landmark nodes that are not connected to each other and are
+  * observed by at least as many measurement rows as they have dimensions.
+  */
+  void landmark_blocks(std::vector<int>& starts, std::vector<int>& dims);
+
   /**
   * Update the system with any newly added measurements. The measurements will be
   * appended to the existing factor matrix, and the factor is transformed into
   * triangular form again using Givens rotations.
   * Very efficient for exploration O(1), but can be more expensive otherwise >O(n).
+  * @param stats Optional, the cost of the update is recorded.
   */
-  virtual void incremental_update();
+  virtual void incremental_update(UpdateStats* stats = NULL);
 
   /**
   * Resolve the system with linearization based on current estimate;
   * perform variable reordering for efficiency.
+  * @param stats Optional, the cost of the update is recorded.
   */
-  virtual void batch_optimization_step();
+  virtual void batch_optimization_step(UpdateStats* stats = NULL);
+
+  /**
+  * Marginalize the oldest poses until the sliding window holds at most
+  * Properties::window poses, and the landmarks no longer observed.
+  */
+  void marginalize_window(UpdateStats& stats);
+
+  /**
+  * True if R is up to date and can be updated by marginalize_nodes().
+  */
+  bool factorization_current() const;
+
+  // GLC factors created by marginalize_window(), owned by this object
+  std::set<Factor*> _window_factors;
+  // marginalized nodes and removed factors not yet handed over
+  std::list<Node*> _marginalized_nodes;
+  std::list<Factor*> _marginalized_factors;
 
 
   // internal variable used for operations such as removing of parts of
   // the graph that currently cannot be done incrementally
   bool _require_batch;
 
-  cost_func_t _cost_func;
+  const RobustKernel* _robust_kernel;
+  // owned kernel wrapping the function set by set_cost_function()
+  CostFunctionKernel* _cost_func_kernel;
 
   void update_starts();
 
+  // nodes in order of their start index, set by update_starts()
+  std::vector<Node*> _nodes_by_start;
+
+  // Jacobian rows and rhs of the first _cached_factors factors at their
+  // current linearization point, see jacobian_relinearized(); assumes
+  // that factors are only appended and linearization points are only
+  // changed through Slam, anything else resets the cache
+  std::vector<SparseVector> _cached_rows;
+  Eigen::VectorXd _cached_rhs;
+  unsigned int _cached_factors;
+
+  // high-water marks, see MemoryStats
+  size_t _peak_R;
+  size_t _peak_jacobian;
+  void update_peak_jacobian(const SparseSystem& jac);
+
+  // true if the state buffer holds the values of all nodes
+  bool state_complete() const {
+    return _prop.contiguous_state && _state.num_nodes() == _nodes.size();
+  }
+
+  void add_contents(const GraphFileContents& contents,
+      unsigned int first_node, unsigned int first_factor);
+
 protected:
   int _dim_nodes;
   int _dim_measure;
@@ -139,6 +139,14 @@ public:
    */
   virtual int max_nz() const;
 
+  /**
+   * Determine memory used by the sparse matrix.
+   * @param unused Optional, returns the bytes allocated for entries and
+   *   rows that are not used (yet).
+   * @return Number of bytes, including unused capacity.
+   */
+  virtual size_t memory(size_t* unused = NULL) const;
+
   /**
    * Print sparse matrix as triples to stream;
    * also readable by Matlab: "load R.txt; S=spconvert(R); spy(S)"
@@ -245,4 +253,26 @@ Eigen::VectorXd mul_SparseMatrixTrans_Vector(const SparseMatrix& lhs, const Eige
 SparseMatrix sparseMatrix_of_matrix(const Eigen::MatrixXd& m);
 Eigen::MatrixXd matrix_of_sparseMatrix(const SparseMatrix& s);
 
+/**
+ * Copies a matrix into the compressed column format of its transpose, as
+ * used by CHOLMOD and CSparse (SparseMatrix is row-based, both are
+ * column-based).
+ * @param A Matrix to copy.
+ * @param p Returns column pointers, A.num_rows()+1 entries.
+ * @param i Returns row indices, A.nnz() entries.
+ * @param x Returns values, A.nnz() entries.
+ */
+void csc_transp_of_sparseMatrix(const SparseMatrix& A, int* p, int* i, double* x);
+
+/**
+ * Creates the rows of a matrix from the compressed column format of its
+ * transpose, for SparseMatrix::import_rows() and friends.
+ * @param num_rows Number of rows (columns of the transpose).
+ * @param p Column pointers, num_rows+1 entries.
+ * @param i Row indices.
+ * @param x Values.
+ * @param rows Returns num_rows newly allocated rows.
+ */
+void rows_of_csc_transp(int num_rows, int* p, int* i, double* x, SparseVector_p* rows);
+
 }
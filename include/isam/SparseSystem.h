@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include <vector>
 #include <Eigen/Dense>
 
 #include "OrderedSparseMatrix.h"
@@ -70,9 +71,14 @@ public:
    * Insert a new measurement row and triangulate using Givens rotations
    * @param new_row The new sparse measurement row to add.
    * @param new_r New right hand side entry.
+   * @param modified_rows Optional, the rows changed by the update
+   *   (including a new row that remains) are appended.
+   * @param nnz_change Optional, the change in the number of entries of
+   *   the matrix (new row and fill-in) is added.
    * @return Number of Givens rotations applied (for analysis).
    */
-  virtual int add_row_givens(const SparseVector& new_row, double new_r);
+  virtual int add_row_givens(const SparseVector& new_row, double new_r,
+      std::vector<int>* modified_rows = NULL, int* nnz_change = NULL);
 
   /**
    * Solve equation system by backsubstitution.
@@ -80,6 +86,8 @@ public:
    */
   virtual Eigen::VectorXd solve() const;
 
+  virtual size_t memory(size_t* unused = NULL) const;
+
 };
 
 }
@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <Eigen/Dense>
 
 #include "isam/util.h"
@@ -34,11 +35,29 @@
 namespace isam {
 
 class SparseVector {
+public:
+  typedef void (*allocation_hook_t)(size_t bytes);
+
+private:
   int _nnz;
   int _nnz_max;
   int* _indices;
   double* _values;
 
+  static allocation_hook_t _allocation_hook;
+
+  /**
+   * Allocate memory for nnz_max entries - private.
+   */
+  inline void _allocate(int nnz_max) {
+    _nnz_max = nnz_max;
+    _indices = new int[_nnz_max];
+    _values = new double[_nnz_max];
+    if (_allocation_hook) {
+      _allocation_hook(_nnz_max*(sizeof(int)+sizeof(double)));
+    }
+  }
+
   /**
   * Copy data from one sparse vector to a new one - private
   * @param vec Existing sparse vector to copy from.
@@ -68,9 +87,8 @@ public:
    */
   SparseVector();
 
-  SparseVector(int nnz_max) : _nnz(0), _nnz_max(nnz_max) {
-    _indices = new int[_nnz_max];
-    _values = new double[_nnz_max];
+  SparseVector(int nnz_max) : _nnz(0) {
+    _allocate(nnz_max);
   }
   
   /**
@@ -193,7 +211,32 @@ public:
     return _nnz;
   }
 
+  /**
+   * @return Number of entries memory is allocated for.
+   */
+  inline int capacity() const {
+    return _nnz_max;
+  }
+
+  /**
+   * @return Bytes used by this vector, including unused capacity.
+   */
+  inline size_t memory() const {
+    return sizeof(SparseVector) + _nnz_max*(sizeof(int)+sizeof(double));
+  }
+
+  /**
+   * Sets a function that is called with the size in bytes of each
+   * allocation of entries, for example to count allocations in tests.
+   * Not synchronized: only change while no other thread uses iSAM.
+   * @param hook Function to call, NULL (the default) to disable.
+   */
+  static void set_allocation_hook(allocation_hook_t hook) {
+    _allocation_hook = hook;
+  }
+
   friend class SparseVectorIter;
+  friend class SparseMatrix; // raw access in apply_givens()
 };
 
 class SparseVectorIter {
@@ -0,0 +1,128 @@
+/**
+ * @file StateBuffer.h
+ * @brief Contiguous storage for the estimates of all nodes in a graph.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <set>
+#include <cstddef>
+
+namespace isam {
+
+class Node;
+
+/**
+ * Keeps the estimates of attached nodes in one contiguous block of
+ * memory and their linearization points in a second block with the same
+ * layout. Nodes access their values in place, while copying or swapping
+ * estimates and linearization points of all nodes reduces to a single
+ * pass over memory.
+ *
+ * Only nodes with plain value types (see is_plain_value in Node.h) are
+ * stored; other attached nodes keep their own storage. Nodes move into
+ * the buffer once initialized, and back into storage of their own when
+ * detached.
+ */
+class StateBuffer {
+  StateBuffer(const StateBuffer& rhs); // not allowed
+  const StateBuffer& operator= (const StateBuffer& rhs); // not allowed
+
+  char* _estimates;
+  char* _linpoints;
+  size_t _size;
+  size_t _capacity;
+
+  // nodes in order of their values, NULL for slots of removed nodes
+  std::vector<Node*> _slots;
+  unsigned int _num_nodes;
+
+  // all attached nodes, including those without a slot, as each of them
+  // refers back to this buffer
+  std::set<Node*> _attached;
+
+  void reserve(size_t capacity);
+  void free_slot(Node* node);
+
+public:
+
+  /**
+   * Alignment of each value, sufficient for Eigen's fixed size types.
+   */
+  static const size_t ALIGNMENT = 32;
+
+  StateBuffer();
+
+  /**
+   * Detaches all nodes, which keep their values.
+   */
+  ~StateBuffer();
+
+  /**
+   * Stores the values of a node in the buffer, now or once it is initialized.
+   * @param node Node to attach.
+   */
+  void attach(Node* node);
+
+  /**
+   * Moves the values of a node back into storage of its own.
+   * @param node Node attached to this buffer.
+   */
+  void detach(Node* node);
+
+  /**
+   * Places the values of an initialized attached node, called by the node.
+   */
+  void insert(Node* node);
+
+  /**
+   * Frees the slot of a node that is being destroyed, called by the node.
+   */
+  void remove(Node* node);
+
+  /**
+   * @return Number of nodes whose values are stored in the buffer.
+   */
+  unsigned int num_nodes() const {return _num_nodes;}
+
+  /**
+   * @return Number of bytes used by each of the two blocks.
+   */
+  size_t size() const {return _size;}
+
+  /**
+   * @return Number of bytes allocated for both blocks, the slots and the
+   * set of attached nodes.
+   */
+  size_t memory() const {
+    return 2*_capacity + _slots.capacity()*sizeof(Node*)
+      + _attached.size()*(sizeof(Node*) + 4*sizeof(void*));
+  }
+
+  void linpoint_to_estimate();
+  void estimate_to_linpoint();
+  void swap_estimates();
+};
+
+}
@@ -0,0 +1,109 @@
+/**
+ * @file Trace.h
+ * @brief Scoped timers recording nested execution times per thread.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <iostream>
+
+namespace isam {
+
+/**
+ * Returns the ID of a named trace scope, registering the name on first
+ * use. Thread-safe, but takes a lock; use ISAM_TRACE, which only looks
+ * up the ID once per call site.
+ * @param name Name of the scope, copied.
+ */
+int trace_id(const char* name);
+
+/**
+ * Marks the beginning of a trace scope in the current thread.
+ * @param id ID as returned by trace_id().
+ */
+void trace_begin(int id);
+
+/**
+ * Marks the end of the innermost open trace scope of the current thread.
+ */
+void trace_end();
+
+/**
+ * Scoped timer: the scope is recorded between construction and
+ * destruction, nested in any scope open in the same thread.
+ */
+class ScopedTrace {
+public:
+  ScopedTrace(int id) {trace_begin(id);}
+  ~ScopedTrace() {trace_end();}
+};
+
+#define ISAM_TRACE_CONCAT_(a, b) a##b
+#define ISAM_TRACE_CONCAT(a, b) ISAM_TRACE_CONCAT_(a, b)
+
+/**
+ * Records the time until the end of the enclosing block under the given
+ * name (a string literal). Per call site, the name is only looked up on
+ * the first execution; timings are kept per thread and per position in
+ * the tree of nested scopes. The lock of the thread's buffer is only
+ * contended while the results are exported.
+ */
+#define ISAM_TRACE(name) \
+  static const int ISAM_TRACE_CONCAT(_isam_trace_id_, __LINE__) = isam::trace_id(name); \
+  isam::ScopedTrace ISAM_TRACE_CONCAT(_isam_trace_, __LINE__)(ISAM_TRACE_CONCAT(_isam_trace_id_, __LINE__))
+
+/**
+ * In addition to the summary statistics, keep each individual scope
+ * (start time and duration) for export by trace_write_chrome(). Off by
+ * default, as the memory then grows with the run time.
+ */
+void trace_record_events(bool record);
+
+/**
+ * Prints the tree of nested scopes merged over all threads: number of
+ * calls, total time, time not spent in nested scopes, min and max.
+ * Threads that have exited are included, scopes still open are not.
+ */
+void trace_print_summary(std::ostream& out = std::cout);
+
+/**
+ * Writes the recorded events (see trace_record_events()) in the Chrome
+ * trace event format (chrome://tracing, Perfetto), including those of
+ * threads that have exited.
+ */
+void trace_write_chrome(const std::string& fname);
+
+/**
+ * Total time in seconds spent in all scopes with the given name, over
+ * all threads.
+ */
+double trace_time(const char* name);
+
+/**
+ * Clears all statistics and events. Scopes still open are recorded
+ * when they end.
+ */
+void trace_clear();
+
+}
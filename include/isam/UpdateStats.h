@@ -0,0 +1,142 @@
+/**
+ * @file UpdateStats.h
+ * @brief Statistics returned by Slam::update() and Slam::memory_stats().
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace isam {
+
+/**
+* Return type of Slam::update() to allow future extensions without
+* having to change the interface.
+*/
+class UpdateStats {
+public:
+  // current step number
+  int step;
+
+  // was batch performed?
+  bool batch;
+
+  // was the solution updated?
+  bool solve;
+
+  // measurement rows added to R (all rows for a batch step)
+  int num_rows_added;
+
+  // Givens rotations applied to add the new rows (0 for a batch step)
+  int num_givens;
+
+  // number of entries in R before and after the step
+  int nnz_before;
+  int nnz_after;
+
+  // variables (scalar entries of the state) solved for again
+  int num_resolved;
+
+  // wall clock time in seconds spent computing the Jacobian of the new
+  // measurements (of all measurements for a batch step), updating R
+  // (Givens rotations, or the batch factorization which also yields the
+  // batch step), back-substitution, and applying the update to the
+  // estimate (exmap)
+  double time_jacobian;
+  double time_qr;
+  double time_solve;
+  double time_exmap;
+
+  // did Powell's dog-leg reject a proposed step (which was then
+  // retried with a smaller trust region, or undone)?
+  bool step_rejected;
+
+  // nodes marginalized by the sliding window after the step, and the
+  // wall clock time in seconds spent on it, see Properties::window
+  int num_marginalized;
+  double time_marginalize;
+
+  UpdateStats()
+    : step(0), batch(false), solve(false), num_rows_added(0), num_givens(0),
+      nnz_before(0), nnz_after(0), num_resolved(0), time_jacobian(0.),
+      time_qr(0.), time_solve(0.), time_exmap(0.), step_rejected(false),
+      num_marginalized(0), time_marginalize(0.) {}
+
+  // growth of R by fill-in and new rows (negative if a batch step
+  // found a better ordering)
+  int fill_in() const {return nnz_after - nnz_before;}
+};
+
+/**
+* Memory used by the data structures of a Slam object in bytes, see
+* Slam::memory_stats(). Not included are the factors, the graph itself
+* and temporaries of the sparse factorization.
+*/
+class MemoryStats {
+public:
+  // factor R: rows including unused capacity, row pointers, variable
+  // orderings and right hand side
+  size_t R;
+
+  // part of R allocated but not used: rows grow by doubling, and new
+  // rows start with room for several entries
+  size_t R_unused;
+
+  // Jacobian rows cached for relinearization, see
+  // Properties::relinearize_threshold
+  size_t jacobian_cache;
+
+  // covariance recovery cache
+  size_t covariances;
+
+  // cached gradient and step of Powell's dog-leg, and the state of the
+  // partial back-substitution
+  size_t optimizer;
+
+  // estimates and linearization points of nodes kept on the heap
+  size_t node_values;
+
+  // reserved by the arena (nodes, factors and their values created
+  // through Slam::arena()), and by the contiguous state buffer
+  size_t arena;
+  size_t state;
+
+  // high-water marks: R, sampled before each batch step (when fill-in
+  // is largest) and by each call of Slam::memory_stats(), and the
+  // largest Jacobian built, a temporary for the new measurements or
+  // for all measurements in a batch step
+  size_t R_peak;
+  size_t jacobian_peak;
+
+  MemoryStats()
+    : R(0), R_unused(0), jacobian_cache(0), covariances(0), optimizer(0),
+      node_values(0), arena(0), state(0), R_peak(0), jacobian_peak(0) {}
+
+  // current total, without the high-water marks
+  size_t total() const {
+    return R + jacobian_cache + covariances + optimizer + node_values
+      + arena + state;
+  }
+};
+
+}
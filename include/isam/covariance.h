@@ -68,6 +68,21 @@ public:
   CovarianceCache () {
     current_valid = 1;
   }
+
+  // bytes used, estimated for the hash table (one pointer per bucket
+  // and one per entry)
+  size_t memory() const {
+    size_t bytes = sizeof(CovarianceCache)
+      + entries.bucket_count()*sizeof(void*)
+      + entries.size()*(sizeof(umap::value_type) + sizeof(void*))
+      + diag.capacity()*sizeof(double)
+      + rows.capacity()*sizeof(SparseVector)
+      + rows_valid.capacity()*sizeof(unsigned int);
+    for (unsigned int i=0; i<rows.size(); i++) {
+      bytes += rows[i].memory() - sizeof(SparseVector);
+    }
+    return bytes;
+  }
 };
 
 typedef std::vector< std::vector<int> > index_lists_t;
@@ -99,4 +114,16 @@ std::list<Eigen::MatrixXd> cov_marginal(const SparseMatrix& R, CovarianceCache&
 std::list<double> cov_marginal(const SparseMatrix& R, CovarianceCache& cache,
                                const entry_list_t& entry_list);
 
+/**
+ * Takes a list of pairs of integers and returns the corresonding
+ * entries of the covariance matrix in a preallocated vector, avoiding
+ * the per-entry allocations of the list version above.
+ * @param R Sparse factor matrix.
+ * @param cache Covariance cache object.
+ * @param entry_lists List of pairs of integers refering to covariance matrix entries.
+ * @param entries Upon return, contains the requested entries in the order of entry_list.
+ */
+void cov_marginal(const SparseMatrix& R, CovarianceCache& cache,
+                  const entry_list_t& entry_list, std::vector<double>& entries);
+
 }
@@ -60,6 +60,27 @@ namespace isam {
 std::vector<Factor*> glc_remove_node(Slam& slam, Node* node, bool sparse = false,
                                      GLC_Reparam* rp = NULL);
 
+/**
+ * Removes a set of nodes in one pass; for dense factors the result
+ * carries the same information as removing them one at a time with
+ * glc_remove_node(). Each group of connected nodes is eliminated jointly
+ * and replaced by GLC factor(s) on the remaining nodes adjacent to the
+ * group; every factor is linearized only once and the graph is only
+ * modified at the end.
+ * The graph is modified by Slam::marginalize_nodes(): if the factor R
+ * is up to date, the nodes are marginalized out of R, so the next update
+ * remains incremental; otherwise it is a batch step.
+ * The nodes and the removed factors are not deallocated.
+ * @param nodes Nodes to be removed, eliminated in this order.
+ * @param sparse Bool flag if new factors should be sparse approximate or dense
+ * @param rp functor to reparamertize variables before linearization
+ * @param removed_factors Optional, the eliminated factors are appended.
+ * @return vector of new factors.
+ */
+std::vector<Factor*> glc_remove_nodes(Slam& slam, const std::vector<Node*>& nodes,
+                                      bool sparse = false, GLC_Reparam* rp = NULL,
+                                      std::vector<Factor*>* removed_factors = NULL);
+
 /**
  * Find the factors that will be eliminated and replaced when node is removed
  * IMPORTANT: must be called before node is removed using glc_remove_node()
@@ -128,7 +149,7 @@ public:
     H = H * Jexmap;
 #endif
 
-    Eigen::VectorXd r = error(LINPOINT);
+    Eigen::VectorXd r = evaluate();
     Jacobian jac(r);
     int position = 0;
     int n_measure = dim();
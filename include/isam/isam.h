@@ -30,6 +30,7 @@
 // all include files needed by a user of iSAM
 
 #include <isam/Slam.h>
+#include <isam/AsyncSlam.h>
 #include <isam/Anchor.h>
 #include <isam/slam2d.h>
 #include <isam/slam3d.h>
@@ -117,4 +117,84 @@ inline double cost_pseudo_huber(double d, double b) {
   return 2*b2*(sqrt(1+d*d/b2) - 1);
 }
 
+/*
+ * Robust kernels for iteratively reweighted least squares (IRLS), applied
+ * to a whole factor: d is the norm of the whitened residual, cost(d) the
+ * robust cost, and weight(d) = cost'(d)/(2d) scales the squared residual
+ * and the Jacobian of the factor in the linearized system. All kernels are
+ * normalized to approximate d^2 near the origin.
+ */
+class RobustKernel {
+public:
+  virtual ~RobustKernel() {}
+
+  /**
+   * Robust cost.
+   * @param d Norm of the whitened residual.
+   */
+  virtual double cost(double d) const = 0;
+
+  /**
+   * IRLS weight, 1 for the squared cost.
+   * @param d Norm of the whitened residual.
+   */
+  virtual double weight(double d) const = 0;
+};
+
+/**
+ * Huber kernel, see cost_huber().
+ */
+class HuberKernel : public RobustKernel {
+  double _b;
+public:
+  HuberKernel(double b) : _b(b) {}
+  double cost(double d) const {return cost_huber(d, _b);}
+  double weight(double d) const {
+    return (d < _b) ? 1. : _b/d;
+  }
+};
+
+/**
+ * Pseudo-Huber kernel, see cost_pseudo_huber().
+ */
+class PseudoHuberKernel : public RobustKernel {
+  double _b;
+public:
+  PseudoHuberKernel(double b) : _b(b) {}
+  double cost(double d) const {return cost_pseudo_huber(d, _b);}
+  double weight(double d) const {
+    return 1. / sqrt(1. + d*d/(_b*_b));
+  }
+};
+
+/**
+ * Cauchy kernel b^2*log(1+d^2/b^2); same as cost_cauchy() up to a
+ * constant factor.
+ */
+class CauchyKernel : public RobustKernel {
+  double _b;
+public:
+  CauchyKernel(double b = 1.) : _b(b) {}
+  double cost(double d) const {return _b*_b * log(1. + d*d/(_b*_b));}
+  double weight(double d) const {
+    return 1. / (1. + d*d/(_b*_b));
+  }
+};
+
+/**
+ * Kernel for any of the cost functions above (or a user defined one),
+ * with the weight obtained by numerical differentiation.
+ */
+class CostFunctionKernel : public RobustKernel {
+  double (*_cost_func)(double);
+public:
+  CostFunctionKernel(double (*cost_func)(double)) : _cost_func(cost_func) {}
+  double cost(double d) const {return _cost_func(d);}
+  double weight(double d) const {
+    double h = 1e-6 * (1. + d);
+    if (d < h) d = h;
+    return (_cost_func(d+h) - _cost_func(d-h)) / (4.*h*d);
+  }
+};
+
 }
@@ -50,6 +50,8 @@ public:
 
   void set_base(Pose3d_Node* base) { _base = base; }
   Pose3d_Node* base() { return _base; }
+
+  bool landmark() const { return true; }
 };
 
 typedef Point3dT_Node<Point3d> Point3d_Node;
@@ -190,6 +190,10 @@ public:
     }
   }
 
+  StereoCamera* camera() const {return _camera;}
+
+  bool relative() const {return _relative;}
+
   void initialize() {
     require(_pose->initialized(), "Stereo_Factor requires pose to be initialized");
     bool initialized = (_point_h!=NULL) ? _point_h->initialized() : _point->initialized();
@@ -51,7 +51,8 @@ const double NUMERICAL_ZERO = 1e-12;
 double tic();
 
 /**
- * Remember and return system time in seconds.
+ * Remember and return system time in seconds. Start times are kept per
+ * thread, times accumulated by toc() are shared by all threads.
  * @param id Name of time slot.
  */
 double tic(std::string id);
@@ -63,20 +64,22 @@ double tic(std::string id);
 double toc(double t0);
 
 /**
- * Return difference between current system time and remembered time in
- * seconds, and add to accumulated time.
+ * Return difference between current system time and the time remembered
+ * by the same thread in seconds, and add to accumulated time.
  * @param id Name of time slot.
  */
 double toc(std::string id);
 
 /**
  * Print a list of accumulated times and additional statistics
- * for each name used in tic/toc.
+ * for each name used in tic/toc, followed by the summary of the
+ * scoped timers (see Trace.h).
  */
 void tictoc_print();
 
 /**
- * Return the accumulated time.
+ * Return the accumulated time, or the total time of the scoped timers
+ * (see Trace.h) of that name if tic/toc was not used with it.
  * @param id Name of time slot.
  */
 double tictoc(std::string id);
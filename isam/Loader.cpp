@@ -28,9 +28,20 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <set>
 #include <list>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include <isam/slam2d.h>
+#include <isam/GraphFile.h>
 
 #include "Loader.h"
 
@@ -41,6 +52,224 @@ using namespace std;
 using namespace isam;
 using namespace Eigen;
 
+namespace {
+
+/**
+ * Powers of ten that are exactly representable as double.
+ */
+const double exact_pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool is_space(char c) {
+  return c==' ' || c=='\t' || c=='\r' || c=='\v' || c=='\f';
+}
+
+inline bool is_separator(const char* p, const char* end) {
+  return p==end || is_space(*p) || *p=='\n';
+}
+
+/**
+ * Parse a floating point number in [p, end). Numbers with at most 19
+ * significant digits whose mantissa and decimal exponent are small
+ * enough are converted with a single correctly rounded multiplication
+ * or division (same result as strtod), all others fall back to strtod.
+ * @return Pointer behind the number, or NULL if no valid number found.
+ */
+const char* parse_number(const char* p, const char* end, double& value) {
+  const char* start = p;
+  bool negative = false;
+  if (p!=end && (*p=='-' || *p=='+')) {
+    negative = (*p=='-');
+    p++;
+  }
+  unsigned long long mantissa = 0;
+  int num_digits = 0; // significant digits in mantissa
+  int exponent = 0;
+  bool any_digits = false;
+  bool fast = true;
+  for (; p!=end && *p>='0' && *p<='9'; p++) {
+    any_digits = true;
+    if (num_digits<19) {
+      mantissa = mantissa*10 + (*p-'0');
+      if (mantissa>0) num_digits++;
+    } else {
+      fast = false;
+    }
+  }
+  if (p!=end && *p=='.') {
+    p++;
+    for (; p!=end && *p>='0' && *p<='9'; p++) {
+      any_digits = true;
+      if (num_digits<19) {
+        mantissa = mantissa*10 + (*p-'0');
+        if (mantissa>0) num_digits++;
+        exponent--;
+      } else {
+        fast = false;
+      }
+    }
+  }
+  if (any_digits && p!=end && (*p=='e' || *p=='E')) {
+    const char* q = p+1;
+    bool exp_negative = false;
+    if (q!=end && (*q=='-' || *q=='+')) {
+      exp_negative = (*q=='-');
+      q++;
+    }
+    if (q!=end && *q>='0' && *q<='9') {
+      int e = 0;
+      for (; q!=end && *q>='0' && *q<='9'; q++) {
+        if (e<100000) e = e*10 + (*q-'0');
+      }
+      exponent += exp_negative ? -e : e;
+      p = q;
+    }
+  }
+  if (any_digits && fast && is_separator(p, end)
+      && mantissa<=(1ULL<<53) && exponent>=-22 && exponent<=22) {
+    double v = (double)mantissa;
+    if (exponent<0) {
+      v /= exact_pow10[-exponent];
+    } else {
+      v *= exact_pow10[exponent];
+    }
+    value = negative ? -v : v;
+    return p;
+  }
+  // slow path: long mantissas, large exponents, nan/inf etc.
+  const char* token_end = start;
+  while (!is_separator(token_end, end)) token_end++;
+  if (token_end==start) return NULL;
+  string token(start, token_end);
+  char* parsed_end;
+  value = strtod(token.c_str(), &parsed_end);
+  if (parsed_end!=token.c_str()+token.size()) return NULL;
+  return token_end;
+}
+
+struct KeywordEntry {
+  const char* name;
+  Loader::Keyword keyword;
+};
+
+const KeywordEntry keywords[] = {
+  {"ODOMETRY", Loader::KEY_ODOMETRY},
+  {"EDGE2", Loader::KEY_ODOMETRY},
+  {"Constraint2", Loader::KEY_ODOMETRY},
+  {"LANDMARK", Loader::KEY_LANDMARK},
+  {"POINT3", Loader::KEY_POINT3},
+  {"CAMERA_STEREO", Loader::KEY_CAMERA_STEREO},
+  {"POINT_STEREO", Loader::KEY_POINT_STEREO},
+  {"EDGE3", Loader::KEY_EDGE3},
+  {"POSE3D_INIT", Loader::KEY_POSE3D_INIT},
+  {"EDGE3_INIT", Loader::KEY_EDGE3_INIT},
+  {"POSE3D_TRUE", Loader::KEY_POSE3D_TRUE},
+  {"EDGE3_TRUE", Loader::KEY_EDGE3_TRUE},
+  {"SOLVE", Loader::KEY_SOLVE}
+};
+
+Loader::Keyword lookup_keyword(const char* begin, const char* end) {
+  size_t length = end - begin;
+  for (size_t i=0; i<sizeof(keywords)/sizeof(keywords[0]); i++) {
+    if (strlen(keywords[i].name)==length && memcmp(keywords[i].name, begin, length)==0) {
+      return keywords[i].keyword;
+    }
+  }
+  return Loader::KEY_UNKNOWN;
+}
+
+/**
+ * One tokenized line: keyword and range of its arguments in Chunk::args.
+ */
+struct Record {
+  int keyword;
+  unsigned int first;
+  unsigned int num;
+};
+
+/**
+ * Part of the log file that is tokenized independently.
+ */
+struct Chunk {
+  const char* begin;
+  const char* end;
+  vector<Record> records;
+  vector<double> args;
+};
+
+/**
+ * Tokenize all lines of a chunk. Parsing of a line's arguments stops at
+ * the first token that is not a number, just as sscanf would.
+ */
+void tokenize(Chunk& chunk) {
+  const char* p = chunk.begin;
+  const char* end = chunk.end;
+  while (p<end) {
+    const char* eol = (const char*)memchr(p, '\n', end-p);
+    if (eol==NULL) eol = end;
+    while (p<eol && is_space(*p)) p++;
+    const char* key_begin = p;
+    while (p<eol && !is_space(*p)) p++;
+    if (p>key_begin) {
+      Loader::Keyword keyword = lookup_keyword(key_begin, p);
+      if (keyword!=Loader::KEY_UNKNOWN) {
+        Record record;
+        record.keyword = keyword;
+        record.first = chunk.args.size();
+        while (true) {
+          while (p<eol && is_space(*p)) p++;
+          if (p==eol) break;
+          double value;
+          const char* next = parse_number(p, eol, value);
+          if (next==NULL) break;
+          chunk.args.push_back(value);
+          p = next;
+        }
+        record.num = chunk.args.size() - record.first;
+        chunk.records.push_back(record);
+      }
+    }
+    p = eol + 1;
+  }
+}
+
+void* tokenize_thread(void* chunk) {
+  tokenize(*(Chunk*)chunk);
+  return NULL;
+}
+
+/**
+ * Sequential extraction of parsed arguments, replacing sscanf.
+ */
+class Arguments {
+  const double* _args;
+  int _num;
+  int _pos;
+public:
+  Arguments(const double* args, int num) : _args(args), _num(num), _pos(0) {}
+
+  Arguments& operator>>(double& value) {
+    value = (_pos<_num) ? _args[_pos] : 0.;
+    _pos++;
+    return *this;
+  }
+
+  Arguments& operator>>(unsigned int& value) {
+    value = (_pos<_num) ? (unsigned int)(int)_args[_pos] : 0;
+    _pos++;
+    return *this;
+  }
+
+  /**
+   * @return Number of successfully assigned values.
+   */
+  int count() const {return (_pos<_num) ? _pos : _num;}
+};
+
+}
+
 /**
  * Create first node at origin: we add a prior to keep the
  * first pose at the origin, which is an arbitrary choice.
@@ -55,22 +284,22 @@ void Loader::add_prior() {
     Pose3d pose0;
     Noise noise = SqrtInformation(100. * eye(6));
     Pose3d_Node* new_pose_node = new Pose3d_Node();
-    _nodes[_pose_mapper[0]].push_back(new_pose_node);
+    step_nodes(_pose_mapper[0]).push_back(new_pose_node);
     if (_verbose) cout << *new_pose_node << endl;
-    _pose_nodes.push_back(new_pose_node);
+    add_pose_node(new_pose_node);
     // create prior measurement
     Pose3d_Factor* prior = new Pose3d_Factor(new_pose_node, pose0, noise);
-    _factors[0].push_back(prior);
+    step_factors(0).push_back(prior);
     if (_verbose) cout << *prior << endl;
   } else {
     Pose2d pose0;
     Noise noise = SqrtInformation(100. * eye(3));
     Pose2d_Node* new_pose_node = new Pose2d_Node();
-    _nodes[_pose_mapper[0]].push_back(new_pose_node);
+    step_nodes(_pose_mapper[0]).push_back(new_pose_node);
     if (_verbose) cout << *new_pose_node << endl;
-    _pose_nodes.push_back(new_pose_node);
+    add_pose_node(new_pose_node);
     Pose2d_Factor* prior = new Pose2d_Factor(new_pose_node, pose0, noise);
-    _factors[0].push_back(prior);
+    step_factors(0).push_back(prior);
     if (_verbose) cout << *prior << endl;
   }
 }
@@ -80,14 +309,16 @@ bool Loader::advance(unsigned int idx_x1, unsigned int next_point_id) {
   bool added = _pose_mapper.add(idx_x1);
   if (added ) {
     _step++;
-    _nodes.resize(_step+1);
-    _factors.resize(_step+1);
-    _num_points.resize(_step+1);
-    _num_points[_step] = next_point_id;
-    _num_constraints.resize(_step+1);
-    _num_constraints[_step] = _constraints.size();
-    _num_measurements.resize(_step+1);
-    _num_measurements[_step] = _measurements.size();
+    _nodes.resize(_step+1-_first_step);
+    _factors.resize(_step+1-_first_step);
+    if (_history) {
+      _num_points.resize(_step+1);
+      _num_points[_step] = next_point_id;
+      _num_constraints.resize(_step+1);
+      _num_constraints[_step] = _constraints.size();
+      _num_measurements.resize(_step+1);
+      _num_measurements[_step] = _measurements.size();
+    }
   }
   return added;
 }
@@ -95,38 +326,46 @@ bool Loader::advance(unsigned int idx_x1, unsigned int next_point_id) {
 void Loader::add_odometry(unsigned int idx_x0, unsigned int idx_x1, const Pose2d& measurement, const Noise& noise) {
   if (advance(idx_x1, _point_nodes.size())) {
     Pose2d_Node* new_pose_node = new Pose2d_Node();
-    _nodes[_step].push_back(new_pose_node);
-    _pose_nodes.push_back(new_pose_node);
+    step_nodes(_step).push_back(new_pose_node);
+    add_pose_node(new_pose_node);
     if (_verbose) cout << idx_x1 << " " << *new_pose_node << endl;
   }
   unsigned int i_x0 = _pose_mapper[idx_x0];
   unsigned int i_x1 = _pose_mapper[idx_x1];
+  // skip measurements on nodes released by the consumer
+  if (!_pose_nodes[i_x0] || !_pose_nodes[i_x1]) return;
   Pose2d_Pose2d_Factor* factor = new Pose2d_Pose2d_Factor(
       dynamic_cast<Pose2d_Node*>(_pose_nodes[i_x0]),
       dynamic_cast<Pose2d_Node*>(_pose_nodes[i_x1]),
       measurement, noise);
-  _factors[i_x1].push_back(factor);
-  _constraints.push_back(make_pair(i_x0, i_x1));
-  _num_constraints[i_x1] = _constraints.size();
+  step_factors(i_x1).push_back(factor);
+  if (_history) {
+    _constraints.push_back(make_pair(i_x0, i_x1));
+    _num_constraints[i_x1] = _constraints.size();
+  }
   if (_verbose) cout << i_x1 << " " << *factor << endl;
 }
 
 void Loader::add_odometry3(unsigned int idx_x0, unsigned int idx_x1, const Pose3d& measurement, const Noise& noise) {
   if (advance(idx_x1, _point_nodes.size())) {
     Pose3d_Node* new_pose_node = new Pose3d_Node();
-    _nodes[_step].push_back(new_pose_node);
-    _pose_nodes.push_back(new_pose_node);
+    step_nodes(_step).push_back(new_pose_node);
+    add_pose_node(new_pose_node);
     if (_verbose) cout << idx_x1 << " " << *new_pose_node << endl;
   }
   unsigned int i_x0 = _pose_mapper[idx_x0];
   unsigned int i_x1 = _pose_mapper[idx_x1];
+  // skip measurements on nodes released by the consumer
+  if (!_pose_nodes[i_x0] || !_pose_nodes[i_x1]) return;
   Pose3d_Pose3d_Factor* factor = new Pose3d_Pose3d_Factor(
       dynamic_cast<Pose3d_Node*>(_pose_nodes[i_x0]),
       dynamic_cast<Pose3d_Node*>(_pose_nodes[i_x1]),
       measurement, noise);
-  _factors[i_x1].push_back(factor);
-  _constraints.push_back(make_pair(i_x0, i_x1));
-  _num_constraints[i_x1] = _constraints.size();
+  step_factors(i_x1).push_back(factor);
+  if (_history) {
+    _constraints.push_back(make_pair(i_x0, i_x1));
+    _num_constraints[i_x1] = _constraints.size();
+  }
   if (_verbose) cout << i_x1 << " " << *factor << endl;
 }
 
@@ -134,20 +373,23 @@ void Loader::add_measurement(unsigned int idx_x, unsigned int idx_l, const Point
   if (_point_mapper.add(idx_l)) {
     // new point has to be added
     Point2d_Node* new_point_node = new Point2d_Node();
-    _nodes[_step].push_back(new_point_node);
-    _point_nodes.push_back(new_point_node);
-    _num_points[_step] = _point_nodes.size();
+    step_nodes(_step).push_back(new_point_node);
+    add_point_node(new_point_node);
+    if (_history) _num_points[_step] = _point_nodes.size();
     if (_verbose) cout << idx_x << " " << *new_point_node << endl;
   }
   unsigned int i_x = _pose_mapper[idx_x];
   unsigned int i_l = _point_mapper[idx_l];
+  if (!_pose_nodes[i_x] || !_point_nodes[i_l]) return;
   Pose2d_Point2d_Factor* factor = new Pose2d_Point2d_Factor(
       dynamic_cast<Pose2d_Node*>(_pose_nodes[i_x]),
       dynamic_cast<Point2d_Node*>(_point_nodes[i_l]),
       measurement, noise);
-  _factors[i_x].push_back(factor);
-  _measurements.push_back(make_pair(i_x, i_l));
-  _num_measurements[i_x] = _measurements.size();
+  step_factors(i_x).push_back(factor);
+  if (_history) {
+    _measurements.push_back(make_pair(i_x, i_l));
+    _num_measurements[i_x] = _measurements.size();
+  }
   if (_verbose) cout << i_x << " " << *factor << endl;
 }
 
@@ -155,20 +397,23 @@ void Loader::add_point3(unsigned int idx_x, unsigned int idx_p, const Point3d& m
   // We require that the pose node already exists
   if (_point_mapper.add(idx_p)) {
     Point3d_Node* new_point_node = new Point3d_Node();
-    _nodes[_step].push_back(new_point_node);
-    _point_nodes.push_back(new_point_node);
-    _num_points[_step] = _point_nodes.size();
+    step_nodes(_step).push_back(new_point_node);
+    add_point_node(new_point_node);
+    if (_history) _num_points[_step] = _point_nodes.size();
     if (_verbose) cout << idx_x << " " << *new_point_node << endl;
   }
   unsigned int i_x = _pose_mapper[idx_x];
   unsigned int i_p = _point_mapper[idx_p];
+  if (!_pose_nodes[i_x] || !_point_nodes[i_p]) return;
   Pose3d_Point3d_Factor* factor =
     new Pose3d_Point3d_Factor(dynamic_cast<Pose3d_Node*>(_pose_nodes[i_x]),
                               dynamic_cast<Point3d_Node*>(_point_nodes[i_p]),
                               m, noise);
-  _factors[i_x].push_back(factor);
-  _measurements.push_back(make_pair(i_x, i_p));
-  _num_measurements[i_x] = _measurements.size();
+  step_factors(i_x).push_back(factor);
+  if (_history) {
+    _measurements.push_back(make_pair(i_x, i_p));
+    _num_measurements[i_x] = _measurements.size();
+  }
   if (_verbose) cout << i_x << " " << *factor << endl;
 }
 
@@ -182,35 +427,34 @@ void Loader::add_stereo(isam::StereoCamera* camera,
   if (_point_mapper.add(idx_p)) {
     Point3dh_Node* new_point_node = new Point3dh_Node();
 //    Point3d_Node* new_point_node = new Point3d_Node();
-    _nodes[_step].push_back(new_point_node);
-    _point_nodes.push_back(new_point_node);
-    _num_points[_step] = _point_nodes.size();
+    step_nodes(_step).push_back(new_point_node);
+    add_point_node(new_point_node);
+    if (_history) _num_points[_step] = _point_nodes.size();
     if (_verbose) cout << idx_x << " " << *new_point_node << endl; 
   }
   unsigned int i_x = _pose_mapper[idx_x];
   unsigned int i_p = _point_mapper[idx_p];
+  if (!_pose_nodes[i_x] || !_point_nodes[i_p]) return;
   Stereo_Factor* factor = 
     new Stereo_Factor(dynamic_cast<Pose3d_Node*>(_pose_nodes[i_x]),
                       dynamic_cast<Point3dh_Node*>(_point_nodes[i_p]),
 //                      dynamic_cast<Point3d_Node*>(_point_nodes[i_p]),
                       camera, m, noise);
-  _factors[i_x].push_back(factor);
-  _measurements.push_back(make_pair(i_x, i_p));
-  _num_measurements[i_x] = _measurements.size();
+  step_factors(i_x).push_back(factor);
+  if (_history) {
+    _measurements.push_back(make_pair(i_x, i_p));
+    _num_measurements[i_x] = _measurements.size();
+  }
   if (_verbose) cout << i_x << " " << *factor << endl;
 }
 
-bool Loader::parse_line(char* str) {
+bool Loader::parse_line(int keyword, const double* args, int num_args) {
   bool solve = false;
-  char keyword_c[2000];
-  int key_length;
-  sscanf(str, "%s%n", keyword_c, &key_length);
-  const char* arguments = &str[key_length];
-  string keyword(keyword_c);
-  if (keyword == "ODOMETRY" || keyword == "EDGE2" || keyword == "Constraint2") {
+  Arguments arguments(args, num_args);
+  if (keyword == KEY_ODOMETRY) {
     unsigned int idx_x0, idx_x1;
     double x, y, t, ixx, ixy, ixt, iyy, iyt, itt;
-    int res = sscanf(arguments, "%i %i %lg %lg %lg %lg %lg %lg %lg %lg %lg", &idx_x0, &idx_x1, &x, &y, &t, &ixx, &ixy, &ixt, &iyy, &iyt, &itt);
+    int res = (arguments >> idx_x0 >> idx_x1 >> x >> y >> t >> ixx >> ixy >> ixt >> iyy >> iyt >> itt).count();
     if (res!=11) {
       cout << "Error while parsing ODOMETRY entry" << endl;
       exit(1);
@@ -231,10 +475,10 @@ bool Loader::parse_line(char* str) {
       add_prior();
     }
     add_odometry(idx_x0, idx_x1, measurement, SqrtInformation(sqrtinf));
-  } else if (keyword == "LANDMARK") {
+  } else if (keyword == KEY_LANDMARK) {
     unsigned int idx_x, idx_l;
     double x, y, ixx, ixy, iyy;
-    int res = sscanf(arguments, "%i %i %lg %lg %lg %lg %lg", &idx_x, &idx_l, &x, &y, &ixx, &ixy, &iyy);
+    int res = (arguments >> idx_x >> idx_l >> x >> y >> ixx >> ixy >> iyy).count();
     if (res!=7) {
       cout << "Error while parsing LANDMARK entry" << endl;
       exit(1);
@@ -250,12 +494,12 @@ bool Loader::parse_line(char* str) {
       ixx, ixy,
       0.,  iyy;
     add_measurement(idx_x, idx_l, measurement, SqrtInformation(sqrtinf));
-  } else if (keyword == "POINT3") {
+  } else if (keyword == KEY_POINT3) {
     unsigned int idx_x; // camera node
     unsigned int idx_p; // point node
     double x,y,z; // Measurement, Euclidean coordinates in camera frame
     double i11, i12, i13, i22, i23, i33;
-    int res = sscanf(arguments, "%i %i %lg %lg %lg %lg %lg %lg %lg %lg %lg",&idx_x,&idx_p,&x,&y,&z,&i11,&i12,&i13,&i22,&i23,&i33);
+    int res = (arguments >> idx_x >> idx_p >> x >> y >> z >> i11 >> i12 >> i13 >> i22 >> i23 >> i33).count();
 
     MatrixXd sqrtinf(3,3);
     if (res!=11 && res!=5) {
@@ -272,13 +516,13 @@ bool Loader::parse_line(char* str) {
     }
     Point3d m(x,y,z);
     add_point3(idx_x, idx_p, m, SqrtInformation(sqrtinf));
-  } else if (keyword == "CAMERA_STEREO") {
+  } else if (keyword == KEY_CAMERA_STEREO) {
     unsigned int idx_camera; // camera id
     double f;
     double cx, cy;
     double b;
 
-    int res = sscanf(arguments, "%i %lg %lg %lg %lg",&idx_camera,&f,&cx,&cy,&b);
+    int res = (arguments >> idx_camera >> f >> cx >> cy >> b).count();
     if (res != 5) {
       cout << "Error while parsing CAMERA_STEREO entry" << endl;
       exit(1);
@@ -286,13 +530,13 @@ bool Loader::parse_line(char* str) {
 
     _cameras[idx_camera] = new StereoCamera(f, Vector2d(cx,cy), b);
 
-  } else if (keyword == "POINT_STEREO") {
+  } else if (keyword == KEY_POINT_STEREO) {
     unsigned int idx_camera; // camera id
     unsigned int idx_x; // camera node
     unsigned int idx_p; // point node
     double u,v,u2; // Measurement, where w is disparity
     double i11, i12, i13, i22, i23, i33;
-    int res = sscanf(arguments, "%i %i %i %lg %lg %lg %lg %lg %lg %lg %lg %lg",&idx_camera,&idx_p,&idx_x,&u,&v,&u2,&i11,&i12,&i13,&i22,&i23,&i33);
+    int res = (arguments >> idx_camera >> idx_p >> idx_x >> u >> v >> u2 >> i11 >> i12 >> i13 >> i22 >> i23 >> i33).count();
 
     MatrixXd sqrtinf(3,3);
     if (res!=12 && res!=6) {
@@ -313,14 +557,13 @@ bool Loader::parse_line(char* str) {
       exit(1);
     }
     add_stereo(_cameras[idx_camera], idx_x, idx_p, m, SqrtInformation(sqrtinf));
-  } else if (keyword == "EDGE3") {
+  } else if (keyword == KEY_EDGE3) {
     unsigned int idx_x0, idx_x1;
     double x, y, z, yaw, pitch, roll, i11, i12, i13, i14, i15, i16;
     double i22, i23, i24, i25, i26, i33, i34, i35, i36, i44, i45, i46, i55, i56, i66;
-    int res = sscanf(arguments, "%i %i %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg %lg",
-                     &idx_x0, &idx_x1, &x, &y, &z, &roll, &pitch, &yaw, // note reverse order of angles, also see covariance below
-                     &i11, &i12, &i13, &i14, &i15, &i16, &i22, &i23, &i24, &i25, &i26,
-                     &i33, &i34, &i35, &i36, &i44, &i45, &i46, &i55, &i56, &i66);
+    int res = (arguments >> idx_x0 >> idx_x1 >> x >> y >> z >> roll >> pitch >> yaw // note reverse order of angles, also see covariance below
+               >> i11 >> i12 >> i13 >> i14 >> i15 >> i16 >> i22 >> i23 >> i24 >> i25 >> i26
+               >> i33 >> i34 >> i35 >> i36 >> i44 >> i45 >> i46 >> i55 >> i56 >> i66).count();
     if (res!=29 && res!=8) {
       cout << "Error while parsing EDGE3 entry" << endl;
       exit(1);
@@ -344,7 +587,7 @@ bool Loader::parse_line(char* str) {
         //                0.,  0.,  0.,  0., i55, i56,
         //                0.,  0.,  0.,  0.,  0., i66);
         // todo: this is wrong in the presence of off-diagonal entries because sqrtinf...
-        0.,  0.,  0., i66, i56, i46, // note: reversed yaw, pitch, roll, also see sscanf above
+        0.,  0.,  0., i66, i56, i46, // note: reversed yaw, pitch, roll, also see arguments above
         0.,  0.,  0.,  0., i55, i45,
         0.,  0.,  0.,  0.,  0., i44;
     }
@@ -363,12 +606,11 @@ bool Loader::parse_line(char* str) {
       add_prior();
     }
     add_odometry3(j, i, delta, SqrtInformation(sqrtinf));
-  } else if (keyword == "POSE3D_INIT") {
+  } else if (keyword == KEY_POSE3D_INIT) {
     // Initialize a POSE3D node
     unsigned int idx_x0;
     double x, y, z, yaw, pitch, roll;
-    int res = sscanf(arguments, "%i %lg %lg %lg %lg %lg %lg",
-                     &idx_x0, &x, &y, &z, &roll, &pitch, &yaw); // note reverse order of angles, also see covariance below
+    int res = (arguments >> idx_x0 >> x >> y >> z >> roll >> pitch >> yaw).count(); // note reverse order of angles, also see covariance below
     if (res!=7) {
       cout << "Error while parsing POSE3D_INIT entry" << endl;
       exit(1);
@@ -376,54 +618,286 @@ bool Loader::parse_line(char* str) {
 
     if (advance(idx_x0, _point_nodes.size())) {
       Pose3d_Node* new_pose_node = new Pose3d_Node();
-      _nodes[_step].push_back(new_pose_node);
-      _pose_nodes.push_back(new_pose_node);
+      step_nodes(_step).push_back(new_pose_node);
+      add_pose_node(new_pose_node);
       if (_verbose) cout << idx_x0 << " " << *new_pose_node << endl;
       new_pose_node->init(Pose3d(x,y,z,yaw,pitch,roll));
     }
 
-  } else if (keyword == "EDGE3_INIT") {
+  } else if (keyword == KEY_EDGE3_INIT) {
     // Provide an edge that is only used for initialization.
-  } else if (keyword == "POSE3D_TRUE") {
+  } else if (keyword == KEY_POSE3D_TRUE) {
     // Use to calculate a performance metric
 
-  } else if (keyword == "EDGE3_TRUE") {
+  } else if (keyword == KEY_EDGE3_TRUE) {
     // Use to calculate a performance metric
 
-  } else if (keyword == "SOLVE") {
+  } else if (keyword == KEY_SOLVE) {
     solve = true;
   }
   return solve;
 }
 
-Loader::Loader(const char* fname, int num_lines, bool verbose) {
+Loader::Loader(const char* fname, int num_lines, bool verbose, int num_threads, unsigned int window) {
   _verbose = verbose;
   _step = 0;
   _is_3d = false;
+  _first_step = 0;
+  _window = window;
+  _history = (window==0);
+  _done = false;
+  _stop = false;
+  _mapped = MAP_FAILED;
+  _mapped_size = 0;
+
+  map_file(fname, num_lines);
 
-  // parse and process data file
-  _in = fopen(fname, "r");
-  if (!_in) {
+  if (is_graph_file(_data, _end-_data)) {
+    // binary graph files are always loaded completely
+    _window = 0;
+    _history = true;
+    load_graph(_data, _end-_data);
+    unmap_file();
+  } else if (_window==0) {
+    parse(_data, _end, num_threads);
+    unmap_file();
+  } else {
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_cond_parsed, NULL);
+    pthread_cond_init(&_cond_consumed, NULL);
+    require(pthread_create(&_thread, NULL, stream_thread, this)==0,
+            "Loader: Failed to create parser thread");
+  }
+}
+
+void Loader::map_file(const char* fname, int num_lines) {
+  // map data file into memory, fall back to reading if not possible
+  int fd = open(fname, O_RDONLY);
+  if (fd<0) {
     printf("ERROR: Failed to open log file %s.\n", fname);
     exit(1);
   }
-  int i = 0;
-  while (!feof(_in) && (num_lines==0 || i<num_lines)) {
-    char str[2000];
-    if (fgets(str, 2000, _in)) {
-      parse_line(str);
+  struct stat st;
+  if (fstat(fd, &st)!=0) {
+    printf("ERROR: Failed to access log file %s.\n", fname);
+    exit(1);
+  }
+  size_t size = st.st_size;
+  _data = NULL;
+  if (size>0) {
+    _mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if (_mapped!=MAP_FAILED) {
+    _mapped_size = size;
+    _data = (const char*)_mapped;
+  } else if (size>0) {
+    _buffer.resize(size);
+    size_t n = 0;
+    while (n<size) {
+      ssize_t res = read(fd, &_buffer[n], size-n);
+      if (res<=0) break;
+      n += res;
+    }
+    size = n;
+    _data = _buffer.empty() ? NULL : &_buffer[0];
+  }
+  close(fd);
+
+  // restrict to the requested number of lines
+  _end = _data + size;
+  if (num_lines>0) {
+    const char* p = _data;
+    for (int i=0; i<num_lines && p<_end; i++) {
+      const char* eol = (const char*)memchr(p, '\n', _end-p);
+      p = (eol==NULL) ? _end : eol+1;
+    }
+    _end = p;
+  }
+}
+
+void Loader::unmap_file() {
+  if (_mapped!=MAP_FAILED) {
+    munmap(_mapped, _mapped_size);
+    _mapped = MAP_FAILED;
+  }
+  vector<char>().swap(_buffer);
+  _data = _end = NULL;
+}
+
+void Loader::parse(const char* data, const char* end, int num_threads) {
+  // split into chunks at line boundaries and tokenize (in parallel)
+  if (num_threads<1) num_threads = 1;
+  vector<Chunk> chunks(num_threads);
+  const char* begin = data;
+  for (int i=0; i<num_threads; i++) {
+    const char* chunk_end = end;
+    if (i<num_threads-1) {
+      chunk_end = begin + (end-begin)/(num_threads-i);
+      if (chunk_end<end) {
+        const char* eol = (const char*)memchr(chunk_end, '\n', end-chunk_end);
+        chunk_end = (eol==NULL) ? end : eol+1;
+      }
+    }
+    chunks[i].begin = begin;
+    chunks[i].end = chunk_end;
+    begin = chunk_end;
+  }
+  if (num_threads==1) {
+    tokenize(chunks[0]);
+  } else {
+    vector<pthread_t> threads(num_threads);
+    for (int i=0; i<num_threads; i++) {
+      require(pthread_create(&threads[i], NULL, tokenize_thread, &chunks[i])==0,
+              "Loader: Failed to create parser thread");
+    }
+    for (int i=0; i<num_threads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+
+  // process data in file order
+  for (int i=0; i<num_threads; i++) {
+    const Chunk& chunk = chunks[i];
+    for (unsigned int j=0; j<chunk.records.size(); j++) {
+      const Record& record = chunk.records[j];
+      const double* args = (record.num>0) ? &chunk.args[record.first] : NULL;
+      parse_line(record.keyword, args, record.num);
+    }
+  }
+}
+
+void* Loader::stream_thread(void* loader) {
+  ((Loader*)loader)->stream();
+  return NULL;
+}
+
+void Loader::stream() {
+  // size of the blocks of lines that are tokenized at once
+  const size_t BLOCK_SIZE = 1<<20;
+  const char* p = _data;
+  bool stop = false;
+  while (p<_end && !stop) {
+    Chunk chunk;
+    chunk.begin = p;
+    chunk.end = (size_t)(_end-p)>BLOCK_SIZE ? p+BLOCK_SIZE : _end;
+    if (chunk.end<_end) {
+      const char* eol = (const char*)memchr(chunk.end, '\n', _end-chunk.end);
+      chunk.end = (eol==NULL) ? _end : eol+1;
+    }
+    tokenize(chunk);
+    for (unsigned int j=0; j<chunk.records.size() && !stop; j++) {
+      const Record& record = chunk.records[j];
+      const double* args = (record.num>0) ? &chunk.args[record.first] : NULL;
+      pthread_mutex_lock(&_mutex);
+      unsigned int step = _step;
+      parse_line(record.keyword, args, record.num);
+      if (_step!=step) {
+        // previous step is complete, wait if too far ahead of the consumer
+        pthread_cond_broadcast(&_cond_parsed);
+        while (_step-_first_step>_window && !_stop) {
+          pthread_cond_wait(&_cond_consumed, &_mutex);
+        }
+      }
+      stop = _stop;
+      pthread_mutex_unlock(&_mutex);
+    }
+    p = chunk.end;
+  }
+  pthread_mutex_lock(&_mutex);
+  // memory() reads the buffer from the consumer thread
+  unmap_file();
+  _done = true;
+  pthread_cond_broadcast(&_cond_parsed);
+  pthread_mutex_unlock(&_mutex);
+}
+
+void Loader::load_graph(const char* data, size_t size) {
+  GraphFileContents contents;
+  read_graph_file(data, size, contents);
+  for (unsigned int i=0; i<contents.cameras.size(); i++) {
+    _cameras[i] = contents.cameras[i];
+  }
+
+  // each pose starts a new time step, points belong to the current one
+  map<Node*, unsigned int> node_step;
+  map<Node*, int> pose_index;
+  map<Node*, int> point_index;
+  _nodes.resize(1);
+  _factors.resize(1);
+  _num_points.resize(1, 0);
+  _num_constraints.resize(1, 0);
+  _num_measurements.resize(1, 0);
+  for (unsigned int i=0; i<contents.nodes.size(); i++) {
+    Node* node = contents.nodes[i];
+    string name = node->name();
+    if (name=="Pose2d" || name=="Pose3d") {
+      _is_3d = (name=="Pose3d");
+      if (!_pose_nodes.empty()) {
+        _step++;
+        _nodes.resize(_step+1);
+        _factors.resize(_step+1);
+        _num_points.push_back(_point_nodes.size());
+        _num_constraints.push_back(0);
+        _num_measurements.push_back(0);
+      }
+      pose_index[node] = _pose_nodes.size();
+      _pose_nodes.push_back(node);
+    } else {
+      point_index[node] = _point_nodes.size();
+      _point_nodes.push_back(node);
+      _num_points[_step] = _point_nodes.size();
+    }
+    node_step[node] = _step;
+    step_nodes(_step).push_back(node);
+    if (_verbose) cout << _step << " " << *node << endl;
+  }
+
+  // factors are processed in the step of their most recent node
+  for (unsigned int i=0; i<contents.factors.size(); i++) {
+    Factor* factor = contents.factors[i];
+    const vector<Node*>& adjacent = factor->nodes();
+    unsigned int step = 0;
+    for (unsigned int j=0; j<adjacent.size(); j++) {
+      step = max(step, node_step[adjacent[j]]);
     }
-    i++;
+    _factors[step].push_back(factor);
+    if (adjacent.size()==2 && pose_index.count(adjacent[0])) {
+      if (pose_index.count(adjacent[1])) {
+        _constraints.push_back(make_pair(pose_index[adjacent[0]], pose_index[adjacent[1]]));
+        _num_constraints[step] = _constraints.size();
+      } else {
+        _measurements.push_back(make_pair(pose_index[adjacent[0]], point_index[adjacent[1]]));
+        _num_measurements[step] = _measurements.size();
+      }
+    }
+    if (_verbose) cout << step << " " << *factor << endl;
+  }
+  for (unsigned int s=1; s<=_step; s++) {
+    _num_constraints[s] = max(_num_constraints[s], _num_constraints[s-1]);
+    _num_measurements[s] = max(_num_measurements[s], _num_measurements[s-1]);
   }
-  fclose(_in);
 }
 
 Loader::~Loader()
 {
+  if (_window>0) {
+    pthread_mutex_lock(&_mutex);
+    _stop = true;
+    pthread_cond_broadcast(&_cond_consumed);
+    pthread_mutex_unlock(&_mutex);
+    pthread_join(_thread, NULL);
+    pthread_mutex_destroy(&_mutex);
+    pthread_cond_destroy(&_cond_parsed);
+    pthread_cond_destroy(&_cond_consumed);
+  }
   for(std::map<int, isam::StereoCamera*>::iterator it = _cameras.begin(); it != _cameras.end(); ++it) delete it->second;
 }
 
 void Loader::print_stats() const {
+  if (_window>0) {
+    cout << "Streaming log file, parsing up to " << _window << " steps ahead" << endl;
+    return;
+  }
   int n = num_steps();
   cout << "Number of poses: " << n << endl;
   if (_point_nodes.size()>0) {
@@ -431,11 +905,134 @@ void Loader::print_stats() const {
     cout << "Number of measurements: " << _num_measurements[n-1] << endl;
   }
   cout << "Number of constraints: " << _num_constraints[n-1] << endl;
+  cout << "Memory retained by loader: " << memory()/(1024.*1024.) << " MB" << endl;
+}
+
+size_t Loader::memory() const {
+  if (_window>0) pthread_mutex_lock(&_mutex);
+  // list entries hold two pointers besides the element
+  const size_t list_entry = 3*sizeof(void*);
+  size_t bytes = (_nodes.size() + _factors.size())*sizeof(nodes_t);
+  for (unsigned int i=0; i<_nodes.size(); i++) {
+    bytes += _nodes[i].size()*list_entry;
+  }
+  for (unsigned int i=0; i<_factors.size(); i++) {
+    bytes += _factors[i].size()*list_entry;
+  }
+  bytes += (_pose_nodes.capacity() + _point_nodes.capacity())*sizeof(isam::Node*)
+    + (_num_points.capacity() + _num_constraints.capacity()
+       + _num_measurements.capacity())*sizeof(int)
+    + (_constraints.capacity() + _measurements.capacity())*sizeof(pair<int,int>)
+    + _buffer.capacity();
+  // map entries hold three pointers and a color besides the element
+  bytes += _node_index.size()*(4*sizeof(void*) + sizeof(isam::Node*)
+                               + sizeof(pair<bool, unsigned int>));
+  if (_window>0) pthread_mutex_unlock(&_mutex);
+  return bytes;
 }
 
 bool Loader::more_data(unsigned int* step) {
   (*step)++;
-  return (*step)<=num_steps();
+  if (_window==0) {
+    return (*step)<=num_steps();
+  }
+  pthread_mutex_lock(&_mutex);
+  // all steps before the requested one have been processed by now
+  while (_first_step+1<(*step) && !_nodes.empty()) {
+    _nodes.pop_front();
+    _factors.pop_front();
+    _first_step++;
+  }
+  pthread_cond_signal(&_cond_consumed);
+  // wait until the requested step is complete
+  while (!_done && _step<(*step)) {
+    pthread_cond_wait(&_cond_parsed, &_mutex);
+  }
+  bool more = (*step)<=num_steps();
+  pthread_mutex_unlock(&_mutex);
+  return more;
+}
+
+const nodes_t& Loader::nodes(int i) const {
+  if (_window==0) {
+    return _nodes[i];
+  }
+  pthread_mutex_lock(&_mutex);
+  const nodes_t& nodes = _nodes[i-_first_step];
+  pthread_mutex_unlock(&_mutex);
+  return nodes;
+}
+
+const factors_t& Loader::factors(int i) const {
+  if (_window==0) {
+    return _factors[i];
+  }
+  pthread_mutex_lock(&_mutex);
+  const factors_t& factors = _factors[i-_first_step];
+  pthread_mutex_unlock(&_mutex);
+  return factors;
+}
+
+factors_t& Loader::step_factors(unsigned int i) {
+  // when streaming, the oldest step might already have been handed
+  // out (or even been discarded), so add to the current step instead
+  if (_window>0 && i<=_first_step && i<_step) {
+    i = _step;
+  }
+  return _factors[i-_first_step];
+}
+
+void Loader::add_pose_node(Node* node) {
+  if (_window>0) {
+    _node_index[node] = make_pair(true, (unsigned int)_pose_nodes.size());
+  }
+  _pose_nodes.push_back(node);
+}
+
+void Loader::add_point_node(Node* node) {
+  if (_window>0) {
+    _node_index[node] = make_pair(false, (unsigned int)_point_nodes.size());
+  }
+  _point_nodes.push_back(node);
+}
+
+bool Loader::release(const nodes_t& nodes) {
+  if (_window==0) {
+    return false;
+  }
+  pthread_mutex_lock(&_mutex);
+  set<Node*> released;
+  for (nodes_t::const_iterator it = nodes.begin(); it!=nodes.end(); it++) {
+    map<Node*, pair<bool, unsigned int> >::iterator entry = _node_index.find(*it);
+    if (entry!=_node_index.end()) {
+      if (entry->second.first) {
+        _pose_nodes[entry->second.second] = NULL;
+      } else {
+        _point_nodes[entry->second.second] = NULL;
+      }
+      _node_index.erase(entry);
+      released.insert(*it);
+    }
+  }
+  // steps after _first_step have not been handed out yet
+  for (unsigned int i=1; i<_factors.size() && !released.empty(); i++) {
+    factors_t& factors = _factors[i];
+    for (factors_t::iterator it = factors.begin(); it!=factors.end(); ) {
+      const vector<Node*>& adjacent = (*it)->nodes();
+      bool involved = false;
+      for (unsigned int j=0; j<adjacent.size() && !involved; j++) {
+        involved = released.count(adjacent[j])>0;
+      }
+      if (involved) {
+        delete *it;
+        it = factors.erase(it);
+      } else {
+        it++;
+      }
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+  return true;
 }
 
 const Loader::PoseList Loader::poses(unsigned int step) const {
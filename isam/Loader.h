@@ -30,12 +30,29 @@
  *
  * Note that Loader expects files to be sorted, ie. the data should
  * arrive in the correct time order.
+ *
+ * The log file is memory mapped and tokenized by a dedicated number
+ * parser; large files can be split into chunks that are tokenized in
+ * parallel, while the resulting entries are still processed in file
+ * order. Binary graph files (see isam/GraphFile.h) are detected
+ * automatically; each pose node then starts a new time step.
+ *
+ * Alternatively, the log file can be streamed: a background thread
+ * parses the file while the caller consumes time steps, staying at most
+ * a given number of steps ahead. Steps are released once the next step
+ * is requested, so memory use no longer grows with the length of the
+ * log. No history for visualization is kept in that case. Nodes the
+ * consumer no longer needs can be handed back with release(); only the
+ * mapping from log file indices keeps growing, by one small entry per
+ * node.
  */
 
 #pragma once
 
 #include <vector>
 #include <list>
+#include <deque>
+#include <pthread.h>
 
 #include <isam/Node.h>
 #include <isam/Factor.h>
@@ -95,17 +112,25 @@ class Loader {
   bool _verbose;
   unsigned int _step;
   bool _is_3d;
-  FILE* _in;
 
   // for each time step, we have some new nodes and some new factors
-  std::vector<nodes_t> _nodes;
-  std::vector<factors_t> _factors;
+  // (starting at _first_step, earlier steps are discarded when streaming)
+  std::deque<nodes_t> _nodes;
+  std::deque<factors_t> _factors;
+  unsigned int _first_step;
+  // keep poses, points, constraints and measurements for visualization
+  bool _history;
 
   // for each time step, the corresponding pose
   std::vector<isam::Node*> _pose_nodes;
 
   // points, not by time step (needed for indexing below)
   std::vector<isam::Node*> _point_nodes;
+
+  // streaming: position of each node in _pose_nodes (first) or
+  // _point_nodes, until the node is released by the consumer; the
+  // entry there is then reset to NULL
+  std::map<isam::Node*, std::pair<bool, unsigned int> > _node_index;
   // for each time step, the number of points observed so far
   std::vector<int> _num_points;
 
@@ -121,6 +146,27 @@ class Loader {
 
   std::map<int, isam::StereoCamera*> _cameras;
 
+  // log file contents
+  const char* _data;
+  const char* _end;
+  void* _mapped;
+  size_t _mapped_size;
+  std::vector<char> _buffer;
+
+  // streaming: maximum number of steps parsed ahead (0 means not streaming)
+  unsigned int _window;
+  bool _done;
+  bool _stop;
+  pthread_t _thread;
+  mutable pthread_mutex_t _mutex;
+  pthread_cond_t _cond_parsed;
+  pthread_cond_t _cond_consumed;
+
+  nodes_t& step_nodes(unsigned int i) {return _nodes[i-_first_step];}
+  factors_t& step_factors(unsigned int i);
+  void add_pose_node(isam::Node* node);
+  void add_point_node(isam::Node* node);
+
   void add_prior();
   bool advance(unsigned int idx_x1, unsigned int next_point_id);
   void add_odometry(unsigned int idx_x0, unsigned int idx_x1, const isam::Pose2d& meausurement, const isam::Noise& noise);
@@ -129,7 +175,33 @@ class Loader {
   void add_measurement(unsigned int idx_x, unsigned int idx_l, const isam::Point2d& measurement, const isam::Noise& noise);
   void add_stereo(isam::StereoCamera* camera, unsigned int idx_x, unsigned int idx_p, const isam::StereoMeasurement& m, const isam::Noise& noise);
 
-  bool parse_line(char* str);
+public:
+  /**
+   * Keywords recognized in log files.
+   */
+  enum Keyword {
+    KEY_UNKNOWN,
+    KEY_ODOMETRY, // also EDGE2 and Constraint2
+    KEY_LANDMARK,
+    KEY_POINT3,
+    KEY_CAMERA_STEREO,
+    KEY_POINT_STEREO,
+    KEY_EDGE3,
+    KEY_POSE3D_INIT,
+    KEY_EDGE3_INIT,
+    KEY_POSE3D_TRUE,
+    KEY_EDGE3_TRUE,
+    KEY_SOLVE
+  };
+
+private:
+  bool parse_line(int keyword, const double* args, int num_args);
+  void load_graph(const char* data, size_t size);
+  void map_file(const char* fname, int num_lines);
+  void unmap_file();
+  void parse(const char* data, const char* end, int num_threads);
+  static void* stream_thread(void* loader);
+  void stream();
 
 public:
   typedef std::vector<isam::Pose3d, Eigen::aligned_allocator<isam::Pose3d> > PoseList;
@@ -139,8 +211,12 @@ public:
    * @param fname File name of log file.
    * @param num_lines Number of lines to process (0 means process complete file).
    * @param verbose Print constraints.
+   * @param num_threads Number of threads used for tokenizing the file.
+   * @param window Stream the log file, parsing at most this many steps
+   *   ahead of the consumer (0 means load the complete file).
    */
-  Loader(const char* fname, int num_lines, bool verbose);
+  Loader(const char* fname, int num_lines, bool verbose, int num_threads = 1,
+         unsigned int window = 0);
 
   ~Loader();
 
@@ -150,15 +226,34 @@ public:
   void print_stats() const;
 
   /**
-   * Returns true if step was not the last step.
+   * Bytes retained for the time steps, the node index and the
+   * visualization history; not included are the nodes and factors (usually owned by Slam once
+   * added) and the log file being streamed.
+   */
+  size_t memory() const;
+
+  /**
+   * Returns true if step was not the last step. When streaming, blocks
+   * until the requested step has been parsed, and releases all steps
+   * before the previously requested one.
    */
   bool more_data(unsigned int* step);
 
+  /**
+   * Only when streaming: the consumer no longer uses the given nodes
+   * (e.g. marginalized by a sliding window) and deletes them after this
+   * call. Factors on these nodes that were parsed but not handed out
+   * yet are deleted, later ones are not created.
+   * @return False if not streaming, the nodes are then still referenced
+   *   for visualization and must not be deleted.
+   */
+  bool release(const nodes_t& nodes);
+
   /**
    * Number of time steps in data loaded.
    * @return Number of time steps.
    */
-  unsigned int num_steps() const {return _nodes.size();}
+  unsigned int num_steps() const {return _first_step + _nodes.size();}
 
   /**
    * @return true if loaded data is 3D.
@@ -170,14 +265,14 @@ public:
    * @param i Time step.
    * @return Nodes created at step i.
    */
-  const nodes_t& nodes(int i) const {return _nodes[i];}
+  const nodes_t& nodes(int i) const;
 
   /**
    * Factors for incremental SLAM.
    * @param i Time step.
    * @return Factors created at step i.
    */
-  const factors_t& factors(int i) const {return _factors[i];}
+  const factors_t& factors(int i) const;
 
   /**
    * Returns vector of current 3D poses up to time step (converted from 2D as needed).
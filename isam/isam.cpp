@@ -36,21 +36,34 @@ const std::string usage = "\n"
     "  -v           verbose - additional output\n"
     "  -q           quiet - no output\n"
     "  -n <number>  max. number of lines to read, 0=all\n"
+    "  -p <number>  #threads for parsing the log file\n"
+    "  -w <number>  stream log file, parsing at most <number> steps ahead\n"
     "  -G           GUI: show in 3D viewer\n"
     "  -L           LCM: send data to external process\n"
     "  -S [fname]   save statistics\n"
     "  -W [fname]   write out final result\n"
+    "  -T [fname]   write timing trace (Chrome trace format), print timing summary\n"
+    "  -O           write result (-W) in binary graph format\n"
     "  -F           force use of numerical derivatives\n"
     "  -C           calculate marginal covariances\n"
     "  -B           batch processing\n"
     "  -M           use Levenberg-Marquardt for batch\n"
+    "  -E           eliminate landmarks first in batch optimization\n"
+    "  -I           iterative (conjugate gradient) solver for batch\n"
     "  -P           use Powell's Dog-Leg algorithm for optimization\n"
     "  -N           no optimization\n"
+    "  -A           asynchronous: run updates on a separate solver thread;\n"
+    "               -G and -L only draw the final result\n"
+    "  -l <number>  sliding window: keep the last <number> poses, marginalize\n"
+    "               older ones and landmarks no longer observed (sparse GLC),\n"
+    "               drop measurements involving them; not with -O\n"
     "  -R           use robust (pseudo-Huber) cost function\n"
     "  -d <number>  #steps between drawing/sending data\n"
     "  -u <number>  #steps between any updates (batch or incremental)\n"
     "  -b <number>  #steps between batch steps, 0=never\n"
     "  -s <number>  #steps between solution (backsubstitution)\n"
+    "  -t <number>  threshold for partial backsubstitution, 0=full\n"
+    "  -r <number>  threshold for relinearizing a node in batch steps, 0=all\n"
     "\n";
 
 const std::string intro = "\n"
@@ -66,6 +79,8 @@ const std::string intro = "\n"
 
 #include <isam/isam.h>
 #include <isam/robust.h>
+#include <isam/Trace.h>
+#include <isam/AsyncSlam.h>
 
 #include "Loader.h"
 #ifdef USE_LCM
@@ -90,15 +105,21 @@ const int FNAME_MAX = 500;
 char fname[FNAME_MAX];
 char fname_stats[FNAME_MAX] = "isam_stats.txt";
 char fname_result[FNAME_MAX] = "isam_result.txt";
+char fname_trace[FNAME_MAX] = "isam_trace.json";
 
 bool use_gui = false;
 bool use_lcm = false;
 bool save_stats = false;
 bool write_result = false;
+bool write_trace = false;
+bool binary_result = false;
 bool calculate_covariances = false;
 bool batch_processing = false;
 bool no_optimization = false;
+bool async_update = false;
 int parse_num_lines = 0;
+int parse_num_threads = 1;
+int parse_window = 0;
 
 // draw state every mod_draw steps
 int mod_draw = 1;
@@ -127,16 +148,14 @@ public:
 vector<class Stats> stats;
 
 // hard coded for now, affecting all constraints
-double robust_cost_function(double d) {
-  return cost_pseudo_huber(d, .5);
-}
+PseudoHuberKernel robust_kernel(.5);
 
 /**
  * Command line argument processing.
  */
 void process_arguments(int argc, char* argv[]) {
   int c;
-  while ((c = getopt(argc, argv, ":h?vqn:GLS:W:FCBMPNRd:u:b:s:")) != -1) {
+  while ((c = getopt(argc, argv, ":h?vqn:p:w:GLS:W:T:OFCBMEIPNRAl:d:u:b:s:t:r:")) != -1) {
     // Each option character has to be in the string in getopt();
     // the first colon changes the error character from '?' to ':';
     // a colon after an option means that there is an extra
@@ -160,6 +179,14 @@ void process_arguments(int argc, char* argv[]) {
       parse_num_lines = atoi(optarg);
       require(parse_num_lines>0, "Number of lines (-n) must be positive (>0).");
       break;
+    case 'p':
+      parse_num_threads = atoi(optarg);
+      require(parse_num_threads>0, "Number of parser threads (-p) must be positive (>0).");
+      break;
+    case 'w':
+      parse_window = atoi(optarg);
+      require(parse_window>0, "Number of steps to parse ahead (-w) must be positive (>0).");
+      break;
     case 'G':
 #ifndef USE_GUI
       require(false, "GUI support (-G) was disabled at compile time");
@@ -178,12 +205,22 @@ void process_arguments(int argc, char* argv[]) {
         strncpy(fname_stats, optarg, FNAME_MAX);
       }
       break;
+    case 'T':
+      write_trace = true;
+      trace_record_events(true);
+      if (optarg != NULL) {
+        strncpy(fname_trace, optarg, FNAME_MAX);
+      }
+      break;
     case 'W':
       write_result = true;
       if (optarg != NULL) {
         strncpy(fname_result, optarg, FNAME_MAX);
       }
       break;
+    case 'O':
+      binary_result = true;
+      break;
     case 'F':
       prop.force_numerical_jacobian = true;
       break;
@@ -196,14 +233,27 @@ void process_arguments(int argc, char* argv[]) {
     case 'M':
       prop.method = LEVENBERG_MARQUARDT;
       break;
+    case 'E':
+      prop.eliminate_landmarks = true;
+      break;
+    case 'I':
+      prop.linear_solver = CONJUGATE_GRADIENT;
+      break;
     case 'P':
       prop.method = DOG_LEG;
       break;
     case 'N':
       no_optimization = true;
       break;
+    case 'A':
+      async_update = true;
+      break;
+    case 'l':
+      prop.window = atoi(optarg);
+      require(prop.window>0, "Sliding window (-l) must be positive (>0).");
+      break;
     case 'R':
-      slam.set_cost_function(&robust_cost_function);
+      slam.set_robust_kernel(&robust_kernel);
       break;
     case 'd':
       mod_draw = atoi(optarg);
@@ -226,6 +276,16 @@ void process_arguments(int argc, char* argv[]) {
       require(prop.mod_solve>0,
           "Number of steps between solving (-s) must be positive (>0).");
       break;
+    case 't':
+      prop.partial_solve_threshold = atof(optarg);
+      require(prop.partial_solve_threshold>=0,
+          "Threshold for partial backsubstitution (-t) must be positive or zero (>=0).");
+      break;
+    case 'r':
+      prop.relinearize_threshold = atof(optarg);
+      require(prop.relinearize_threshold>=0,
+          "Threshold for relinearization (-r) must be positive or zero (>=0).");
+      break;
     case ':': // unknown option, from getopt
       cout << intro;
       cout << usage;
@@ -234,12 +294,39 @@ void process_arguments(int argc, char* argv[]) {
     }
   }
 
+  if (parse_window>0 && (use_gui || use_lcm)) {
+    cout << "Error:  Streaming (-w) does not support visualization (-G, -L)."
+        << endl;
+    exit(1);
+  }
+
+  if (async_update && (batch_processing || no_optimization || save_stats
+      || use_gui || use_lcm)) {
+    cout << "Error:  Asynchronous updates (-A) are only used for incremental"
+        << " processing, without statistics (-S) or visualization (-G, -L)."
+        << endl;
+    exit(1);
+  }
+
+  if (prop.window>0 && (batch_processing || no_optimization || async_update
+      || binary_result)) {
+    cout << "Error:  The sliding window (-l) is only used for synchronous"
+        << " incremental processing, without binary output (-O)." << endl;
+    exit(1);
+  }
+
   if ((prop.method == LEVENBERG_MARQUARDT) && (!batch_processing)) {
     cout << "Error:  Levenberg-Marquardt optimization has no incremental mode."
         << endl;
     exit(1);
   }
 
+  if ((prop.linear_solver == CONJUGATE_GRADIENT) && (!batch_processing)) {
+    cout << "Error:  The iterative solver (-I) is only used for batch processing (-B)."
+        << endl;
+    exit(1);
+  }
+
   if (argc > optind + 1) {
     cout << intro;
     cout << endl;
@@ -386,12 +473,31 @@ void check_quit() {
 #endif
 }
 
+/**
+ * Does the factor involve a node that is no longer in the graph?
+ */
+bool involves_removed(Factor* factor) {
+  const vector<Node*>& factor_nodes = factor->nodes();
+  for (unsigned int i=0; i<factor_nodes.size(); i++) {
+    if (!factor_nodes[i]->in_graph()) return true;
+  }
+  return false;
+}
+
 /**
  * Incrementally process factors.
  */
 void incremental_slam() {
   unsigned int step = 0;
 
+  // only the solver thread accesses slam until async is deleted
+  AsyncSlam* async = async_update ? new AsyncSlam(slam) : NULL;
+
+  // nodes marginalized by the sliding window, their measurements are
+  // dropped; unless streaming, the loader still refers to them for
+  // visualization, so they are only deleted once the loader releases them
+  list<Node*> released_nodes;
+  list<Factor*> released_factors;
 
   unsigned int next_step = step;
   // step by step after reading log file
@@ -400,32 +506,60 @@ void incremental_slam() {
 
     double t0 = tic();
 
-    tic("setup");
-
-    // add new variables and constraints for current step
-    for (unsigned int s = step; s < next_step; s++) {
-      for (list<Node*>::const_iterator it = loader->nodes(s).begin();
-          it != loader->nodes(s).end(); it++) {
-        if (prop.verbose)
-          cout << **it << endl;
-        slam.add_node(*it);
-      }
-      for (list<Factor*>::const_iterator it = loader->factors(s).begin();
-          it != loader->factors(s).end(); it++) {
-        if (prop.verbose)
-          cout << **it << endl;
-        slam.add_factor(*it);
+    {
+      ISAM_TRACE("setup");
+      // add new variables and constraints for current step
+      for (unsigned int s = step; s < next_step; s++) {
+        for (list<Node*>::const_iterator it = loader->nodes(s).begin();
+            it != loader->nodes(s).end(); it++) {
+          if (prop.verbose)
+            cout << **it << endl;
+          if (async) {
+            async->add_node(*it);
+          } else {
+            slam.add_node(*it);
+          }
+        }
+        for (list<Factor*>::const_iterator it = loader->factors(s).begin();
+            it != loader->factors(s).end(); it++) {
+          if (prop.verbose)
+            cout << **it << endl;
+          if (prop.window > 0 && involves_removed(*it)) {
+            continue;
+          }
+          if (async) {
+            async->add_factor(*it);
+          } else {
+            slam.add_factor(*it);
+          }
+        }
       }
     }
 
-    toc("setup");
-    tic("incremental");
-
     if (!(batch_processing || no_optimization)) {
-      slam.update();
+      ISAM_TRACE("incremental");
+      if (async) {
+        async->update();
+      } else {
+        slam.update();
+      }
     }
 
-    toc("incremental");
+    if (prop.window > 0) {
+      slam.release_marginalized(released_nodes, released_factors);
+      if (loader->release(released_nodes)) {
+        for (list<Factor*>::iterator it = released_factors.begin();
+            it != released_factors.end(); it++) {
+          delete *it;
+        }
+        for (list<Node*>::iterator it = released_nodes.begin();
+            it != released_nodes.end(); it++) {
+          delete *it;
+        }
+      }
+      released_nodes.clear();
+      released_factors.clear();
+    }
 
     if (save_stats) {
       stats.resize(step + 1);
@@ -437,26 +571,31 @@ void incremental_slam() {
       stats[step].nconstraints = slam.get_factors().size();
     }
 
-    // visualization is not counted in timing
-    if (!(batch_processing || no_optimization)) {
+    // visualization is not counted in timing; it reads the nodes and
+    // the factor directly, which the solver thread owns with -A
+    if (!(batch_processing || no_optimization || async)) {
       visualize(step);
     }
   }
 
+  if (async) {
+    // waiting for the solver thread to finish counts as update time
+    ISAM_TRACE("incremental");
+    delete async;
+  }
+
   visualize(step - 1);
 
   if (!no_optimization) {
     if (batch_processing) {
-      tic("batch");
+      ISAM_TRACE("batch");
       slam.batch_optimization();
-      toc("batch");
     } else {
       // end with a batch step/relinearization
       prop.mod_batch = 1;
       slam.set_properties(prop);
-      tic("final");
+      ISAM_TRACE("final");
       slam.update();
-      toc("final");
     }
   }
 
@@ -491,9 +630,22 @@ int process(void* unused) {
     save_statistics(fname_stats);
     cout << endl;
   }
+  if (write_trace) {
+    if (!prop.quiet) {
+      trace_print_summary();
+      cout << endl;
+    }
+    cout << "Saving timing trace to " << fname_trace << endl;
+    trace_write_chrome(fname_trace);
+    cout << endl;
+  }
   if (write_result) {
     cout << "Saving result to " << fname_result << endl;
-    slam.save(fname_result);
+    if (binary_result) {
+      slam.save_binary(fname_result);
+    } else {
+      slam.save(fname_result);
+    }
     cout << endl;
   }
 
@@ -530,7 +682,7 @@ int main(int argc, char* argv[]) {
     cout << endl;
   }
   // parse all data and get into suitable format for incremental processing
-  Loader loader_(fname, parse_num_lines, prop.verbose);
+  Loader loader_(fname, parse_num_lines, prop.verbose, parse_num_threads, parse_window);
   loader = &loader_;
   if (!prop.quiet) {
     loader_.print_stats();
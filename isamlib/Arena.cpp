@@ -0,0 +1,85 @@
+/**
+ * @file Arena.cpp
+ * @brief Region based allocation of nodes, factors and their values.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+
+#include "isam/util.h"
+#include "isam/Node.h"
+#include "isam/Arena.h"
+
+using namespace std;
+
+namespace isam {
+
+Arena::Arena(size_t block_size)
+  : _block_size(block_size), _next(NULL), _end(NULL), _allocated(0), _reserved(0)
+{
+}
+
+Arena::~Arena() {
+  for (int i=(int)_elements.size()-1; i>=0; i--) {
+    _elements[i]->~Element();
+  }
+  for (unsigned int i=0; i<_blocks.size(); i++) {
+    free(_blocks[i]);
+  }
+}
+
+char* Arena::new_block(size_t size) {
+  void* block = NULL;
+  require(posix_memalign(&block, ALIGNMENT, size)==0,
+          "Arena::allocate: out of memory");
+  _blocks.push_back((char*)block);
+  _reserved += size;
+  return (char*)block;
+}
+
+void* Arena::allocate(size_t size) {
+  // round up to keep the next allocation aligned
+  size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  _allocated += size;
+  if (size > _block_size) {
+    // large requests get a block of their own
+    return new_block(size);
+  }
+  if ((size_t)(_end-_next) < size) {
+    _next = new_block(_block_size);
+    _end = _next + _block_size;
+  }
+  void* p = _next;
+  _next += size;
+  return p;
+}
+
+void Arena::adopt(Element* element) {
+  _elements.push_back(element);
+}
+
+void Arena::adopt(Node* node) {
+  node->_arena = this;
+  _elements.push_back(node);
+}
+
+}
@@ -0,0 +1,319 @@
+/**
+ * @file AsyncSlam.cpp
+ * @brief Runs Slam updates on a background solver thread.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include "isam/util.h"
+#include "isam/Trace.h"
+#include "isam/AsyncSlam.h"
+
+using namespace std;
+using namespace Eigen;
+
+namespace isam {
+
+struct UpdateFuture::State {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool ready;
+  UpdateStats stats;
+  // number of futures and queued commands referring to this state
+  int refs;
+
+  State() : ready(false), refs(1) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  ~State() {
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  void add_ref() {
+    __sync_add_and_fetch(&refs, 1);
+  }
+
+  void release() {
+    if (__sync_sub_and_fetch(&refs, 1) == 0) {
+      delete this;
+    }
+  }
+
+  void set(const UpdateStats& result) {
+    pthread_mutex_lock(&mutex);
+    stats = result;
+    ready = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+  }
+};
+
+UpdateFuture::UpdateFuture() : _state(NULL) {
+}
+
+UpdateFuture::UpdateFuture(State* state) : _state(state) {
+  _state->add_ref();
+}
+
+UpdateFuture::UpdateFuture(const UpdateFuture& rhs) : _state(rhs._state) {
+  if (_state) _state->add_ref();
+}
+
+const UpdateFuture& UpdateFuture::operator= (const UpdateFuture& rhs) {
+  if (rhs._state) rhs._state->add_ref();
+  if (_state) _state->release();
+  _state = rhs._state;
+  return *this;
+}
+
+UpdateFuture::~UpdateFuture() {
+  if (_state) _state->release();
+}
+
+bool UpdateFuture::ready() const {
+  require(_state != NULL, "UpdateFuture::ready: no update requested");
+  pthread_mutex_lock(&_state->mutex);
+  bool ready = _state->ready;
+  pthread_mutex_unlock(&_state->mutex);
+  return ready;
+}
+
+const UpdateStats& UpdateFuture::get() const {
+  require(_state != NULL, "UpdateFuture::get: no update requested");
+  pthread_mutex_lock(&_state->mutex);
+  while (!_state->ready) {
+    pthread_cond_wait(&_state->cond, &_state->mutex);
+  }
+  pthread_mutex_unlock(&_state->mutex);
+  // not modified once ready
+  return _state->stats;
+}
+
+AsyncSlam::AsyncSlam(Slam& slam)
+  : _slam(slam), _busy(false), _stop(false), _published_step(0), _size(0),
+    _relayout(false)
+{
+  require(_slam.properties().window == 0,
+          "AsyncSlam: sliding window (Properties::window) not supported");
+  // nodes added before are published as well
+  const list<Node*>& nodes = _slam.get_nodes();
+  _nodes.assign(nodes.begin(), nodes.end());
+  _offsets.assign(_nodes.size(), -1);
+
+  pthread_mutex_init(&_mutex, NULL);
+  pthread_mutex_init(&_publish_mutex, NULL);
+  pthread_cond_init(&_cond_queued, NULL);
+  pthread_cond_init(&_cond_idle, NULL);
+  require(pthread_create(&_thread, NULL, solver_thread, this)==0,
+          "AsyncSlam: Failed to create solver thread");
+}
+
+AsyncSlam::~AsyncSlam() {
+  pthread_mutex_lock(&_mutex);
+  _stop = true;
+  pthread_cond_signal(&_cond_queued);
+  pthread_mutex_unlock(&_mutex);
+  pthread_join(_thread, NULL);
+
+  pthread_cond_destroy(&_cond_idle);
+  pthread_cond_destroy(&_cond_queued);
+  pthread_mutex_destroy(&_publish_mutex);
+  pthread_mutex_destroy(&_mutex);
+}
+
+void AsyncSlam::enqueue(const Command& command) {
+  pthread_mutex_lock(&_mutex);
+  _queue.push_back(command);
+  pthread_cond_signal(&_cond_queued);
+  pthread_mutex_unlock(&_mutex);
+}
+
+void AsyncSlam::add_node(Node* node) {
+  Command command = {NODE, node, NULL, NULL, NULL, NULL};
+  enqueue(command);
+}
+
+void AsyncSlam::add_factor(Factor* factor) {
+  Command command = {FACTOR, NULL, factor, NULL, NULL, NULL};
+  enqueue(command);
+}
+
+void AsyncSlam::remove_node(Node* node) {
+  Command command = {REMOVE_NODE, node, NULL, NULL, NULL, NULL};
+  enqueue(command);
+}
+
+UpdateFuture AsyncSlam::update(callback_t callback, void* data) {
+  // the reference of the new state is held by the command
+  UpdateFuture::State* state = new UpdateFuture::State();
+  UpdateFuture future(state);
+  Command command = {UPDATE, NULL, NULL, state, callback, data};
+  enqueue(command);
+  return future;
+}
+
+void AsyncSlam::flush() {
+  pthread_mutex_lock(&_mutex);
+  while (!_queue.empty() || _busy) {
+    pthread_cond_wait(&_cond_idle, &_mutex);
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+unsigned int AsyncSlam::pending() const {
+  pthread_mutex_lock(&_mutex);
+  unsigned int n = _queue.size() + (_busy ? 1 : 0);
+  pthread_mutex_unlock(&_mutex);
+  return n;
+}
+
+bool AsyncSlam::estimate(Node* node, VectorXd& value) const {
+  pthread_mutex_lock(&_publish_mutex);
+  map<Node*, pair<int, int> >::const_iterator it = _index.find(node);
+  bool found = (it != _index.end());
+  if (found) {
+    value = Map<const VectorXd>(&_front[it->second.first], it->second.second);
+  }
+  pthread_mutex_unlock(&_publish_mutex);
+  return found;
+}
+
+int AsyncSlam::published_step() const {
+  pthread_mutex_lock(&_publish_mutex);
+  int step = _published_step;
+  pthread_mutex_unlock(&_publish_mutex);
+  return step;
+}
+
+void AsyncSlam::remove(Node* node) {
+  vector<Node*>::iterator it = find(_nodes.begin(), _nodes.end(), node);
+  if (it != _nodes.end()) {
+    _offsets.erase(_offsets.begin() + (it - _nodes.begin()));
+    _nodes.erase(it);
+  }
+  pthread_mutex_lock(&_publish_mutex);
+  _index.erase(node);
+  pthread_mutex_unlock(&_publish_mutex);
+  // the space of the node is reclaimed with the next publish
+  _relayout = true;
+}
+
+void AsyncSlam::publish(int step) {
+  ISAM_TRACE("AsyncSlam::publish");
+  if (_relayout) {
+    _offsets.assign(_nodes.size(), -1);
+    _size = 0;
+  }
+  // nodes are placed in the buffers once initialized
+  vector<int> new_nodes;
+  for (unsigned int i=0; i<_nodes.size(); i++) {
+    if (_offsets[i] < 0 && _nodes[i]->initialized()) {
+      _offsets[i] = _size;
+      _size += _nodes[i]->dim();
+      new_nodes.push_back(i);
+    }
+  }
+  // fill the back buffer without holding the lock
+  _back.resize(_size);
+  for (unsigned int i=0; i<_nodes.size(); i++) {
+    if (_offsets[i] >= 0) {
+      VectorXd v = _nodes[i]->vector(ESTIMATE);
+      memcpy(&_back[_offsets[i]], v.data(), v.size()*sizeof(double));
+    }
+  }
+  pthread_mutex_lock(&_publish_mutex);
+  if (_relayout) {
+    _index.clear();
+    _relayout = false;
+  }
+  for (unsigned int k=0; k<new_nodes.size(); k++) {
+    int i = new_nodes[k];
+    _index[_nodes[i]] = make_pair(_offsets[i], _nodes[i]->dim());
+  }
+  _front.swap(_back);
+  _published_step = step;
+  pthread_mutex_unlock(&_publish_mutex);
+}
+
+void AsyncSlam::run() {
+  pthread_mutex_lock(&_mutex);
+  while (true) {
+    while (_queue.empty() && !_stop) {
+      pthread_cond_wait(&_cond_queued, &_mutex);
+    }
+    if (_queue.empty()) {
+      // stop requested and all work done
+      break;
+    }
+    Command command = _queue.front();
+    _queue.pop_front();
+    _busy = true;
+    pthread_mutex_unlock(&_mutex);
+
+    switch (command.type) {
+    case NODE:
+      _slam.add_node(command.node);
+      _nodes.push_back(command.node);
+      _offsets.push_back(-1);
+      break;
+    case FACTOR:
+      _slam.add_factor(command.factor);
+      break;
+    case REMOVE_NODE:
+      _slam.remove_node(command.node);
+      remove(command.node);
+      break;
+    case UPDATE:
+      {
+        require(_slam.properties().window == 0,
+                "AsyncSlam: sliding window (Properties::window) not supported");
+        UpdateStats stats = _slam.update();
+        publish(stats.step);
+        if (command.callback) {
+          command.callback(stats, command.data);
+        }
+        command.future->set(stats);
+        command.future->release();
+      }
+      break;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    _busy = false;
+    if (_queue.empty()) {
+      pthread_cond_broadcast(&_cond_idle);
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+void* AsyncSlam::solver_thread(void* async) {
+  static_cast<AsyncSlam*>(async)->run();
+  return NULL;
+}
+
+}
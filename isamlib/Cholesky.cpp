@@ -28,10 +28,12 @@
 #include <string.h>
 
 #include "isam/util.h"
+#include "isam/Trace.h"
 #include "isam/SparseMatrix.h"
 #include "isam/SparseSystem.h"
 
 #include "isam/Cholesky.h"
+#include "isam/ConjugateGradient.h"
 
 #include "cs.h"
 #include "cholmod.h"
@@ -66,7 +68,7 @@ public:
   }
 
   void factorize(const SparseSystem& Ab, VectorXd* delta = NULL, double lambda = 0) {
-    tic("Cholesky");
+    ISAM_TRACE("Cholesky");
 
     reset(); // make sure _L, _rhs, _order are empty
 
@@ -96,16 +98,16 @@ public:
         AtAx[p] *= (1+lambda);
       }
       L_factor = cholmod_analyze(AtA, &Common);
-      tic("cholmod_factorize");
-      cholmod_factorize(AtA, L_factor, &Common);
-      toc("cholmod_factorize");
+      {
+        ISAM_TRACE("cholmod_factorize");
+        cholmod_factorize(AtA, L_factor, &Common);
+      }
       cholmod_free_sparse(&AtA, &Common);
       cholmod_free_sparse(&A, &Common);
     } else {
       L_factor = cholmod_analyze(At, &Common);
-      tic("cholmod_factorize");
+      ISAM_TRACE("cholmod_factorize");
       cholmod_factorize(At, L_factor, &Common);
-      toc("cholmod_factorize");
     }
     // make sure factorization is in correct format (LL, simplicial, packed, ordered)
     cholmod_change_factor(CHOLMOD_REAL, true, false, true, true, L_factor, &Common);
@@ -143,7 +145,6 @@ public:
     cholmod_free_factor(&L_factor, &Common);
     cholmod_free_sparse(&At, &Common);
 
-    toc("Cholesky");
   }
 
   void get_R(SparseSystem& R) {
@@ -173,23 +174,7 @@ private:
     cholmod_sparse* T = cholmod_allocate_sparse(A.num_cols(), A.num_rows(), A.nnz(),
                                                 true, true, 0, CHOLMOD_REAL, &Common);
 
-    int* p = (int*)T->p;
-    int* i = (int*)T->i;
-    double* x = (double*)T->x;
-    int n = 0;
-    *p = n;
-    for (int row=0; row<A.num_rows(); row++) {
-      const SparseVector& r = A.get_row(row);
-      int nnz = r.nnz();
-      // easy: CSparse and SparseVector indices are both 0-based
-      r.copy_raw(i, x);
-      i += nnz;
-      x += nnz;
-      n += nnz;
-      p++;
-      *p = n;
-    }
-
+    csc_transp_of_sparseMatrix(A, (int*)T->p, (int*)T->i, (double*)T->x);
     return T;
   }
 
@@ -198,16 +183,7 @@ private:
     int nrow = T->ncol; // swapped for transpose
     int ncol = T->nrow;
     SparseVector_p* rows = new SparseVector_p[nrow];
-    int *p = (int*)T->p;
-    int *i = (int*)T->i;
-    double* x = (double*)T->x;
-    for (int row = 0; row < nrow; row++) {
-      int nnz = *(p+1) - *p;
-      rows[row] = new SparseVector(i, x, nnz);
-      i += nnz;
-      x += nnz;
-      p++;
-    }
+    rows_of_csc_transp(nrow, (int*)T->p, (int*)T->i, (double*)T->x, rows);
     A.import_rows_ordered(nrow, ncol, rows, order);
     delete [] rows;
   }
@@ -269,7 +245,7 @@ public:
   }
 
   void factorize(const SparseSystem& Ab, VectorXd* delta = NULL, double lambda = 0) {
-    tic("Cholesky");
+    ISAM_TRACE("Cholesky");
 
     reset(); // make sure _L, _rhs, _order are empty
 
@@ -350,23 +326,7 @@ private:
   cs* to_csparse_transp(const SparseMatrix& A) const {
     // note: num_cols/num_rows swapped for transpose
     cs* T = cs_spalloc(A.num_cols(), A.num_rows(), A.nnz(), 1, 0);
-    int* p = (int*)T->p;
-    int* i = (int*)T->i;
-    double* x = (double*)T->x;
-    int n = 0;
-    *p = n;
-    for (int row=0; row<A.num_rows(); row++) {
-      const SparseVector& r = A.get_row(row);
-      int nnz = r.nnz();
-      // easy: CSparse and SparseVector indices are both 0-based
-      r.copy_raw(i, x);
-      i += nnz;
-      x += nnz;
-      n += nnz;
-      p++;
-      *p = n;
-    }
-
+    csc_transp_of_sparseMatrix(A, (int*)T->p, (int*)T->i, (double*)T->x);
     return T;
   }
 
@@ -374,16 +334,7 @@ private:
     int nrow = T->n; // swapped for transpose
     int ncol = T->m;
     SparseVector_p rows[nrow];
-    int *p = (int*)T->p;
-    int *i = (int*)T->i;
-    double* x = (double*)T->x;
-    for (int row = 0; row < nrow; row++) {
-      int nnz = *(p+1) - *p;
-      rows[row] = new SparseVector(i, x, nnz);
-      i += nnz;
-      x += nnz;
-      p++;
-    }
+    rows_of_csc_transp(nrow, (int*)T->p, (int*)T->i, (double*)T->x, rows);
     A.import_rows_ordered(nrow, ncol, rows, order);
   }
 
@@ -398,4 +349,13 @@ Cholesky* Cholesky::Create() {
   }
 }
 
+Cholesky* Cholesky::Create(const Properties& prop) {
+  if (prop.linear_solver == CONJUGATE_GRADIENT) {
+    return new ConjugateGradient(prop.cg_tolerance, prop.cg_max_iterations,
+        prop.cg_preconditioner);
+  } else {
+    return Create();
+  }
+}
+
 }
@@ -26,6 +26,8 @@
  *
  */
 
+#include <algorithm>
+
 #include "isam/ChowLiuTree.h"
 #include "isam/util.h"
 
@@ -34,7 +36,7 @@ using namespace Eigen;
 
 namespace isam {
 
-MatrixXd matslice (const MatrixXd A, vector<int> ii, vector<int> jj) {
+MatrixXd matslice (const MatrixXd& A, const vector<int>& ii, const vector<int>& jj) {
   MatrixXd B(ii.size(), jj.size());
   for (size_t i=0; i<ii.size(); i++) {
     for (size_t j=0; j<jj.size(); j++) {
@@ -44,63 +46,113 @@ MatrixXd matslice (const MatrixXd A, vector<int> ii, vector<int> jj) {
   return B;
 }
 
-
-MatrixXd ChowLiuTreeInfo::marginal(int id) {
-
-  // get the indicies associated with the node
-  vector<int> iia(0);
-  vector<int> iib(0);
+ChowLiuTreeInfo::ChowLiuTreeInfo (const MatrixXd& L, const vector<Node *>& nodes)
+  : _L(L), _nodes(nodes), _root(0), _prior(0.)
+{
   int off = 0;
   for (size_t i=0; i<_nodes.size(); i++) {
-    if ((int)i == id)
-      for (int j=0; j<_nodes[i]->dim(); j++) iia.push_back(off+j);
-    else
-      for (int j=0; j<_nodes[i]->dim(); j++) iib.push_back(off+j);
+    _offsets.push_back(off);
     off += _nodes[i]->dim();
+    // the largest node removes most of the gauge freedom
+    if (_nodes[i]->dim() > _nodes[_root]->dim()) {
+      _root = i;
+    }
   }
 
-  if (iib.size() > 0) {
-      MatrixXd Laa = matslice(_L, iia, iia);
-      MatrixXd Lbb = matslice(_L, iib, iib);
-      MatrixXd Lab = matslice(_L, iia, iib);
-      MatrixXd Lbbinv = posdef_pinv(Lbb);
-      return Laa - Lab * Lbbinv * Lab.transpose();
-      //return Laa - Lab * Lbb.inverse() * Lab.transpose();
-  } else
-      return _L;
-}
+  // covariance with a prior on the root node, which makes it
+  // well-conditioned if L is only singular because of the gauge
+  if (_nodes.size() > 2) {
+    _prior = _L.diagonal().maxCoeff();
+    MatrixXd L_prior = _L;
+    int d = _nodes[_root]->dim();
+    L_prior.block(_offsets[_root], _offsets[_root], d, d) += _prior * MatrixXd::Identity(d, d);
+    SelfAdjointEigenSolver<MatrixXd> eig(L_prior);
+    const VectorXd& ev = eig.eigenvalues(); // in increasing order
+    if (eig.info() == Success && _prior > 0. && ev(0) > 1e-10 * ev(ev.size()-1)) {
+      VectorXd ev_inv = ev.cwiseInverse();
+      _cov = eig.eigenvectors() * ev_inv.asDiagonal() * eig.eigenvectors().transpose();
+    }
+  }
 
-MatrixXd ChowLiuTreeInfo::joint(int ida, int idb) {
+  int nn = _nodes.size();
+  _marginals.resize(nn);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i=0; i<nn; i++) {
+    if (nn == 1) {
+      _marginals[i] = _L;
+    } else {
+      _marginals[i] = _marginalize(_indices(i));
+    }
+  }
+}
 
-  vector<int> iia(0);
-  vector<int> iib(0);
-  vector<int> iic(0);
-  int off = 0;
-  for (size_t i=0; i<_nodes.size(); i++) {
-    if ((int)i == ida)
-      for (int j=0; j<_nodes[i]->dim(); j++) iia.push_back(off+j);
-    else if ((int)i == idb)
-      for (int j=0; j<_nodes[i]->dim(); j++) iib.push_back(off+j);
-    else
-      for (int j=0; j<_nodes[i]->dim(); j++) iic.push_back(off+j);
-    off += _nodes[i]->dim();
+vector<int> ChowLiuTreeInfo::_indices(int id) const {
+  vector<int> ii(_nodes[id]->dim());
+  for (size_t j=0; j<ii.size(); j++) {
+    ii[j] = _offsets[id] + j;
   }
-  vector<int> iiab(0);
-  iiab.insert(iiab.end(), iia.begin(), iia.end());
-  iiab.insert(iiab.end(), iib.begin(), iib.end());
-  
-  if (iic.size() > 0) {
-    MatrixXd Labab = matslice(_L, iiab, iiab);
+  return ii;
+}
+
+// Marginal information of the variables ii, the Schur complement of L
+// onto ii. The prior on the root only affects the root, so the marginal
+// onto ii and the root is the inverse of their block of the covariance,
+// minus the prior; the root is then eliminated from that small matrix.
+MatrixXd ChowLiuTreeInfo::_marginalize(const vector<int>& ii) const {
+  int n = ii.size();
+  if (_cov.rows() == 0) {
+    // no covariance, Schur complement of L
+    vector<bool> in(_L.rows(), false);
+    for (int i=0; i<n; i++) {
+      in[ii[i]] = true;
+    }
+    vector<int> iic;
+    for (int i=0; i<_L.rows(); i++) {
+      if (!in[i]) iic.push_back(i);
+    }
+    MatrixXd Laa = matslice(_L, ii, ii);
     MatrixXd Lcc = matslice(_L, iic, iic);
-    MatrixXd Labc = matslice(_L, iiab, iic);
+    MatrixXd Lac = matslice(_L, ii, iic);
     MatrixXd Lccinv = posdef_pinv(Lcc);
-    return Labab - Labc * Lccinv * Labc.transpose();
-    //return Labab - Labc * Lcc.inverse() * Labc.transpose();
-  } else
-      return matslice(_L, iiab, iiab);
+    return Laa - Lac * Lccinv * Lac.transpose();
+  }
+
+  int d = _nodes[_root]->dim();
+  vector<int> iir = ii;
+  bool has_root = (find(ii.begin(), ii.end(), _offsets[_root]) != ii.end());
+  if (!has_root) {
+    vector<int> root = _indices(_root);
+    iir.insert(iir.end(), root.begin(), root.end());
+  }
+  MatrixXd cov = matslice(_cov, iir, iir);
+  MatrixXd M = posdef_pinv(cov);
+  for (int i=0; i<(int)iir.size(); i++) {
+    if (iir[i] >= _offsets[_root] && iir[i] < _offsets[_root] + d) {
+      M(i,i) -= _prior;
+    }
+  }
+  if (has_root) {
+    return M;
+  }
+  MatrixXd Mrr_inv = posdef_pinv(MatrixXd(M.bottomRightCorner(d, d)));
+  return M.topLeftCorner(n, n) - M.topRightCorner(n, d) * Mrr_inv * M.bottomLeftCorner(d, n);
+}
+
+MatrixXd ChowLiuTreeInfo::joint(int ida, int idb) const {
+
+  vector<int> iiab = _indices(ida);
+  vector<int> iib = _indices(idb);
+  iiab.insert(iiab.end(), iib.begin(), iib.end());
+
+  if (_nodes.size() > 2)
+    return _marginalize(iiab);
+  else
+    return matslice(_L, iiab, iiab);
 }
 
-MatrixXd ChowLiuTreeInfo::conditional(int ida, int idb) {
+MatrixXd ChowLiuTreeInfo::conditional(int ida, int idb) const {
 
   MatrixXd Lj = joint(ida, idb);
   return Lj.block(0, 0, _nodes[ida]->dim(), _nodes[ida]->dim());
@@ -126,13 +178,19 @@ ChowLiuTree::ChowLiuTree (const Eigen::MatrixXd &L, const std::vector<Node *>& n
     //calculate the parent nodes based on maximising mutual information
     _calc_edges();
     _max_span_tree();
+    // neighbors in the tree, in the order of the edges
+    vector<vector<int> > adjacent(nodes.size());
+    for (size_t i=0; i<_edges.size(); i++) {
+      adjacent[_edges[i].id1].push_back(_edges[i].id2);
+      adjacent[_edges[i].id2].push_back(_edges[i].id1);
+    }
     tree.clear();
-    _build_tree_rec(_edges.front().id1, -1);
+    _build_tree_rec(_edges.front().id1, -1, adjacent);
 
   }
 }
 
-bool mi_sort(MI &first, MI &second) {
+bool mi_sort(const MI &first, const MI &second) {
   return first.mi > second.mi;
 }
 
@@ -140,22 +198,30 @@ void
 ChowLiuTree::_calc_edges()  {
 
   int nn = _clt_info.num_nodes();
-  //double npairs = floor(pow((double)bb, 2.0) / 2) -  floor((double)nn/2);
 
+  _edges.reserve(nn*(nn-1)/2);
   for (int i=0; i<nn; i++) {
     for (int j=(i+1); j<nn; j++) {
-      MI mi_tmp (i,j, _calc_mi(i, j));
-      _edges.push_back(mi_tmp);
+      _edges.push_back(MI(i, j, 0.));
     }
   }
-  _edges.sort(mi_sort);
+  // pairs are independent of each other
+  int num_edges = _edges.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int k=0; k<num_edges; k++) {
+    _edges[k].mi = _calc_mi(_edges[k].id1, _edges[k].id2);
+  }
+  // stable, ties are kept in the order of the pairs
+  stable_sort(_edges.begin(), _edges.end(), mi_sort);
   
 }
 
 double ChowLiuTree::_calc_mi(int ida, int idb) {
 
   MatrixXd L_agb = _clt_info.conditional (ida, idb);
-  MatrixXd L_a = _clt_info.marginal (ida);
+  const MatrixXd& L_a = _clt_info.marginal (ida);
 
   // use pdet
   //double ldL_agb = plogdet(L_agb);
@@ -170,35 +236,49 @@ double ChowLiuTree::_calc_mi(int ida, int idb) {
   return mi;
 }
 
+// root of the group of id, with path halving
+int find_group(vector<int>& parent, int id) {
+  while (parent[id] != id) {
+    parent[id] = parent[parent[id]];
+    id = parent[id];
+  }
+  return id;
+}
+
 void ChowLiuTree::_max_span_tree() {
 
   // init groups: assign each id to a different group initially
-  map<int, int> groups; // map <node index, group index>
-  for (int i=0; i<_clt_info.num_nodes(); i++) {
-      groups[i] = i;
-  }
-    
-  int group1, group2;
-  list<MI>::iterator edge = _edges.begin();
-  while(edge != _edges.end()) {
-    if(groups[edge->id1] != groups[edge->id2]) {
-      group1 = groups[edge->id1];
-      group2 = groups[edge->id2];
-
-      // merge group2 into group 1
-      map<int, int>::iterator groupIt;
-      for(groupIt = groups.begin(); groupIt != groups.end(); groupIt++)
-        if(groupIt->second == group2) groupIt->second = group1;
-
-      edge++;
-    } else {
-      edge = _edges.erase(edge);
+  int nn = _clt_info.num_nodes();
+  vector<int> parent(nn);
+  vector<int> rank(nn, 0);
+  for (int i=0; i<nn; i++) {
+    parent[i] = i;
+  }
+
+  // Kruskal: keep the edges with largest mutual information that join
+  // two groups, in their order
+  vector<MI> tree_edges;
+  tree_edges.reserve(nn-1);
+  for (size_t k=0; k<_edges.size() && (int)tree_edges.size()<nn-1; k++) {
+    int group1 = find_group(parent, _edges[k].id1);
+    int group2 = find_group(parent, _edges[k].id2);
+    if (group1 != group2) {
+      // merge the smaller group into the larger one
+      if (rank[group1] < rank[group2]) {
+        swap(group1, group2);
+      }
+      parent[group2] = group1;
+      if (rank[group1] == rank[group2]) {
+        rank[group1]++;
+      }
+      tree_edges.push_back(_edges[k]);
     }
   }
+  _edges.swap(tree_edges);
   
 }
 
-void ChowLiuTree::_build_tree_rec(int id, int pid) {
+void ChowLiuTree::_build_tree_rec(int id, int pid, const vector<vector<int> >& adjacent) {
 
   ChowLiuTreeNode new_node;
 
@@ -209,31 +289,22 @@ void ChowLiuTree::_build_tree_rec(int id, int pid) {
     new_node.conditional = new_node.marginal;
     new_node.joint = new_node.marginal;
   } else {
-    new_node.conditional = _clt_info.conditional(id, pid);
+    // the conditional is part of the joint
     new_node.joint = _clt_info.joint(id, pid);
+    int dim = new_node.marginal.rows();
+    new_node.conditional = new_node.joint.block(0, 0, dim, dim);
   }
 
-  vector<int> cids; // vector of child ids
-  list<MI>::iterator edge = _edges.begin();
-  while(edge != _edges.end()) {
-    if(edge->id1 == new_node.id) {
-      cids.push_back(edge->id2);
-      edge = _edges.erase(edge);
-      continue;
-    }
-    if(edge->id2 == new_node.id) {
-      cids.push_back(edge->id1);
-      edge = _edges.erase(edge);
-      continue;
+  for(size_t i=0; i < adjacent[id].size(); i++) {
+    if (adjacent[id][i] != pid) {
+      new_node.cids.push_back(adjacent[id][i]);
     }
-    edge++;
   }
-  for(size_t i=0; i < cids.size(); i++) {
-      new_node.cids.push_back(cids[i]);
-      _build_tree_rec(cids[i], new_node.id);
+  for(size_t i=0; i < new_node.cids.size(); i++) {
+      _build_tree_rec(new_node.cids[i], new_node.id, adjacent);
   }
 
   tree[new_node.id] = new_node;
 }
 
-} //namespace isam
\ No newline at end of file
+} //namespace isam
@@ -0,0 +1,207 @@
+/**
+ * @file ConjugateGradient.cpp
+ * @brief Preconditioned conjugate gradient solver for least squares problems.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cmath>
+
+#include "isam/util.h"
+#include "isam/Trace.h"
+#include "isam/ConjugateGradient.h"
+
+using namespace std;
+using namespace Eigen;
+
+namespace isam {
+
+// larger groups of variables are split into several blocks
+const int MAX_BLOCK_SIZE = 12;
+
+ConjugateGradient::ConjugateGradient(double tolerance, int max_iterations,
+    Preconditioner preconditioner)
+  : _tolerance(tolerance), _max_iterations(max_iterations),
+    _preconditioner(preconditioner), _iterations(0)
+{
+}
+
+void ConjugateGradient::find_blocks(const SparseSystem& Ab) {
+  int n = Ab.num_cols();
+  // variables col and col+1 belong to different blocks if a row
+  // contains only one of them
+  vector<char> split(n, (_preconditioner == JACOBI) ? 1 : 0);
+  if (_preconditioner == BLOCK_JACOBI) {
+    for (int row=0; row<Ab.num_rows(); row++) {
+      int prev = -2;
+      for (SparseVectorIter iter(Ab.get_row(row)); iter.valid(); iter.next()) {
+        int col = iter.get();
+        if (col != prev+1) {
+          if (prev >= 0) split[prev] = 1;
+          if (col > 0) split[col-1] = 1;
+        }
+        prev = col;
+      }
+      if (prev >= 0) split[prev] = 1;
+    }
+  }
+  _block_starts.clear();
+  _block_starts.push_back(0);
+  for (int col=0; col<n-1; col++) {
+    if (split[col] || col+1-_block_starts.back() >= MAX_BLOCK_SIZE) {
+      _block_starts.push_back(col+1);
+    }
+  }
+  _block_starts.push_back(n);
+}
+
+void ConjugateGradient::build_preconditioner(const SparseSystem& Ab,
+    const VectorXd& damping) {
+  int n = Ab.num_cols();
+  int num_blocks = _block_starts.size() - 1;
+  vector<int> block_of(n);
+  _blocks.resize(num_blocks);
+  for (int b=0; b<num_blocks; b++) {
+    int size = _block_starts[b+1] - _block_starts[b];
+    _blocks[b] = MatrixXd::Zero(size, size);
+    for (int col=_block_starts[b]; col<_block_starts[b+1]; col++) {
+      block_of[col] = b;
+    }
+  }
+
+  // diagonal blocks of A'A; entries of a block are consecutive in a row
+  vector<int> cols;
+  vector<double> vals;
+  for (int row=0; row<Ab.num_rows(); row++) {
+    const SparseVector& rowvec = Ab.get_row(row);
+    cols.resize(rowvec.nnz());
+    vals.resize(rowvec.nnz());
+    int k = 0;
+    for (SparseVectorIter iter(rowvec); iter.valid(); iter.next(), k++) {
+      cols[k] = iter.get(vals[k]);
+    }
+    for (int i=0; i<k; i++) {
+      int b = block_of[cols[i]];
+      int start = _block_starts[b];
+      for (int j=i; j<k && block_of[cols[j]]==b; j++) {
+        double v = vals[i]*vals[j];
+        _blocks[b](cols[i]-start, cols[j]-start) += v;
+        if (j != i) {
+          _blocks[b](cols[j]-start, cols[i]-start) += v;
+        }
+      }
+    }
+  }
+
+  // replace each block by its Cholesky factor, falling back to the
+  // diagonal for blocks that are not positive definite
+  for (int b=0; b<num_blocks; b++) {
+    MatrixXd& block = _blocks[b];
+    for (int i=0; i<block.rows(); i++) {
+      block(i,i) += damping(_block_starts[b]+i);
+    }
+    LLT<MatrixXd> llt(block);
+    if (llt.info() != Success) {
+      VectorXd diag = block.diagonal();
+      for (int i=0; i<diag.size(); i++) {
+        if (diag(i) <= 0.) diag(i) = 1.;
+      }
+      llt.compute(MatrixXd(diag.asDiagonal()));
+    }
+    block = llt.matrixL();
+  }
+}
+
+void ConjugateGradient::precondition(const VectorXd& s, VectorXd& z) const {
+  z.resize(s.size());
+  for (unsigned int b=0; b<_blocks.size(); b++) {
+    int start = _block_starts[b];
+    int size = _block_starts[b+1] - start;
+    const MatrixXd& L = _blocks[b];
+    VectorXd y = L.triangularView<Lower>().solve(s.segment(start, size));
+    z.segment(start, size) = L.transpose().triangularView<Upper>().solve(y);
+  }
+}
+
+void ConjugateGradient::factorize(const SparseSystem& Ab, VectorXd* delta, double lambda) {
+  require(delta != NULL, "ConjugateGradient::factorize: solution has to be requested");
+  ISAM_TRACE("ConjugateGradient");
+  int m = Ab.num_rows();
+  int n = Ab.num_cols();
+  const VectorXd& b = Ab.rhs();
+
+  _order.resize(n);
+  for (int i=0; i<n; i++) {
+    _order[i] = i;
+  }
+
+  // Levenberg-Marquardt: lambda times the diagonal of A'A is added
+  VectorXd damping = VectorXd::Zero(n);
+  if (lambda > 0.) {
+    for (int row=0; row<m; row++) {
+      for (SparseVectorIter iter(Ab.get_row(row)); iter.valid(); iter.next()) {
+        double v;
+        int col = iter.get(v);
+        damping(col) += lambda*v*v;
+      }
+    }
+  }
+
+  find_blocks(Ab);
+  build_preconditioner(Ab, damping);
+
+  // CGLS: conjugate gradient on A'A x = A'b without forming A'A;
+  // s is the residual of the normal equations
+  VectorXd& x = *delta;
+  x = VectorXd::Zero(n);
+  VectorXd r = b;
+  VectorXd s = mul_SparseMatrixTrans_Vector(Ab, r);
+  VectorXd z;
+  precondition(s, z);
+  VectorXd p = z;
+  VectorXd q;
+  double gamma = s.dot(z);
+  double norm_s0 = s.norm();
+  int max_iterations = (_max_iterations > 0) ? _max_iterations : n;
+  _iterations = 0;
+  while (_iterations < max_iterations && s.norm() > _tolerance * norm_s0) {
+    _iterations++;
+    q = Ab * p;
+    double alpha = gamma / (q.squaredNorm() + p.dot(damping.cwiseProduct(p)));
+    x += alpha * p;
+    r -= alpha * q;
+    s = mul_SparseMatrixTrans_Vector(Ab, r) - damping.cwiseProduct(x);
+    precondition(s, z);
+    double gamma_new = s.dot(z);
+    p = z + (gamma_new / gamma) * p;
+    gamma = gamma_new;
+  }
+}
+
+void ConjugateGradient::get_R(SparseSystem& R) {
+  require(false, "ConjugateGradient::get_R: no factor available for iterative solver");
+}
+
+int* ConjugateGradient::get_order() {
+  return _order.empty() ? NULL : &_order[0];
+}
+
+}
@@ -51,6 +51,13 @@ Covariances::Covariances(Slam& slam) : _slam(NULL), _R(slam._R) {
   }  
 }
 
+size_t Covariances::memory() const {
+  // map nodes hold three pointers and a color besides the entry
+  size_t index = _index.size()
+      * (sizeof(std::pair<Node* const, std::pair<int, int> >) + 4*sizeof(void*));
+  return _R.memory() + index + _cache.memory();
+}
+
 int Covariances::get_start(Node* node) const {
   if (_slam) {
     return node->_start;
@@ -160,4 +167,84 @@ list<MatrixXd> Covariances::access(const node_pair_list_t& node_pair_list) const
   return empty_list;
 }
 
+vector<double> Covariances::mahalanobis(const vector<Factor*>& candidates) const {
+  const SparseSystem& R = (_slam==NULL) ? _R : _slam->_R;
+  if (_slam) {
+    _slam->update_starts();
+  }
+
+  vector<double> distances;
+  if (R.num_rows()>1) { // skip if _R not calculated yet (eg. before batch step)
+
+    // request the upper triangle of the joint marginal over the nodes
+    // of each candidate; entries requested by several candidates are
+    // retrieved from the cache instead of being recalculated
+    const int* trans = R.a_to_r();
+    entry_list_t index_list;
+    vector<int> dims(candidates.size());
+    for (unsigned int k=0; k<candidates.size(); k++) {
+      vector<int> indices;
+      const vector<Node*>& nodes = candidates[k]->nodes();
+      for (unsigned int i=0; i<nodes.size(); i++) {
+        int start = get_start(nodes[i]);
+        int dim = get_dim(nodes[i]);
+        for (int j=0; j<dim; j++) {
+          indices.push_back(trans[start+j]);
+        }
+      }
+      int n = indices.size();
+      for (int r=0; r<n; r++) {
+        for (int c=r; c<n; c++) {
+          index_list.push_back(make_pair(indices[r], indices[c]));
+        }
+      }
+      dims[k] = n;
+    }
+    vector<double> covs;
+    cov_marginal(R, _cache, index_list, covs);
+
+    // innovation covariance S = H*Sigma*H' + I for whitened measurements
+    distances.resize(candidates.size());
+    MatrixXd Sigma;
+    MatrixXd H;
+    MatrixXd S;
+    int pos = 0;
+    for (unsigned int k=0; k<candidates.size(); k++) {
+      Factor* factor = candidates[k];
+      int n = dims[k];
+      Sigma.resize(n, n);
+      for (int r=0; r<n; r++) {
+        for (int c=r; c<n; c++, pos++) {
+          Sigma(r,c) = covs[pos];
+          Sigma(c,r) = covs[pos];
+        }
+      }
+      // Jacobian at the estimate, the same point as the innovation: the
+      // linearization point may be several steps old in incremental mode
+      const vector<Node*>& nodes = factor->nodes();
+      for (unsigned int i=0; i<nodes.size(); i++) {
+        nodes[i]->swap_estimates();
+      }
+      Jacobian jac = factor->jacobian();
+      for (unsigned int i=0; i<nodes.size(); i++) {
+        nodes[i]->swap_estimates();
+      }
+      int m = factor->dim();
+      H.setZero(m, n);
+      for (Terms::const_iterator it=jac.terms().begin(); it!=jac.terms().end(); it++) {
+        int offset = 0;
+        for (unsigned int i=0; i<nodes.size() && nodes[i]!=it->node(); i++) {
+          offset += nodes[i]->dim();
+        }
+        H.block(0, offset, m, it->term().cols()) = it->term();
+      }
+      S = H * Sigma * H.transpose();
+      S.diagonal().array() += 1.;
+      VectorXd innovation = factor->sqrtinf() * factor->basic_error(ESTIMATE);
+      distances[k] = innovation.dot(S.llt().solve(innovation));
+    }
+  }
+  return distances;
+}
+
 }
@@ -42,6 +42,19 @@ using namespace Eigen;
 
 namespace isam {
 
+int GLC_RootShift::_root() {
+  // decide on the root for the root shift
+  // for now just use the first pose2d or pose3d
+  int np = _nodes.size();
+  int ir=0;
+  for (ir=0; ir<np; ir++) {
+    if (0 == strcmp(_nodes[ir]->name(), "Pose3d") ||
+        0 == strcmp(_nodes[ir]->name(), "Pose2d"))
+      break;
+  }
+  return ir;
+}
+
 VectorXd GLC_RootShift::reparameterize (Selector s) {
 
   VectorXd x;
@@ -56,15 +69,16 @@ VectorXd GLC_RootShift::reparameterize (Selector s) {
   x.resize(_dim);
   x.setZero();
 
-  // decide on the root for the root shift
-  // for now just use the first pose2d or pose3d
-  int ir=0;
-  for (ir=0; ir<np; ir++) {
-    if (0 == strcmp(_nodes[ir]->name(), "Pose3d") ||
-        0 == strcmp(_nodes[ir]->name(), "Pose2d"))
-      break;
+  int ir = _root();
+  if (ir == np) {
+    // no pose to shift to, identity
+    int ioff = 0;
+    for (int j=0; j<np; j++) {
+      x.segment(ioff, _nodes[j]->dim()) = _nodes[j]->vector(s);
+      ioff += _nodes[j]->dim();
+    }
+    return x;
   }
-  assert (ir != np); // assumes a pose3d or pose2d node is avaliable
   Node *node_i = _nodes[ir];
 
   int ioff = 0;
@@ -112,45 +126,107 @@ VectorXd GLC_RootShift::root_shift (Node* node_i, Node* node_j, Selector s) {
   return x_i_j;
 }
 
-const double epsilon = 0.0001;
+// maps the rates of yaw, pitch and roll to the angular velocity of
+// wRo = Rz(yaw)*Ry(pitch)*Rx(roll) in the world frame
+Matrix3d euler_rates (double yaw, double pitch) {
+  double cy = cos(yaw);
+  double sy = sin(yaw);
+  double cp = cos(pitch);
+  double sp = sin(pitch);
+  Matrix3d E;
+  E << 0., -sy, cy*cp,
+       0.,  cy, sy*cp,
+       1.,  0.,   -sp;
+  return E;
+}
+
+Matrix3d skew (const Vector3d& v) {
+  Matrix3d S;
+  S <<    0., -v(2),  v(1),
+        v(2),    0., -v(0),
+       -v(1),  v(0),    0.;
+  return S;
+}
+
+void GLC_RootShift::root_shift_jacobian (Node* node_i, Node* node_j, Selector s,
+                                         MatrixXd& J_i, MatrixXd& J_j) {
+
+  J_i = MatrixXd::Zero(node_j->dim(), node_i->dim());
+  J_j = MatrixXd::Identity(node_j->dim(), node_j->dim());
+  if (0 == strcmp(node_i->name(), "Pose3d")) {
+    // a rotation of pose i by w (in the world frame) rotates everything
+    // expressed in frame i by -oRw_i*w
+    Pose3d pose3d_i = dynamic_cast<Pose3d_Node*>(node_i)->value(s);
+    Matrix3d oRw_i = pose3d_i.rot().wRo().transpose();
+    Vector3d t_i = pose3d_i.trans().vector();
+    Matrix3d E_i = euler_rates(pose3d_i.yaw(), pose3d_i.pitch());
+    if (0 == strcmp(node_j->name(), "Pose3d")) {
+      Pose3d pose3d_j = dynamic_cast<Pose3d_Node*>(node_j)->value(s);
+      Pose3d pose3d_i_j = pose3d_j.ominus(pose3d_i);
+      Matrix3d E_i_j_inv = euler_rates(pose3d_i_j.yaw(), pose3d_i_j.pitch()).inverse();
+      Matrix3d E_j = euler_rates(pose3d_j.yaw(), pose3d_j.pitch());
+      Vector3d d = pose3d_j.trans().vector() - t_i;
+      J_i.block<3,3>(0,0) = -oRw_i;
+      J_i.block<3,3>(0,3) = oRw_i * skew(d) * E_i;
+      J_i.block<3,3>(3,3) = -E_i_j_inv * oRw_i * E_i;
+      J_j.block<3,3>(0,0) = oRw_i;
+      J_j.block<3,3>(3,3) = E_i_j_inv * oRw_i * E_j;
+    } else if (0 == strcmp(node_j->name(), "Point3d")) {
+      Vector3d d = dynamic_cast<Point3d_Node*>(node_j)->value(s).vector() - t_i;
+      J_i.block<3,3>(0,0) = -oRw_i;
+      J_i.block<3,3>(0,3) = oRw_i * skew(d) * E_i;
+      J_j = oRw_i;
+    }
+  } else if (0 == strcmp(node_i->name(), "Pose2d")) {
+    Pose2d pose2d_i = dynamic_cast<Pose2d_Node*>(node_i)->value(s);
+    double c = cos(pose2d_i.t());
+    double si = sin(pose2d_i.t());
+    Matrix2d oRw_i;
+    oRw_i << c, si, -si, c;
+    if (0 == strcmp(node_j->name(), "Pose2d")) {
+      Pose2d pose2d_j = dynamic_cast<Pose2d_Node*>(node_j)->value(s);
+      Pose2d pose2d_i_j = pose2d_j.ominus(pose2d_i);
+      J_i.block<2,2>(0,0) = -oRw_i;
+      J_i(0,2) = pose2d_i_j.y();
+      J_i(1,2) = -pose2d_i_j.x();
+      J_i(2,2) = -1.;
+      J_j.block<2,2>(0,0) = oRw_i;
+    } else if (0 == strcmp(node_j->name(), "Point2d")) {
+      Point2d point2d_i_j = pose2d_i.transform_to(dynamic_cast<Point2d_Node*>(node_j)->value(s));
+      J_i.block<2,2>(0,0) = -oRw_i;
+      J_i(0,2) = point2d_i_j.y();
+      J_i(1,2) = -point2d_i_j.x();
+      J_j = oRw_i;
+    }
+  }
+}
 
-// TODO replace with analytical jacobians
 MatrixXd GLC_RootShift::jacobian() {
 
-  MatrixXd J(_dim,_dim);
-
-  int col = 0;
-  // for each node...
-  for (vector<Node*>::iterator it = _nodes.begin(); it!=_nodes.end(); it++) {
-    Node* node = *it;
-    int dim_n = node->dim();
-    // for each dimension of the node...
-    for (int j=0; j<dim_n; j++, col++) {
-      VectorXd delta(dim_n);
-      delta.setZero();
-      // remember original value
-      VectorXd original = node->vector0();
-      // evaluate positive delta
-      delta(j) = epsilon;
-      //node->self_exmap(delta); // taken care of in exmap_jacobian() in glc.[h/cpp]
-      node->update0(node->vector0() + delta);
-      VectorXd y_plus = reparameterize(LINPOINT);
-      node->update0(original);
-      // evaluate negative delta
-      delta(j) = -epsilon;
-      //node->self_exmap(delta);  // taken care of in exmap_jacobian() in glc.[h/cpp]
-      node->update0(node->vector0() + delta);
-      VectorXd y_minus = reparameterize(LINPOINT);
-      node->update0(original);
-      // store column
-      VectorXd diff = (y_plus - y_minus) / (epsilon + epsilon);
-      // wrap angular difference
-      for (int k=0; k<_dim; k++) {
-        if (_is_angle(k))
-          diff(k) = standardRad(diff(k));
-      }
-      J.col(col) = diff;
+  // evaluated at the linearization point, as reparameterize(LINPOINT)
+  MatrixXd J = MatrixXd::Identity(_dim,_dim);
+
+  int np = _nodes.size();
+  int ir = _root();
+  if (np == 1 || ir == np) {
+    return J;
+  }
+
+  Node *node_i = _nodes[ir];
+  int ioff_i = 0;
+  for (int j=0; j<ir; j++) {
+    ioff_i += _nodes[j]->dim();
+  }
+  int ioff = 0;
+  for (int j=0; j<np; j++) {
+    Node *node_j = _nodes[j];
+    if (j != ir) {
+      MatrixXd J_i, J_j;
+      root_shift_jacobian(node_i, node_j, LINPOINT, J_i, J_j);
+      J.block(ioff, ioff_i, node_j->dim(), node_i->dim()) = J_i;
+      J.block(ioff, ioff, node_j->dim(), node_j->dim()) = J_j;
     }
+    ioff += node_j->dim();
   }
 
   return J;
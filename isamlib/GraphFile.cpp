@@ -0,0 +1,478 @@
+/**
+ * @file GraphFile.cpp
+ * @brief Compact binary file format for graphs (nodes, factors, estimates).
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <fstream>
+#include <cstring>
+#include <map>
+
+#include "isam/util.h"
+#include "isam/slam2d.h"
+#include "isam/slam3d.h"
+#include "isam/slam_stereo.h"
+
+#include "isam/GraphFile.h"
+
+using namespace std;
+using namespace Eigen;
+
+namespace isam {
+
+namespace {
+
+const char MAGIC[8] = {'i', 'S', 'A', 'M', 'g', 'r', 'p', 'h'};
+
+enum NodeType {
+  NODE_UNKNOWN,
+  NODE_POSE2D,
+  NODE_POINT2D,
+  NODE_POSE3D,
+  NODE_POINT3D,
+  NODE_POINT3DH
+};
+
+enum FactorType {
+  FACTOR_UNKNOWN,
+  FACTOR_POINT2D,
+  FACTOR_POSE2D,
+  FACTOR_POSE2D_POSE2D,
+  FACTOR_POSE2D_POINT2D,
+  FACTOR_POSE3D,
+  FACTOR_POSE3D_POSE3D,
+  FACTOR_POSE3D_POINT3D,
+  FACTOR_STEREO
+};
+
+struct TypeName {
+  const char* name;
+  int type;
+};
+
+const TypeName node_types[] = {
+  {"Pose2d", NODE_POSE2D},
+  {"Point2d", NODE_POINT2D},
+  {"Pose3d", NODE_POSE3D},
+  {"Point3d", NODE_POINT3D},
+  {"Point3dh", NODE_POINT3DH}
+};
+
+const TypeName factor_types[] = {
+  {"Point2d_Factor", FACTOR_POINT2D},
+  {"Pose2d_Factor", FACTOR_POSE2D},
+  {"Pose2d_Pose2d_Factor", FACTOR_POSE2D_POSE2D},
+  {"Pose2d_Point2d_Factor", FACTOR_POSE2D_POINT2D},
+  {"Pose3d_Factor", FACTOR_POSE3D},
+  {"Pose3d_Pose3d_Factor", FACTOR_POSE3D_POSE3D},
+  {"Pose3d_Point3d_Factor", FACTOR_POSE3D_POINT3D},
+  {"Stereo_Factor", FACTOR_STEREO}
+};
+
+template <int N>
+int lookup_type(const TypeName (&table)[N], const char* name) {
+  for (int i=0; i<N; i++) {
+    if (strcmp(table[i].name, name)==0) {
+      return table[i].type;
+    }
+  }
+  return 0;
+}
+
+// values are stored in their internal representation to allow exact
+// round trips; in particular, angles are not normalized
+template <class T>
+VectorXd to_vector(const T& t) {
+  return t.vector();
+}
+
+template <>
+VectorXd to_vector<Pose3d>(const Pose3d& pose) {
+  Quaterniond q = pose.rot().quaternion();
+  VectorXd v(7);
+  v << pose.x(), pose.y(), pose.z(), q.w(), q.x(), q.y(), q.z();
+  return v;
+}
+
+template <class T>
+T from_vector(const VectorXd& v) {
+  return T(v);
+}
+
+template <>
+Pose3d from_vector<Pose3d>(const VectorXd& v) {
+  return Pose3d(Point3d(v(0), v(1), v(2)), Rot3d(Quaterniond(v(3), v(4), v(5), v(6))));
+}
+
+template <class T>
+void put_node(BinaryWriter& out, Node* node) {
+  NodeT<T>* node_t = dynamic_cast<NodeT<T>*>(node);
+  out.put<unsigned char>(node_t->initialized());
+  if (node_t->initialized()) {
+    out.put_vector(to_vector(node_t->value(ESTIMATE)));
+    out.put_vector(to_vector(node_t->value0()));
+  }
+}
+
+template <class N, class T>
+N* read_node(BinaryReader& in) {
+  N* node = new N();
+  bool initialized = in.get<unsigned char>();
+  if (initialized) {
+    VectorXd value = in.get_vector();
+    VectorXd value0 = in.get_vector();
+    require(value.size()==value0.size() && value.size()==to_vector(T()).size(),
+        "read_graph_file: inconsistent node size");
+    node->init(from_vector<T>(value), from_vector<T>(value0));
+  }
+  return node;
+}
+
+template <class N>
+N* node_as(const vector<Node*>& nodes, unsigned int i) {
+  require(i<nodes.size(), "read_graph_file: invalid node index");
+  N* node = dynamic_cast<N*>(nodes[i]);
+  require(node!=NULL, "read_graph_file: factor refers to node of wrong type");
+  return node;
+}
+
+void put_noise(BinaryWriter& out, const MatrixXd& sqrtinf) {
+  int n = sqrtinf.rows();
+  // only the upper triangle is stored, Factor checks this in debug mode only
+  require(sqrtinf.cols()==n && n<256, "write_graph_file: noise must be a small square matrix");
+  for (int r=0; r<n; r++) {
+    for (int c=0; c<r; c++) {
+      require(sqrtinf(r,c)==0, "write_graph_file: sqrtinf must be upper triangular");
+    }
+  }
+  out.put<unsigned char>(n);
+  for (int r=0; r<n; r++) {
+    for (int c=r; c<n; c++) {
+      out.put<double>(sqrtinf(r,c));
+    }
+  }
+}
+
+SqrtInformation get_noise(BinaryReader& in) {
+  int n = in.get<unsigned char>();
+  MatrixXd sqrtinf = MatrixXd::Zero(n, n);
+  for (int r=0; r<n; r++) {
+    for (int c=r; c<n; c++) {
+      sqrtinf(r,c) = in.get<double>();
+    }
+  }
+  return SqrtInformation(sqrtinf);
+}
+
+// checks the sizes declared in the file against the factor type before
+// the measurement is converted
+void check_sizes(const VectorXd& measure, const SqrtInformation& noise,
+    int measure_size, int dim) {
+  require(measure.size()==measure_size, "read_graph_file: wrong measurement size for factor");
+  require(noise.sqrtinf().rows()==dim, "read_graph_file: wrong noise size for factor");
+}
+
+template <class T>
+T get_measurement(const VectorXd& measure, const SqrtInformation& noise) {
+  check_sizes(measure, noise, to_vector(T()).size(), T::dim);
+  return from_vector<T>(measure);
+}
+
+template <class T>
+void put_measurement(BinaryWriter& out, Factor* factor) {
+  out.put_vector(to_vector(dynamic_cast<FactorT<T>*>(factor)->measurement()));
+}
+
+}
+
+bool is_graph_file(const char* data, size_t size) {
+  return size>=sizeof(MAGIC) && memcmp(data, MAGIC, sizeof(MAGIC))==0;
+}
+
+bool is_graph_file(const string& fname) {
+  ifstream in(fname.c_str(), ios::in | ios::binary);
+  char magic[sizeof(MAGIC)];
+  in.read(magic, sizeof(MAGIC));
+  return in && is_graph_file(magic, sizeof(MAGIC));
+}
+
+void write_graph(BinaryWriter& out,
+    const list<Node*>& nodes, const list<Factor*>& factors) {
+  // index nodes and cameras in order of appearance
+  map<Node*, unsigned int> node_index;
+  unsigned int n = 0;
+  for (list<Node*>::const_iterator it = nodes.begin(); it!=nodes.end(); it++, n++) {
+    node_index[*it] = n;
+  }
+  map<StereoCamera*, unsigned int> camera_index;
+  vector<StereoCamera*> cameras;
+  for (list<Factor*>::const_iterator it = factors.begin(); it!=factors.end(); it++) {
+    Stereo_Factor* stereo = dynamic_cast<Stereo_Factor*>(*it);
+    if (stereo && camera_index.find(stereo->camera())==camera_index.end()) {
+      camera_index[stereo->camera()] = cameras.size();
+      cameras.push_back(stereo->camera());
+    }
+  }
+
+  for (unsigned int i=0; i<sizeof(MAGIC); i++) {
+    out.put<char>(MAGIC[i]);
+  }
+  out.put<unsigned int>(GRAPH_FILE_VERSION);
+  out.put<unsigned int>(cameras.size());
+  out.put<unsigned int>(nodes.size());
+  out.put<unsigned int>(factors.size());
+
+  for (unsigned int i=0; i<cameras.size(); i++) {
+    out.put<double>(cameras[i]->focalLength());
+    out.put<double>(cameras[i]->principalPoint()(0));
+    out.put<double>(cameras[i]->principalPoint()(1));
+    out.put<double>(cameras[i]->baseline());
+  }
+
+  for (list<Node*>::const_iterator it = nodes.begin(); it!=nodes.end(); it++) {
+    Node* node = *it;
+    int type = lookup_type(node_types, node->name());
+    require(type!=NODE_UNKNOWN, "write_graph_file: unsupported node type");
+    out.put<unsigned char>(type);
+    switch (type) {
+    case NODE_POSE2D:
+      put_node<Pose2d>(out, node);
+      break;
+    case NODE_POINT2D:
+      put_node<Point2d>(out, node);
+      break;
+    case NODE_POSE3D:
+      put_node<Pose3d>(out, node);
+      break;
+    case NODE_POINT3D:
+      put_node<Point3d>(out, node);
+      break;
+    case NODE_POINT3DH:
+      put_node<Point3dh>(out, node);
+      break;
+    }
+  }
+
+  for (list<Factor*>::const_iterator it = factors.begin(); it!=factors.end(); it++) {
+    Factor* factor = *it;
+    int type = lookup_type(factor_types, factor->name());
+    require(type!=FACTOR_UNKNOWN, "write_graph_file: unsupported factor type");
+    require(!factor->has_own_robust_kernel(),
+        "write_graph_file: factors with their own robust kernel are not supported");
+    vector<Node*>& adjacent = factor->nodes();
+    require((type!=FACTOR_POSE2D_POSE2D && type!=FACTOR_POSE3D_POSE3D) || adjacent.size()==2,
+        "write_graph_file: anchored factors are not supported");
+    out.put<unsigned char>(type);
+    out.put<unsigned char>(adjacent.size());
+    for (unsigned int i=0; i<adjacent.size(); i++) {
+      map<Node*, unsigned int>::iterator idx = node_index.find(adjacent[i]);
+      require(idx!=node_index.end(), "write_graph_file: factor refers to node that is not saved");
+      out.put<unsigned int>(idx->second);
+    }
+    switch (type) {
+    case FACTOR_POINT2D:
+    case FACTOR_POSE2D_POINT2D:
+      put_measurement<Point2d>(out, factor);
+      break;
+    case FACTOR_POSE2D:
+    case FACTOR_POSE2D_POSE2D:
+      put_measurement<Pose2d>(out, factor);
+      break;
+    case FACTOR_POSE3D:
+    case FACTOR_POSE3D_POSE3D:
+      put_measurement<Pose3d>(out, factor);
+      break;
+    case FACTOR_POSE3D_POINT3D:
+      put_measurement<Point3d>(out, factor);
+      break;
+    case FACTOR_STEREO:
+      put_measurement<StereoMeasurement>(out, factor);
+      break;
+    }
+    put_noise(out, factor->sqrtinf());
+    if (type==FACTOR_STEREO) {
+      Stereo_Factor* stereo = dynamic_cast<Stereo_Factor*>(factor);
+      require(!stereo->relative(), "write_graph_file: relative stereo factors are not supported");
+      out.put<unsigned int>(camera_index[stereo->camera()]);
+      out.put<unsigned char>(stereo->measurement().valid);
+    }
+  }
+
+}
+
+void write_graph_file(const string& fname,
+    const list<Node*>& nodes, const list<Factor*>& factors) {
+  BinaryWriter out;
+  write_graph(out, nodes, factors);
+  out.save(fname);
+}
+
+void read_graph(BinaryReader& in, GraphFileContents& contents) {
+  for (unsigned int i=0; i<sizeof(MAGIC); i++) {
+    require(in.get<char>()==MAGIC[i], "read_graph_file: not a binary graph file");
+  }
+  unsigned int version = in.get<unsigned int>();
+  require(version==GRAPH_FILE_VERSION, "read_graph_file: unsupported file version");
+  unsigned int num_cameras = in.get<unsigned int>();
+  unsigned int num_nodes = in.get<unsigned int>();
+  unsigned int num_factors = in.get<unsigned int>();
+
+  vector<StereoCamera*>& cameras = contents.cameras;
+  unsigned int first_camera = cameras.size();
+  cameras.reserve(first_camera + num_cameras);
+  for (unsigned int i=0; i<num_cameras; i++) {
+    double f = in.get<double>();
+    double cx = in.get<double>();
+    double cy = in.get<double>();
+    double b = in.get<double>();
+    cameras.push_back(new StereoCamera(f, Vector2d(cx, cy), b));
+  }
+
+  // factors refer to nodes of the same file only
+  vector<Node*> nodes;
+  nodes.reserve(num_nodes);
+  for (unsigned int i=0; i<num_nodes; i++) {
+    Node* node = NULL;
+    switch (in.get<unsigned char>()) {
+    case NODE_POSE2D:
+      node = read_node<Pose2d_Node, Pose2d>(in);
+      break;
+    case NODE_POINT2D:
+      node = read_node<Point2d_Node, Point2d>(in);
+      break;
+    case NODE_POSE3D:
+      node = read_node<Pose3d_Node, Pose3d>(in);
+      break;
+    case NODE_POINT3D:
+      node = read_node<Point3d_Node, Point3d>(in);
+      break;
+    case NODE_POINT3DH:
+      node = read_node<Point3dh_Node, Point3dh>(in);
+      break;
+    default:
+      require(false, "read_graph_file: unknown node type");
+    }
+    nodes.push_back(node);
+  }
+
+  contents.factors.reserve(contents.factors.size() + num_factors);
+  for (unsigned int i=0; i<num_factors; i++) {
+    int type = in.get<unsigned char>();
+    unsigned int num_adjacent = in.get<unsigned char>();
+    vector<unsigned int> idx(num_adjacent);
+    for (unsigned int j=0; j<num_adjacent; j++) {
+      idx[j] = in.get<unsigned int>();
+    }
+    require(num_adjacent==(type==FACTOR_POINT2D || type==FACTOR_POSE2D || type==FACTOR_POSE3D ? 1u : 2u),
+        "read_graph_file: wrong number of nodes for factor");
+    VectorXd measure = in.get_vector();
+    SqrtInformation noise = get_noise(in);
+    Factor* factor = NULL;
+    switch (type) {
+    case FACTOR_POINT2D:
+      factor = new Point2d_Factor(node_as<Point2d_Node>(nodes, idx[0]),
+          get_measurement<Point2d>(measure, noise), noise);
+      break;
+    case FACTOR_POSE2D:
+      factor = new Pose2d_Factor(node_as<Pose2d_Node>(nodes, idx[0]),
+          get_measurement<Pose2d>(measure, noise), noise);
+      break;
+    case FACTOR_POSE2D_POSE2D:
+      factor = new Pose2d_Pose2d_Factor(node_as<Pose2d_Node>(nodes, idx[0]),
+          node_as<Pose2d_Node>(nodes, idx[1]), get_measurement<Pose2d>(measure, noise), noise);
+      break;
+    case FACTOR_POSE2D_POINT2D:
+      factor = new Pose2d_Point2d_Factor(node_as<Pose2d_Node>(nodes, idx[0]),
+          node_as<Point2d_Node>(nodes, idx[1]), get_measurement<Point2d>(measure, noise), noise);
+      break;
+    case FACTOR_POSE3D:
+      factor = new Pose3d_Factor(node_as<Pose3d_Node>(nodes, idx[0]),
+          get_measurement<Pose3d>(measure, noise), noise);
+      break;
+    case FACTOR_POSE3D_POSE3D:
+      factor = new Pose3d_Pose3d_Factor(node_as<Pose3d_Node>(nodes, idx[0]),
+          node_as<Pose3d_Node>(nodes, idx[1]), get_measurement<Pose3d>(measure, noise), noise);
+      break;
+    case FACTOR_POSE3D_POINT3D:
+      factor = new Pose3d_Point3d_Factor(node_as<Pose3d_Node>(nodes, idx[0]),
+          node_as<Point3d_Node>(nodes, idx[1]), get_measurement<Point3d>(measure, noise), noise);
+      break;
+    case FACTOR_STEREO: {
+      unsigned int camera = in.get<unsigned int>();
+      require(camera<num_cameras, "read_graph_file: invalid camera index");
+      bool valid = in.get<unsigned char>();
+      check_sizes(measure, noise, 3, 3);
+      StereoMeasurement m(measure(0), measure(1), measure(2), valid);
+      Pose3d_Node* pose = node_as<Pose3d_Node>(nodes, idx[0]);
+      require(idx[1]<nodes.size(), "read_graph_file: invalid node index");
+      if (dynamic_cast<Point3dh_Node*>(nodes[idx[1]])) {
+        factor = new Stereo_Factor(pose, node_as<Point3dh_Node>(nodes, idx[1]),
+            cameras[first_camera+camera], m, noise);
+      } else {
+        factor = new Stereo_Factor(pose, node_as<Point3d_Node>(nodes, idx[1]),
+            cameras[first_camera+camera], m, noise);
+      }
+      break;
+    }
+    default:
+      require(false, "read_graph_file: unknown factor type");
+    }
+    contents.factors.push_back(factor);
+  }
+
+  contents.nodes.insert(contents.nodes.end(), nodes.begin(), nodes.end());
+}
+
+void read_graph_file(const char* data, size_t size, GraphFileContents& contents) {
+  BinaryReader in(data, size);
+  read_graph(in, contents);
+}
+
+void read_graph_file(const string& fname, GraphFileContents& contents) {
+  vector<char> data;
+  BinaryReader::load(fname, data);
+  read_graph_file(data.empty() ? NULL : &data[0], data.size(), contents);
+}
+
+void BinaryWriter::save(const string& fname) const {
+  ofstream file(fname.c_str(), ios::out | ios::binary);
+  require(file, "BinaryWriter::save: Cannot open output file.");
+  if (!_buffer.empty()) {
+    file.write(&_buffer[0], _buffer.size());
+  }
+  require(file, "BinaryWriter::save: Failed to write output file.");
+}
+
+void BinaryReader::load(const string& fname, vector<char>& data) {
+  ifstream in(fname.c_str(), ios::in | ios::binary);
+  require(in, "BinaryReader::load: Cannot open input file.");
+  in.seekg(0, ios::end);
+  size_t size = in.tellg();
+  in.seekg(0, ios::beg);
+  data.resize(size);
+  if (size>0) {
+    in.read(&data[0], size);
+  }
+  require(in, "BinaryReader::load: Failed to read input file.");
+}
+
+}
@@ -36,9 +36,30 @@ void Node::mark_deleted() {
   for (std::list<Factor*>::iterator factor = _factors.begin(); factor != _factors.end(); ++factor)
     (*factor)->mark_deleted();
 }
+void Node::remove_factor(Factor* e) {
+  // positions were recorded when the factor was added to this node
+  bool found = false;
+  for (unsigned int i=0; i<e->_node_positions.size(); i++) {
+    if (e->_nodes[i]==this && e->_node_positions[i]!=_factors.end()) {
+      _factors.erase(e->_node_positions[i]);
+      e->_node_positions[i] = _factors.end();
+      found = true;
+    }
+  }
+  if (!found) {
+    // factor was linked without Factor::initialize_internal()
+    _factors.remove(e);
+  }
+}
 void Node::erase_marked_factors() {
-  for (std::list<Factor*>::iterator factor = _factors.begin(); factor != _factors.end();)
-    if ((*factor)->deleted()) factor = _factors.erase(factor);
-    else ++factor;
+  for (std::list<Factor*>::iterator factor = _factors.begin(); factor != _factors.end();) {
+    if ((*factor)->deleted()) {
+      Factor* e = *factor;
+      for (unsigned int i=0; i<e->_node_positions.size(); i++) {
+        if (e->_node_positions[i]==factor) e->_node_positions[i] = _factors.end();
+      }
+      factor = _factors.erase(factor);
+    } else ++factor;
+  }
 }
 } // namespace - isam
@@ -26,10 +26,17 @@
  *
  */
 
+#include <queue>
+#include <algorithm>
+#include <cmath>
 #include <Eigen/Dense>
 
 #include "isam/Optimizer.h"
+#include "isam/Trace.h"
 #include "isam/OptimizationInterface.h"
+#include "isam/GraphFile.h"
+#include "isam/UpdateStats.h"
+#include "isam/util.h"
 
 using namespace std;
 using namespace Eigen;
@@ -39,6 +46,36 @@ namespace isam {
 /* Use Powell's Dog-Leg stopping criteria for all of the batch algorithms? */
 // #define USE_PDL_STOPPING_CRITERIA
 
+/* Check the dependencies and result of partial back-substitution? */
+// #define PARTIAL_SOLVE_DEBUG
+
+void Optimizer::apply_exmap(const VectorXd& delta, UpdateStats* stats) {
+  double t0 = tic();
+  function_system.apply_exmap(delta);
+  if (stats) {
+    stats->time_exmap += toc(t0);
+  }
+}
+
+int Optimizer::nnz_R() {
+  if (_nnz_R < 0) {
+    _nnz_R = function_system._R.nnz();
+  }
+  return _nnz_R;
+}
+
+size_t Optimizer::memory() const {
+  size_t bytes = (gradient.size() + last_accepted_hdl.size()
+      + _h_gn_ordered.size() + _h_gn.size())*sizeof(double)
+    + _col_rows.capacity()*sizeof(vector<int>)
+    + (_col_compacted.capacity() + _modified_rows.capacity())*sizeof(int)
+    + _queued.capacity();
+  for (unsigned int i = 0; i < _col_rows.size(); i++) {
+    bytes += _col_rows[i].capacity()*sizeof(int);
+  }
+  return bytes;
+}
+
 void Optimizer::permute_vector(const VectorXd& v, VectorXd& p,
     const int* permutation) {
   for (int i = 0; i < v.size(); i++) {
@@ -48,20 +85,287 @@ void Optimizer::permute_vector(const VectorXd& v, VectorXd& p,
 
 VectorXd Optimizer::compute_gauss_newton_step(const SparseSystem& jacobian,
     SparseSystem* R, double lambda) {
+  if (!_landmark_starts.empty()) {
+    return compute_gauss_newton_step_schur(jacobian, lambda);
+  }
   VectorXd delta_ordered;
-  _cholesky->factorize(jacobian, &delta_ordered, lambda);
-  if (R != NULL) {
+  _solver->factorize(jacobian, &delta_ordered, lambda);
+  // an iterative solver provides no factor
+  if (R != NULL && _solver == _cholesky) {
     _cholesky->get_R(*R);
+    _nnz_R = -1;
   }
 
   // delta has new ordering, need to return result with default ordering
   int nrows = delta_ordered.size();
   VectorXd delta(nrows);
-  permute_vector(delta_ordered, delta, _cholesky->get_order());
+  permute_vector(delta_ordered, delta, _solver->get_order());
+
+  return delta;
+}
+
+VectorXd Optimizer::compute_gauss_newton_step_schur(const SparseSystem& jacobian,
+    double lambda) {
+  int n = jacobian.num_cols();
+  int num_blocks = _landmark_starts.size();
+
+  // landmark of each variable (-1 for none), and index of each
+  // remaining variable in the reduced system
+  vector<int> col_block(n, -1);
+  for (int b=0; b<num_blocks; b++) {
+    for (int k=0; k<_landmark_dims[b]; k++) {
+      col_block[_landmark_starts[b]+k] = b;
+    }
+  }
+  vector<int> reduced_col(n, -1);
+  int n_reduced = 0;
+  for (int col=0; col<n; col++) {
+    if (col_block[col] < 0) {
+      reduced_col[col] = n_reduced++;
+    }
+  }
+
+  // measurement rows of each landmark, and rows not involving any
+  vector<vector<int> > block_rows(num_blocks);
+  vector<int> other_rows;
+  for (int row=0; row<jacobian.num_rows(); row++) {
+    int b = -1;
+    for (SparseVectorIter iter(jacobian.get_row(row)); iter.valid() && b<0; iter.next()) {
+      b = col_block[iter.get()];
+    }
+    if (b >= 0) {
+      block_rows[b].push_back(row);
+    } else {
+      other_rows.push_back(row);
+    }
+  }
+  for (int b=0; b<num_blocks; b++) {
+    require((int)block_rows[b].size() >= _landmark_dims[b],
+        "Optimizer::compute_gauss_newton_step_schur: landmark not sufficiently constrained");
+  }
+
+  // rows not involving any landmark are copied into the reduced system
+  vector<SparseVector*> reduced_rows;
+  vector<double> reduced_rhs;
+  for (unsigned int i=0; i<other_rows.size(); i++) {
+    const SparseVector& rowvec = jacobian.get_row(other_rows[i]);
+    SparseVector* reduced = new SparseVector(rowvec.nnz());
+    for (SparseVectorIter iter(rowvec); iter.valid(); iter.next()) {
+      double v;
+      int col = iter.get(v);
+      reduced->append(reduced_col[col], v);
+    }
+    reduced_rows.push_back(reduced);
+    reduced_rhs.push_back(jacobian.rhs()(other_rows[i]));
+  }
+
+  // QR factorization of [B A r] for each landmark, where B are the
+  // landmark columns and A the remaining variables seen with it:
+  // the first rows [R_l S_l z_l] are kept for back-substitution, the
+  // others [0 R_a r_a] become rows of the reduced system
+  vector<vector<int> > block_cols(num_blocks);
+  vector<MatrixXd> eliminated(num_blocks);
+  vector<MatrixXd> remaining(num_blocks);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int b=0; b<num_blocks; b++) {
+    const vector<int>& rows = block_rows[b];
+    vector<int>& cols = block_cols[b];
+    int start = _landmark_starts[b];
+    int d = _landmark_dims[b];
+    for (unsigned int i=0; i<rows.size(); i++) {
+      for (SparseVectorIter iter(jacobian.get_row(rows[i])); iter.valid(); iter.next()) {
+        int col = iter.get();
+        if (col_block[col] < 0) {
+          cols.push_back(col);
+        }
+      }
+    }
+    sort(cols.begin(), cols.end());
+    cols.erase(unique(cols.begin(), cols.end()), cols.end());
+    int k = cols.size();
+    int m = rows.size();
+    // damping of the landmark for Levenberg-Marquardt as extra rows
+    MatrixXd M = MatrixXd::Zero((lambda>0.) ? m+d : m, d+k+1);
+    for (int i=0; i<m; i++) {
+      for (SparseVectorIter iter(jacobian.get_row(rows[i])); iter.valid(); iter.next()) {
+        double v;
+        int col = iter.get(v);
+        if (col_block[col] == b) {
+          M(i, col-start) = v;
+        } else {
+          M(i, d + (lower_bound(cols.begin(), cols.end(), col) - cols.begin())) = v;
+        }
+      }
+      M(i, d+k) = jacobian.rhs()(rows[i]);
+    }
+    if (lambda > 0.) {
+      for (int j=0; j<d; j++) {
+        M(m+j, j) = sqrt(lambda * M.col(j).head(m).squaredNorm());
+      }
+    }
+    HouseholderQR<MatrixXd> qr(M);
+    int num = min((int)M.rows(), d+k+1);
+    MatrixXd R = qr.matrixQR().topRows(num).triangularView<Upper>();
+    eliminated[b] = R.topRows(d);
+    remaining[b] = R.block(d, d, num-d, k+1);
+  }
+
+  for (int b=0; b<num_blocks; b++) {
+    const MatrixXd& rem = remaining[b];
+    const vector<int>& cols = block_cols[b];
+    int k = cols.size();
+    for (int i=0; i<rem.rows(); i++) {
+      // rows are upper triangular, and the last ones might only
+      // contain a residual
+      int nnz = 0;
+      for (int j=i; j<k; j++) {
+        if (rem(i,j) != 0.) nnz++;
+      }
+      if (nnz == 0) continue;
+      SparseVector* reduced = new SparseVector(nnz);
+      for (int j=i; j<k; j++) {
+        if (rem(i,j) != 0.) {
+          reduced->append(reduced_col[cols[j]], rem(i,j));
+        }
+      }
+      reduced_rows.push_back(reduced);
+      reduced_rhs.push_back(rem(i,k));
+    }
+  }
+
+  // solve the reduced system
+  VectorXd delta(n);
+  _num_reduced = (n_reduced > 0) ? -1 : 0;
+  if (n_reduced > 0 && !reduced_rows.empty()) {
+    int num_rows = reduced_rows.size();
+    VectorXd rhs(num_rows);
+    for (int i=0; i<num_rows; i++) {
+      rhs(i) = reduced_rhs[i];
+    }
+    // rows are pulled into the system
+    SparseSystem system(num_rows, n_reduced, &reduced_rows[0], rhs);
+    VectorXd delta_ordered;
+    _solver->factorize(system, &delta_ordered, lambda);
+    _num_reduced = n_reduced;
+    VectorXd delta_reduced(n_reduced);
+    permute_vector(delta_ordered, delta_reduced, _solver->get_order());
+    for (int col=0; col<n; col++) {
+      if (reduced_col[col] >= 0) {
+        delta(col) = delta_reduced(reduced_col[col]);
+      }
+    }
+  }
+
+  // back-substitution for each landmark
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (int b=0; b<num_blocks; b++) {
+    const MatrixXd& E = eliminated[b];
+    const vector<int>& cols = block_cols[b];
+    int d = _landmark_dims[b];
+    int k = cols.size();
+    VectorXd x(k);
+    for (int j=0; j<k; j++) {
+      x(j) = delta(cols[j]);
+    }
+    VectorXd z = E.col(d+k) - E.block(0, d, d, k) * x;
+    delta.segment(_landmark_starts[b], d) = E.leftCols(d).triangularView<Upper>().solve(z);
+  }
+
+  // kept for get_R_schur()
+  _landmark_factors.swap(eliminated);
+  _landmark_cols.swap(block_cols);
 
   return delta;
 }
 
+bool Optimizer::get_R_schur(SparseSystem& R) {
+  if (_num_reduced < 0) {
+    return false;
+  }
+  int num_blocks = _landmark_starts.size();
+  int n_landmarks = 0;
+  for (int b=0; b<num_blocks; b++) {
+    n_landmarks += _landmark_dims[b];
+  }
+  int n_reduced = _num_reduced;
+  int n = n_landmarks + n_reduced;
+
+  // variable order: landmarks in block order, followed by the remaining
+  // variables in the order of the reduced factor
+  vector<int> a_to_r(n, -1);
+  for (int b=0, pos=0; b<num_blocks; b++) {
+    for (int k=0; k<_landmark_dims[b]; k++) {
+      a_to_r[_landmark_starts[b]+k] = pos++;
+    }
+  }
+  SparseSystem R_reduced(1, 1);
+  if (n_reduced > 0) {
+    _cholesky->get_R(R_reduced);
+    const int* reduced_a_to_r = R_reduced.a_to_r();
+    for (int col=0, reduced=0; col<n; col++) {
+      if (a_to_r[col] < 0) {
+        a_to_r[col] = n_landmarks + reduced_a_to_r[reduced++];
+      }
+    }
+  }
+  int* r_to_a = new int[n];
+  for (int col=0; col<n; col++) {
+    r_to_a[a_to_r[col]] = col;
+  }
+
+  SparseVector_p* rows = new SparseVector_p[n];
+  VectorXd rhs(n);
+  for (int b=0, row=0; b<num_blocks; b++) {
+    const MatrixXd& E = _landmark_factors[b];
+    const vector<int>& cols = _landmark_cols[b];
+    int d = _landmark_dims[b];
+    int k = cols.size();
+    // remaining variables are ordered after all landmarks
+    vector<pair<int, double> > entries;
+    for (int i=0; i<d; i++, row++) {
+      entries.clear();
+      for (int j=0; j<k; j++) {
+        if (E(i,d+j) != 0.) {
+          entries.push_back(make_pair(a_to_r[cols[j]], E(i,d+j)));
+        }
+      }
+      sort(entries.begin(), entries.end());
+      rows[row] = new SparseVector(d-i+entries.size());
+      for (int j=i; j<d; j++) {
+        if (j==i || E(i,j) != 0.) {
+          rows[row]->append(row+j-i, E(i,j));
+        }
+      }
+      for (unsigned int e=0; e<entries.size(); e++) {
+        rows[row]->append(entries[e].first, entries[e].second);
+      }
+      rhs(row) = E(i,d+k);
+    }
+  }
+  for (int row=0; row<n_reduced; row++) {
+    const SparseVector& rowvec = R_reduced.get_row(row);
+    SparseVector* shifted = new SparseVector(rowvec.nnz());
+    for (SparseVectorIter iter(rowvec); iter.valid(); iter.next()) {
+      double v;
+      int col = iter.get(v);
+      shifted->append(n_landmarks+col, v);
+    }
+    rows[n_landmarks+row] = shifted;
+    rhs(n_landmarks+row) = R_reduced.rhs()(row);
+  }
+  // rows are pulled into R
+  R.import_rows_ordered(n, n, rows, r_to_a);
+  R.set_rhs(rhs);
+  delete[] rows;
+  delete[] r_to_a;
+  _nnz_R = -1;
+  return true;
+}
+
 VectorXd Optimizer::compute_dog_leg(double alpha, const VectorXd& h_sd,
     const VectorXd& h_gn, double delta, double& gain_ratio_denominator) {
   if (h_gn.norm() <= delta) {
@@ -107,15 +411,27 @@ void Optimizer::update_trust_radius(double rho, double hdl_norm) {
   }
 }
 
-void Optimizer::relinearize(const Properties& prop) {
-  // We're going to relinearize about the current estimate.
-  function_system.estimate_to_linpoint();
-
-  // prepare factorization
-  SparseSystem jac = function_system.jacobian();
+void Optimizer::relinearize(const Properties& prop, UpdateStats* stats) {
+  ISAM_TRACE("Optimizer::relinearize");
+  _partial_valid = false;
+
+  // We're going to relinearize about the current estimate
+  // (possibly only for variables that changed significantly),
+  // and prepare factorization.
+  double t0 = tic();
+  SparseSystem jac = function_system.jacobian_relinearized(prop.relinearize_threshold);
+  if (stats) {
+    stats->time_jacobian += toc(t0);
+    t0 = tic();
+  }
 
   // factorization and new rhs based on new linearization point will be in _R
   VectorXd h_gn = compute_gauss_newton_step(jac, &function_system._R); // modifies _R
+  if (stats) {
+    stats->time_qr += toc(t0);
+    stats->num_rows_added += jac.num_rows();
+    stats->num_resolved += h_gn.size();
+  }
 
   if (prop.method == DOG_LEG) {
     // Compute the gradient and cache it.
@@ -124,6 +440,10 @@ void Optimizer::relinearize(const Properties& prop) {
     //Get the value of the sum-of-squared errors at the current linearization point.
     current_SSE_at_linpoint = jac.rhs().squaredNorm();
 
+    // Objective at the linearization point; differs from the above
+    // once a robust kernel reweights the residuals.
+    current_cost_at_linpoint = function_system.weighted_errors(LINPOINT).squaredNorm();
+
     // NB: alpha's denominator will be zero iff the gradient vector is zero
     // (since J is full-rank by hypothesis).  But the gradient is zero iff
     // we're already at the minimum, so we don't actually need to to any
@@ -139,7 +459,7 @@ void Optimizer::relinearize(const Properties& prop) {
       // These values will be used to update the estimate of Delta
       double F_0, F_h;
 
-      F_0 = current_SSE_at_linpoint;
+      F_0 = current_cost_at_linpoint;
 
       double rho_denominator, rho;
 
@@ -156,13 +476,16 @@ void Optimizer::relinearize(const Properties& prop) {
 
         // Update the estimate.
         // NOTE:  Here we use -h_dl because of the weird sign change in the exmap functions.
-        function_system.apply_exmap(-h_dl);
+        apply_exmap(-h_dl, stats);
 
         // Get the value of the sum-of-squared errors at the new estimate.
         F_h = function_system.weighted_errors(ESTIMATE).squaredNorm();
 
         // Compute gain ratio.
         rho = (F_0 - F_h) / (rho_denominator);
+        if (rho < 0 && stats) {
+          stats->step_rejected = true;
+        }
 
         update_trust_radius(rho, h_dl.norm());
       } while (rho < 0);
@@ -176,7 +499,7 @@ void Optimizer::relinearize(const Properties& prop) {
 
   } else {
     // For Gauss-Newton just apply the update directly.
-    function_system.apply_exmap(h_gn);
+    apply_exmap(h_gn, stats);
   }
 }
 
@@ -184,13 +507,16 @@ bool Optimizer::powells_dog_leg_update(double epsilon1, double epsilon3,
     SparseSystem& jacobian, VectorXd& f_x, VectorXd& grad) {
   jacobian = function_system.jacobian();
   f_x = function_system.weighted_errors(LINPOINT);
-  grad = mul_SparseMatrixTrans_Vector(jacobian, f_x);
+  // the residual of the (reweighted) Jacobian, not the robust cost f_x
+  grad = mul_SparseMatrixTrans_Vector(jacobian, jacobian.rhs());
   return (f_x.lpNorm<Eigen::Infinity>() <= epsilon3)
       || (grad.lpNorm<Eigen::Infinity>() <= epsilon1);
 }
 
 void Optimizer::augment_sparse_linear_system(SparseSystem& W,
-    const Properties& prop) {
+    double cost_new, const Properties& prop, UpdateStats* stats) {
+  ISAM_TRACE("Optimizer::augment_sparse_linear_system");
+  double t0 = tic();
   if (prop.method == DOG_LEG) {
     // We're using the incremental version of Powell's Dog-Leg, so we need
     // to form the updated gradient.
@@ -199,6 +525,7 @@ void Optimizer::augment_sparse_linear_system(SparseSystem& W,
     // Augment the running count for the sum-of-squared errors at the current
     // linearization point.
     current_SSE_at_linpoint += f_new.squaredNorm();
+    current_cost_at_linpoint += cost_new;
 
     // Allocate the new gradient vector
     VectorXd g_new(W.num_cols());
@@ -216,22 +543,311 @@ void Optimizer::augment_sparse_linear_system(SparseSystem& W,
   }
 
   // Apply Givens to QR factorize the newly augmented sparse system.
+  // Keep track of the modified rows for partial back-substitution.
+  vector<int>* modified_rows = NULL;
+  if (_partial_valid && prop.partial_solve_threshold > 0.) {
+    modified_rows = &_modified_rows;
+  }
+  int num_givens = 0;
+  int nnz_change = 0;
   for (int i = 0; i < W.num_rows(); i++) {
     SparseVector new_row = W.get_row(i);
-    function_system._R.add_row_givens(new_row, W.rhs()(i));
+    num_givens += function_system._R.add_row_givens(new_row, W.rhs()(i),
+        modified_rows, &nnz_change);
+  }
+  if (_nnz_R >= 0) {
+    _nnz_R += nnz_change;
+  }
+  if (stats) {
+    stats->time_qr += toc(t0);
+    stats->num_rows_added += W.num_rows();
+    stats->num_givens += num_givens;
+  }
+}
+
+bool Optimizer::marginalize(const vector<int>& cols) {
+  ISAM_TRACE("Optimizer::marginalize");
+  SparseSystem& R = function_system._R;
+  _partial_valid = false;
+  _nnz_R = -1;
+  int n = R.num_cols();
+  const int* r_to_a = R.r_to_a();
+
+  // new index of each remaining variable in both orderings, -1 if removed
+  vector<int> a_new(n, 0);
+  for (unsigned int i=0; i<cols.size(); i++) {
+    a_new[cols[i]] = -1;
+  }
+  int num_kept = 0;
+  for (int a=0; a<n; a++) {
+    if (a_new[a] >= 0) {
+      a_new[a] = num_kept++;
+    }
+  }
+  vector<int> r_new(n);
+  num_kept = 0;
+  for (int r=0; r<n; r++) {
+    r_new[r] = (a_new[r_to_a[r]] >= 0) ? num_kept++ : -1;
+  }
+
+  // rows with an entry in a marginalized column, and their columns
+  vector<char> affected(n, 0);
+  vector<char> used(n, 0);
+  for (int row=0; row<n; row++) {
+    const SparseVector& rowvec = R.get_row(row);
+    SparseVectorIter iter(rowvec);
+    for (; iter.valid() && r_new[iter.get()] >= 0; iter.next());
+    if (iter.valid()) {
+      affected[row] = 1;
+      for (SparseVectorIter it(rowvec); it.valid(); it.next()) {
+        used[it.get()] = 1;
+      }
+    }
+  }
+  // local ordering of these columns: marginalized variables first, R
+  // ordering otherwise
+  vector<int> local(n, -1);
+  vector<int> local_to_r;
+  for (int pass=0; pass<2; pass++) {
+    for (int r=0; r<n; r++) {
+      if (used[r] && (r_new[r] < 0) == (pass == 0)) {
+        local[r] = local_to_r.size();
+        local_to_r.push_back(r);
+      }
+    }
+  }
+  int num_marg = n - num_kept;
+  int num_local = local_to_r.size();
+
+  // triangulate the affected rows; the rows below the marginalized
+  // variables are the square root information of the remaining ones
+  SparseSystem L(num_local, num_local);
+  L.set_rhs(VectorXd::Zero(num_local));
+  for (int row=0; row<n; row++) {
+    if (!affected[row]) continue;
+    const SparseVector& rowvec = R.get_row(row);
+    SparseVector local_row(rowvec.nnz());
+    for (int pass=0; pass<2; pass++) {
+      for (SparseVectorIter iter(rowvec); iter.valid(); iter.next()) {
+        double v;
+        int col = iter.get(v);
+        if ((r_new[col] < 0) == (pass == 0)) {
+          local_row.append(local[col], v);
+        }
+      }
+    }
+    L.add_row_givens(local_row, R.rhs()(row));
+  }
+
+  // unaffected rows keep their place, affected ones leave a gap that is
+  // filled by merging the triangulated rows back in
+  SparseVector_p* rows = new SparseVector_p[num_kept];
+  int* order = new int[num_kept];
+  VectorXd rhs = VectorXd::Zero(num_kept);
+  for (int row=0; row<n; row++) {
+    int row_new = r_new[row];
+    if (row_new < 0) continue;
+    order[row_new] = a_new[r_to_a[row]];
+    if (affected[row]) {
+      rows[row_new] = new SparseVector();
+    } else {
+      const SparseVector& rowvec = R.get_row(row);
+      rows[row_new] = new SparseVector(rowvec.nnz());
+      for (SparseVectorIter iter(rowvec); iter.valid(); iter.next()) {
+        double v;
+        int col = iter.get(v);
+        rows[row_new]->append(r_new[col], v);
+      }
+      rhs(row_new) = R.rhs()(row);
+    }
+  }
+  vector<int> local_to_a(num_local);
+  for (int i=num_marg; i<num_local; i++) {
+    local_to_a[i] = order[r_new[local_to_r[i]]];
+  }
+  // rows are pulled into R
+  R.import_rows_ordered(num_kept, num_kept, rows, order);
+  R.set_rhs(rhs);
+  delete[] rows;
+  delete[] order;
+  for (int row=num_marg; row<num_local; row++) {
+    const SparseVector& rowvec = L.get_row(row);
+    if (rowvec.nnz() == 0) continue;
+    // add_row_givens() expects the node ordering
+    SparseVector new_row;
+    for (SparseVectorIter iter(rowvec); iter.valid(); iter.next()) {
+      double v;
+      int col = iter.get(v);
+      new_row.set(local_to_a[col], v);
+    }
+    R.add_row_givens(new_row, L.rhs()(row));
+  }
+
+  // a gap that was not filled leaves R singular
+  for (int row=0; row<num_kept; row++) {
+    if (R.get_row(row).first() != row) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Optimizer::start_partial_solve(const VectorXd& h_gn_ordered,
+    const VectorXd& h_gn) {
+  const SparseSystem& R = function_system._R;
+  int n = R.num_cols();
+  _h_gn_ordered = h_gn_ordered;
+  _h_gn = h_gn;
+  _col_rows.clear();
+  _col_rows.resize(n);
+  for (int row = 0; row < R.num_rows(); row++) {
+    for (SparseVectorIter iter(R.get_row(row)); iter.valid(); iter.next()) {
+      int col = iter.get();
+      if (col > row) {
+        _col_rows[col].push_back(row);
+      }
+    }
+  }
+  _col_compacted.resize(n);
+  for (int col = 0; col < n; col++) {
+    _col_compacted[col] = max((int)_col_rows[col].size(), 4);
   }
+  _modified_rows.clear();
+  _queued.assign(n, 0);
+  _partial_valid = true;
 }
 
-void Optimizer::update_estimate(const Properties& prop) {
+void Optimizer::partial_solve(double threshold, vector<int>& changed) {
+  const SparseSystem& R = function_system._R;
+  const int* r_to_a = R.r_to_a();
+  int n = R.num_cols();
+  int n_old = _h_gn.size();
+  if (n > n_old) {
+    // new variables are appended in both orderings
+    _h_gn_ordered.conservativeResize(n);
+    _h_gn_ordered.tail(n - n_old).setZero();
+    _h_gn.conservativeResize(n);
+    _h_gn.tail(n - n_old).setZero();
+    _col_rows.resize(n);
+    _col_compacted.resize(n, 4);
+    _queued.resize(n, 0);
+  }
+
+  // rows modified by Givens rotations might have new entries
+  priority_queue<int> pending;
+  for (unsigned int i = 0; i < _modified_rows.size(); i++) {
+    int row = _modified_rows[i];
+    if (_queued[row]) continue;
+    _queued[row] = 1;
+    pending.push(row);
+    // Givens rotations can add and drop entries (fill-in, cancellation),
+    // so all columns of the row are registered again; duplicates and
+    // stale rows only cost a visit during propagation, and lists that
+    // have grown to twice their size since the last cleanup are compacted
+    for (SparseVectorIter iter(R.get_row(row)); iter.valid(); iter.next()) {
+      int col = iter.get();
+      if (col > row) {
+        vector<int>& rows = _col_rows[col];
+        rows.push_back(row);
+        if ((int)rows.size() >= 2*_col_compacted[col]) {
+          sort(rows.begin(), rows.end());
+          rows.erase(unique(rows.begin(), rows.end()), rows.end());
+          _col_compacted[col] = max((int)rows.size(), 4);
+        }
+      }
+    }
+  }
+  _modified_rows.clear();
+
+  // back-substitution from the bottom, only visiting rows that depend
+  // on a modified row or a significantly changed variable
+  while (!pending.empty()) {
+    int row = pending.top();
+    pending.pop();
+    _queued[row] = 0;
+
+    SparseVectorIter iter(R.get_row(row));
+    double diag;
+    iter.get(diag);
+    iter.next();
+    double terms = R.rhs()(row);
+    for (; iter.valid(); iter.next()) {
+      double v;
+      int col = iter.get(v);
+      terms -= _h_gn_ordered(col) * v;
+    }
+    double value = terms / diag;
+    double change = fabs(value - _h_gn_ordered(row));
+    _h_gn_ordered(row) = value;
+    _h_gn(r_to_a[row]) = value;
+    changed.push_back(r_to_a[row]);
+
+    if (change > threshold) {
+      const vector<int>& rows = _col_rows[row];
+      for (unsigned int i = 0; i < rows.size(); i++) {
+        if (!_queued[rows[i]]) {
+          _queued[rows[i]] = 1;
+          pending.push(rows[i]);
+        }
+      }
+    }
+  }
+
+#ifdef PARTIAL_SOLVE_DEBUG
+  // every entry above the diagonal must be listed for its column
+  for (int row = 0; row < n; row++) {
+    for (SparseVectorIter iter(R.get_row(row)); iter.valid(); iter.next()) {
+      int col = iter.get();
+      if (col > row) {
+        const vector<int>& rows = _col_rows[col];
+        require(find(rows.begin(), rows.end(), row) != rows.end(),
+            "Optimizer::partial_solve: missing dependency");
+      }
+    }
+  }
+  // without propagation threshold the result equals a full solve
+  double diff = (R.solve() - _h_gn_ordered).lpNorm<Eigen::Infinity>();
+  cout << "[partial_solve]\tDifference to full solve: " << diff << endl;
+#endif
+}
+
+void Optimizer::update_estimate(const Properties& prop, UpdateStats* stats) {
+  ISAM_TRACE("Optimizer::update_estimate");
+  double t0 = tic();
+  if (prop.method == GAUSS_NEWTON && prop.partial_solve_threshold > 0.
+      && _partial_valid) {
+    vector<int> changed;
+    partial_solve(prop.partial_solve_threshold, changed);
+    if (stats) {
+      stats->time_solve += toc(t0);
+      stats->num_resolved += changed.size();
+      t0 = tic();
+    }
+    function_system.apply_exmap_partial(_h_gn, changed);
+    if (stats) {
+      stats->time_exmap += toc(t0);
+    }
+    return;
+  }
+  _partial_valid = false;
+  // time spent in exmap is subtracted from the solve time at the end
+  double time_exmap = stats ? stats->time_exmap : 0.;
+
   // Solve for the Gauss-Newton step.
   VectorXd h_gn_reordered = function_system._R.solve();
+  if (stats) {
+    stats->num_resolved += h_gn_reordered.size();
+  }
 
   // permute from R-ordering to J-ordering
   VectorXd h_gn(h_gn_reordered.size());
   permute_vector(h_gn_reordered, h_gn, function_system._R.r_to_a());
 
   if (prop.method == GAUSS_NEWTON) {
-    function_system.apply_exmap(h_gn);
+    apply_exmap(h_gn, stats);
+    if (prop.partial_solve_threshold > 0.) {
+      start_partial_solve(h_gn_reordered, h_gn);
+    }
   } else { //method == DOG_LEG
     // Compute alpha.  Note that since the variable ordering of the factor
     // R differs from that of the original Jacobian J,
@@ -251,10 +867,10 @@ void Optimizer::update_estimate(const Properties& prop) {
 
       VectorXd h_dl = compute_dog_leg(alpha, -gradient, -h_gn, Delta,
           rho_denominator);
-      function_system.apply_exmap(-h_dl);
+      apply_exmap(-h_dl, stats);
 
       // Compute the gain ratio
-      double rho = (current_SSE_at_linpoint
+      double rho = (current_cost_at_linpoint
           - function_system.weighted_errors(ESTIMATE).squaredNorm())
           / rho_denominator;
 
@@ -267,7 +883,10 @@ void Optimizer::update_estimate(const Properties& prop) {
         restore_step.head(last_accepted_hdl.size()) = last_accepted_hdl;
         restore_step.tail(gradient.size() - last_accepted_hdl.size()).setZero();
 
-        function_system.apply_exmap(-restore_step);
+        apply_exmap(-restore_step, stats);
+        if (stats) {
+          stats->step_rejected = true;
+        }
       } else {
         // The proposed update was accepted; cache the dog-leg step used
         // to produce it.
@@ -278,6 +897,9 @@ void Optimizer::update_estimate(const Properties& prop) {
     // NOTE:  The negatives prepended to "compute_dog_leg()" and "h_gn"
     // are due to the weird sign change in the exmap functions.
   }
+  if (stats) {
+    stats->time_solve += toc(t0) - (stats->time_exmap - time_exmap);
+  }
 }
 
 void Optimizer::gauss_newton(const Properties& prop, int* num_iterations) {
@@ -362,7 +984,10 @@ void Optimizer::gauss_newton(const Properties& prop, int* num_iterations) {
   if (num_iterations != NULL) {
     *num_iterations = num_iter;
   }
-  _cholesky->get_R(function_system._R);
+  if (_solver == _cholesky && _landmark_starts.empty()) {
+    _cholesky->get_R(function_system._R);
+    _nnz_R = -1;
+  }
 }
 
 void Optimizer::levenberg_marquardt(const Properties& prop,
@@ -464,7 +1089,8 @@ void Optimizer::levenberg_marquardt(const Properties& prop,
 }
 
 void Optimizer::powells_dog_leg(int* num_iterations, double delta0,
-    int max_iterations, double epsilon1, double epsilon2, double epsilon3) {
+    int max_iterations, double epsilon1, double epsilon2, double epsilon3,
+    bool quiet) {
   // Batch optimization
   int num_iter = 0;
   // current estimate is used as new linearization point
@@ -481,8 +1107,10 @@ void Optimizer::powells_dog_leg(int* num_iterations, double delta0,
 
   while ((not found) && (max_iterations == 0 || num_iter < max_iterations)) {
     num_iter++;
-    cout << "PDL Iteration " << num_iter << " residual: " << f_x.squaredNorm()
-        << endl;
+    if (!quiet) {
+      cout << "PDL Iteration " << num_iter << " residual: " << f_x.squaredNorm()
+          << endl;
+    }
     // compute alpha
     double alpha = grad.squaredNorm() / (jacobian * grad).squaredNorm();
     // steepest descent
@@ -506,12 +1134,12 @@ void Optimizer::powells_dog_leg(int* num_iterations, double delta0,
           / (rho_denominator);
       if (rho > 0) {
         // accept new estimate
-        cout << "accepted" << endl;
+        if (!quiet) cout << "accepted" << endl;
         f_x = f_x_new;
         found = powells_dog_leg_update(epsilon1, epsilon3, jacobian, f_x, grad);
       } else {
         // reject new estimate, overwrite with last saved one
-        cout << "rejected" << endl;
+        if (!quiet) cout << "rejected" << endl;
         function_system.estimate_to_linpoint();
       }
       if (rho > 0.75) {
@@ -533,22 +1161,73 @@ void Optimizer::powells_dog_leg(int* num_iterations, double delta0,
 }
 
 void Optimizer::batch_optimize(const Properties& prop, int* num_iterations) {
+  ISAM_TRACE("Optimizer::batch_optimize");
+  _partial_valid = false;
 
   const double delta0 = 1.0;
 
+  if (prop.eliminate_landmarks) {
+    function_system.landmark_blocks(_landmark_starts, _landmark_dims);
+  }
+  if (prop.linear_solver != CHOLESKY) {
+    _solver = Cholesky::Create(prop);
+  }
+
   switch (prop.method) {
   case GAUSS_NEWTON:
     gauss_newton(prop, num_iterations);
     break;
   case DOG_LEG:
     powells_dog_leg(num_iterations, delta0, prop.max_iterations, prop.epsilon1,
-        prop.epsilon2, prop.epsilon3); // modifies x0,R
+        prop.epsilon2, prop.epsilon3, prop.quiet); // modifies x0,R
     break;
   case LEVENBERG_MARQUARDT:
     levenberg_marquardt(prop, num_iterations);
     break;
   }
 
+  if (_solver != _cholesky) {
+    // R is not available, see Properties::linear_solver; a factor of an
+    // earlier estimate must not be used for covariances
+    function_system._R = SparseSystem(1, 1);
+    _nnz_R = -1;
+    delete _solver;
+    _solver = _cholesky;
+    _landmark_starts.clear();
+    _landmark_dims.clear();
+  } else if (!_landmark_starts.empty()) {
+    // only the reduced system was factored, but incremental updates and
+    // covariances need the factor of the full system, which is assembled
+    // from it and the landmark factors of the last step
+    bool assembled = get_R_schur(function_system._R);
+    _landmark_starts.clear();
+    _landmark_dims.clear();
+    if (!assembled) {
+      // variables without any measurement rows left
+      compute_gauss_newton_step(function_system.jacobian(), &function_system._R);
+    }
+  }
+  _landmark_factors.clear();
+  _landmark_cols.clear();
+
+}
+
+void Optimizer::save_state(BinaryWriter& out) const {
+  out.put<double>(Delta);
+  out.put<double>(current_SSE_at_linpoint);
+  out.put<double>(current_cost_at_linpoint);
+  out.put_vector(gradient);
+  out.put_vector(last_accepted_hdl);
+}
+
+void Optimizer::load_state(BinaryReader& in) {
+  _partial_valid = false;
+  _nnz_R = -1;
+  Delta = in.get<double>();
+  current_SSE_at_linpoint = in.get<double>();
+  current_cost_at_linpoint = in.get<double>();
+  gradient = in.get_vector();
+  last_accepted_hdl = in.get_vector();
 }
 
 }
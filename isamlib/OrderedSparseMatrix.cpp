@@ -131,6 +131,17 @@ void OrderedSparseMatrix::import_rows_ordered(int num_rows, int num_cols, Sparse
   _set_order(r_to_a);
 }
 
+size_t OrderedSparseMatrix::memory(size_t* unused) const {
+  size_t bytes = SparseMatrix::memory(unused)
+      + sizeof(OrderedSparseMatrix) - sizeof(SparseMatrix);
+  // both translation tables
+  bytes += 2*_max_num_cols*sizeof(int);
+  if (unused) {
+    *unused += 2*(_max_num_cols-_num_cols)*sizeof(int);
+  }
+  return bytes;
+}
+
 void OrderedSparseMatrix::append_new_cols(int num) {
   int orig_num_cols = _num_cols;
   int orig_max_num_cols = _max_num_cols;
@@ -28,15 +28,21 @@
 
 #include <iomanip>
 #include <vector>
+#include <algorithm>
 #include <map>
 #include <list>
 
 #include "isam/util.h"
+#include "isam/Trace.h"
 #include "isam/SparseSystem.h"
 #include "isam/OptimizationInterface.h"
 #include "isam/covariance.h"
+#include "isam/glc.h"
+#include "isam/slam2d.h"
+#include "isam/slam3d.h"
 
 #include "isam/Slam.h"
+#include "isam/GraphFile.h"
 
 using namespace std;
 using namespace Eigen;
@@ -59,18 +65,30 @@ struct DeleteOnReturn
 void Slam::update_starts() {
   int start = 0;
   const list<Node*>& nodes = get_nodes();
-  for (list<Node*>::const_iterator it = nodes.begin(); it!=nodes.end(); it++) {
+  _nodes_by_start.resize(nodes.size());
+  int i = 0;
+  for (list<Node*>::const_iterator it = nodes.begin(); it!=nodes.end(); it++, i++) {
     Node* node = *it;
     node->_start = start;
     start += node->dim();
+    _nodes_by_start[i] = node;
   }
 }
 
+// for finding the node that contains a variable
+struct StartLess {
+  bool operator()(int start, const Node* node) const {
+    return start < node->start();
+  }
+};
+
 Slam::Slam()
   : Graph(),
     _step(0), _prop(Properties()),
     _covariances(this),
-    _require_batch(true), _cost_func(NULL),
+    _require_batch(true), _robust_kernel(NULL), _cost_func_kernel(NULL),
+    _cached_factors(0),
+    _peak_R(0), _peak_jacobian(0),
     _dim_nodes(0), _dim_measure(0),
     _num_new_measurements(0), _num_new_rows(0),
     _opt(*this)
@@ -79,6 +97,24 @@ Slam::Slam()
 
 Slam::~Slam()
 {
+  delete _cost_func_kernel;
+  for (set<Factor*>::iterator it = _window_factors.begin(); it != _window_factors.end(); it++) {
+    delete *it;
+  }
+}
+
+void Slam::set_properties(Properties prop) {
+  if (prop.contiguous_state != _prop.contiguous_state) {
+    for (list<Node*>::iterator node = _nodes.begin(); node != _nodes.end(); node++) {
+      if (prop.contiguous_state) {
+        _state.attach(*node);
+      } else {
+        _state.detach(*node);
+      }
+    }
+  }
+  _prop = prop;
+  _cached_factors = 0;
 }
 
 void Slam::save(const string fname) const {
@@ -88,16 +124,156 @@ void Slam::save(const string fname) const {
   out.close();
 }
 
+void Slam::save_binary(const string fname) const {
+  require(_prop.window==0, "Slam::save_binary: sliding window not supported");
+  write_graph_file(fname, get_nodes(), get_factors());
+}
+
+void Slam::add_contents(const GraphFileContents& contents,
+    unsigned int first_node, unsigned int first_factor) {
+  for (unsigned int i=first_node; i<contents.nodes.size(); i++) {
+    add_node(contents.nodes[i]);
+  }
+  for (unsigned int i=first_factor; i<contents.factors.size(); i++) {
+    add_factor(contents.factors[i]);
+  }
+}
+
+void Slam::load_binary(const string fname, GraphFileContents& contents) {
+  unsigned int first_node = contents.nodes.size();
+  unsigned int first_factor = contents.factors.size();
+  read_graph_file(fname, contents);
+  add_contents(contents, first_node, first_factor);
+}
+
+const char CHECKPOINT_MAGIC[8] = {'i', 'S', 'A', 'M', 'c', 'k', 'p', 't'};
+const unsigned int CHECKPOINT_VERSION = 2;
+
+void Slam::save_checkpoint(const string fname) const {
+  require(_prop.window==0, "Slam::save_checkpoint: sliding window not supported");
+  BinaryWriter out;
+  out.put_array(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  out.put<unsigned int>(CHECKPOINT_VERSION);
+  write_graph(out, get_nodes(), get_factors());
+
+  out.put<int>(_step);
+  out.put<unsigned char>(_require_batch);
+  out.put<int>(_num_new_measurements);
+  out.put<int>(_num_new_rows);
+
+  // factor matrix with variable ordering and right hand side
+  int num_rows = _R.num_rows();
+  int num_cols = _R.num_cols();
+  out.put<int>(num_rows);
+  out.put<int>(num_cols);
+  out.put_array(_R.r_to_a(), num_cols);
+  vector<int> indices;
+  vector<double> values;
+  for (int row=0; row<num_rows; row++) {
+    const SparseVector& r = _R.get_row(row);
+    int nnz = r.nnz();
+    out.put<int>(nnz);
+    if (nnz>0) {
+      indices.resize(nnz);
+      values.resize(nnz);
+      r.copy_raw(&indices[0], &values[0]);
+      out.put_array(&indices[0], nnz);
+      out.put_array(&values[0], nnz);
+    }
+  }
+  out.put_vector(_R.rhs());
+
+  _opt.save_state(out);
+  out.save(fname);
+}
+
+void Slam::load_checkpoint(const string fname, GraphFileContents& contents) {
+  require(_nodes.empty() && _factors.empty(),
+      "Slam.load_checkpoint: graph has to be empty.");
+  vector<char> data;
+  BinaryReader::load(fname, data);
+  BinaryReader in(data.empty() ? NULL : &data[0], data.size());
+  for (unsigned int i=0; i<sizeof(CHECKPOINT_MAGIC); i++) {
+    require(in.get<char>()==CHECKPOINT_MAGIC[i], "Slam.load_checkpoint: not a checkpoint file.");
+  }
+  require(in.get<unsigned int>()==CHECKPOINT_VERSION,
+      "Slam.load_checkpoint: unsupported checkpoint version.");
+  unsigned int first_node = contents.nodes.size();
+  unsigned int first_factor = contents.factors.size();
+  read_graph(in, contents);
+  add_contents(contents, first_node, first_factor);
+
+  _step = in.get<int>();
+  _require_batch = in.get<unsigned char>();
+  _num_new_measurements = in.get<int>();
+  _num_new_rows = in.get<int>();
+  require(_num_new_measurements>=0 && _num_new_measurements<=num_factors()
+      && _num_new_rows>=0 && _num_new_rows<=_dim_measure,
+      "Slam.load_checkpoint: new measurements do not match graph.");
+
+  // the factor matrix has to belong to the restored graph; R is only
+  // used if no batch step is pending, otherwise it may be stale
+  int num_rows = in.get<int>();
+  int num_cols = in.get<int>();
+  require(num_cols>=0 && num_cols<=_dim_nodes && num_rows>=0 && num_rows<=num_cols,
+      "Slam.load_checkpoint: factor matrix does not match graph.");
+  require(_require_batch
+      || (num_rows==num_cols && num_rows<=_dim_measure-_num_new_rows),
+      "Slam.load_checkpoint: factor matrix does not match graph.");
+  vector<int> r_to_a(num_cols);
+  if (num_cols>0) {
+    in.get_array(&r_to_a[0], num_cols);
+  }
+  vector<char> seen(num_cols, 0);
+  for (int i=0; i<num_cols; i++) {
+    require(r_to_a[i]>=0 && r_to_a[i]<num_cols && !seen[r_to_a[i]],
+        "Slam.load_checkpoint: invalid variable ordering.");
+    seen[r_to_a[i]] = 1;
+  }
+  SparseVector_p* rows = new SparseVector_p[num_rows];
+  DeleteOnReturn rows_ptr(rows);
+  vector<int> indices;
+  vector<double> values;
+  for (int row=0; row<num_rows; row++) {
+    int nnz = in.get<int>();
+    require(nnz>=0 && nnz<=num_cols-row, "Slam.load_checkpoint: invalid factor matrix row.");
+    if (nnz>0) {
+      indices.resize(nnz);
+      values.resize(nnz);
+      in.get_array(&indices[0], nnz);
+      in.get_array(&values[0], nnz);
+      // upper triangular, sorted column indices
+      for (int i=0; i<nnz; i++) {
+        require(indices[i]>=(i==0 ? row : indices[i-1]+1) && indices[i]<num_cols,
+            "Slam.load_checkpoint: invalid factor matrix row.");
+      }
+      rows[row] = new SparseVector(&indices[0], &values[0], nnz);
+    } else {
+      rows[row] = new SparseVector();
+    }
+  }
+  _R.import_rows_ordered(num_rows, num_cols, rows, num_cols>0 ? &r_to_a[0] : NULL);
+  VectorXd rhs = in.get_vector();
+  require(rhs.size()==num_rows, "Slam.load_checkpoint: right hand side does not match factor matrix.");
+  _R.set_rhs(rhs);
+
+  _opt.load_state(in);
+  update_starts();
+}
+
 void Slam::add_node(Node* node) {
   Graph::add_node(node);
+  if (_prop.contiguous_state) {
+    _state.attach(node);
+  }
   _dim_nodes += node->dim();
 }
 
 void Slam::add_factor(Factor* factor) {
   // adds itself to factor lists of adjacent nodes; also initialized linked nodes if necessary
   factor->initialize_internal();
-  // needed to change cost function
-  factor->set_cost_function(&_cost_func);
+  // needed to change the robust kernel of all factors
+  factor->set_default_kernel(&_robust_kernel);
   Graph::add_factor(factor);
   _num_new_measurements++;
   _num_new_rows += factor->dim();
@@ -111,8 +287,11 @@ void Slam::remove_node(Node* node) {
     remove_factor(*factor);
   }
   _dim_nodes -= node->dim();
+  _state.detach(node);
   Graph::remove_node(node);
   _require_batch = true;
+  // columns of later nodes shift, even if the node had no factors
+  _cached_factors = 0;
 }
 
 void Slam::remove_factor(Factor* factor) {
@@ -123,42 +302,180 @@ void Slam::remove_factor(Factor* factor) {
   _dim_measure -= factor->dim();
   Graph::remove_factor(factor);
   _require_batch = true;
+  _cached_factors = 0;
+}
+
+bool Slam::factorization_current() const {
+  return !_require_batch && _num_new_measurements == 0
+    && _prop.method == GAUSS_NEWTON
+    && _R.num_cols() == _dim_nodes && _R.num_rows() == _dim_nodes;
+}
+
+void Slam::marginalize_nodes(const vector<Node*>& nodes,
+    const vector<Factor*>& factors, const vector<Factor*>& new_factors) {
+  bool incremental = factorization_current();
+  if (incremental) {
+    update_starts();
+    vector<int> cols;
+    for (unsigned int i=0; i<nodes.size(); i++) {
+      for (int j=0; j<nodes[i]->dim(); j++) {
+        cols.push_back(nodes[i]->_start + j);
+      }
+    }
+    incremental = _opt.marginalize(cols);
+  }
+  for (unsigned int i=0; i<nodes.size(); i++) {
+    remove_node(nodes[i]);
+  }
+  for (unsigned int i=0; i<factors.size(); i++) {
+    remove_factor(factors[i]);
+  }
+  for (unsigned int i=0; i<new_factors.size(); i++) {
+    add_factor(new_factors[i]);
+  }
+  if (incremental) {
+    // R already holds the information of the new factors
+    _require_batch = false;
+    _num_new_measurements = 0;
+    _num_new_rows = 0;
+  } else {
+    _require_batch = true;
+  }
 }
 
-void Slam::incremental_update()
+void Slam::release_marginalized(list<Node*>& nodes, list<Factor*>& factors) {
+  nodes.splice(nodes.end(), _marginalized_nodes);
+  factors.splice(factors.end(), _marginalized_factors);
+}
+
+namespace {
+
+bool is_pose(const Node* node) {
+  return dynamic_cast<const Pose2d_Node*>(node) || dynamic_cast<const Pose3d_Node*>(node);
+}
+
+}
+
+void Slam::marginalize_window(UpdateStats& stats) {
+  // nodes are kept in the order they were added
+  int num_poses = 0;
+  for (list<Node*>::const_iterator it = _nodes.begin(); it!=_nodes.end(); it++) {
+    if (is_pose(*it)) num_poses++;
+  }
+  if (num_poses <= _prop.window) {
+    return;
+  }
+  ISAM_TRACE("Slam::marginalize_window");
+  double t0 = tic();
+  // GLC linearizes at the linearization point, as does R. If R cannot be
+  // updated incrementally, the next update is a batch step anyway, and
+  // the GLC factors are better linearized at the current estimate
+  if (!factorization_current()) {
+    estimate_to_linpoint();
+  }
+  // the oldest poses, and the older landmarks (any other nodes) that are
+  // not observed from the remaining poses; GLC factors of earlier
+  // marginalizations are no observations, otherwise a landmark would
+  // stay forever
+  set<Node*> old_poses;
+  list<Node*>::const_iterator first_kept = _nodes.begin();
+  for (int n = num_poses; n > _prop.window; first_kept++) {
+    if (is_pose(*first_kept)) {
+      old_poses.insert(*first_kept);
+      n--;
+    }
+  }
+  while (first_kept!=_nodes.end() && !is_pose(*first_kept)) first_kept++;
+  vector<Node*> nodes;
+  for (list<Node*>::const_iterator it = _nodes.begin(); it!=first_kept; it++) {
+    bool observed = false;
+    if (!is_pose(*it)) {
+      const list<Factor*>& factors = (*it)->factors();
+      for (list<Factor*>::const_iterator f = factors.begin(); f!=factors.end() && !observed; f++) {
+        if (_window_factors.count(*f)) continue;
+        const vector<Node*>& adjacent = (*f)->nodes();
+        for (unsigned int k=0; k<adjacent.size() && !observed; k++) {
+          observed = is_pose(adjacent[k]) && old_poses.count(adjacent[k])==0;
+        }
+      }
+    }
+    if (!observed) nodes.push_back(*it);
+  }
+  GLC_RootShift root_shift;
+  vector<Factor*> removed;
+  vector<Factor*> added = glc_remove_nodes(*this, nodes, _prop.window_sparse,
+                                           &root_shift, &removed);
+  _marginalized_nodes.insert(_marginalized_nodes.end(), nodes.begin(), nodes.end());
+  for (unsigned int i=0; i<removed.size(); i++) {
+    set<Factor*>::iterator own = _window_factors.find(removed[i]);
+    if (own != _window_factors.end()) {
+      _window_factors.erase(own);
+      delete removed[i];
+    } else {
+      _marginalized_factors.push_back(removed[i]);
+    }
+  }
+  _window_factors.insert(added.begin(), added.end());
+  stats.num_marginalized = nodes.size();
+  stats.time_marginalize = toc(t0);
+}
+
+void Slam::incremental_update(UpdateStats* stats)
 {
   // incremental update not possible after removing nodes or factors
   // (might change in the future)
   if (_require_batch)
   {
-    batch_optimization_step();
+    batch_optimization_step(stats);
+    if (stats) {
+      stats->batch = true;
+    }
   }
   else if (_num_new_measurements > 0)
   {
+    double t0 = tic();
     SparseSystem jac_new = jacobian_partial(_num_new_measurements);
+    if (stats) {
+      stats->time_jacobian += toc(t0);
+    }
+
+    // robust cost of the new measurements for the dog-leg gain ratio
+    double cost_new = 0.;
+    if (_prop.method == DOG_LEG) {
+      const list<Factor*>& factors = get_factors();
+      int n = 0;
+      for (list<Factor*>::const_reverse_iterator it = factors.rbegin();
+          it!=factors.rend() && n<_num_new_measurements;
+          it++, n++) {
+        cost_new += (*it)->error(LINPOINT).squaredNorm();
+      }
+    }
 
-    _opt.augment_sparse_linear_system(jac_new, _prop);
+    _opt.augment_sparse_linear_system(jac_new, cost_new, _prop, stats);
 
     _num_new_measurements = 0;
     _num_new_rows = 0;
   }
 }
 
-void Slam::batch_optimization_step()
+void Slam::batch_optimization_step(UpdateStats* stats)
 {
   _require_batch = false;
   // update linearization point x0 with current estimate x
   _num_new_measurements = 0;
   _num_new_rows = 0;
 
-  _opt.relinearize(_prop);
+  // fill-in is largest just before R is recalculated
+  _peak_R = max(_peak_R, _R.memory());
+
+  _opt.relinearize(_prop, stats);
 }
 
 UpdateStats Slam::update()
 {
+  ISAM_TRACE("Slam::update");
   UpdateStats stats;
-  stats.batch = false;
-  stats.solve = false;
+  stats.nnz_before = _opt.nnz_R();
   if (_step%_prop.mod_update == 0)
   {
     if (_step%_prop.mod_batch == 0)
@@ -169,7 +486,7 @@ UpdateStats Slam::update()
         cout << endl;
         cout << "step " << _step;
       }
-      batch_optimization_step();
+      batch_optimization_step(&stats);
       stats.batch = true;
     }
     else
@@ -180,23 +497,28 @@ UpdateStats Slam::update()
         cout << ".";
         fflush(stdout);
       }
-      incremental_update();
+      incremental_update(&stats);
       if (_step%_prop.mod_solve == 0)
       {
         stats.solve = true;
 
-        _opt.update_estimate(_prop);
+        _opt.update_estimate(_prop, &stats);
       }
     }
   }
+  if (_prop.window > 0) {
+    marginalize_window(stats);
+  }
   _step++;
   stats.step = _step;
+  stats.nnz_after = _opt.nnz_R();
 
   return stats;
 }
 
 int Slam::batch_optimization()
 {
+  ISAM_TRACE("Slam::batch_optimization");
   int num_iterations = 0;
 
   int variables_deleted;
@@ -204,13 +526,30 @@ int Slam::batch_optimization()
   erase_marked(variables_deleted, measurements_deleted);
   _dim_nodes -= variables_deleted;
   _dim_measure -= measurements_deleted;
+  _cached_factors = 0;
 
   _opt.batch_optimize(_prop, &num_iterations);
+  if (_prop.linear_solver != CHOLESKY) {
+    // R was not computed
+    _require_batch = true;
+  }
   return num_iterations;
 }
 
+void Slam::set_robust_kernel(const RobustKernel* kernel) {
+  _robust_kernel = kernel;
+  _cached_factors = 0;
+}
+
+void Slam::set_robust_kernel(Factor* factor, const RobustKernel* kernel) {
+  factor->set_robust_kernel(kernel);
+  _cached_factors = 0;
+}
+
 void Slam::set_cost_function(cost_func_t func) {
-  _cost_func = func;
+  delete _cost_func_kernel;
+  _cost_func_kernel = func ? new CostFunctionKernel(func) : NULL;
+  set_robust_kernel(_cost_func_kernel);
 }
 
 void Slam::apply_exmap(const Eigen::VectorXd& x) {
@@ -223,7 +562,23 @@ void Slam::apply_exmap(const Eigen::VectorXd& x) {
   }
 }
 
+void Slam::apply_exmap_partial(const Eigen::VectorXd& x, const vector<int>& variables) {
+  vector<Node*> nodes(variables.size());
+  for (unsigned int i=0; i<variables.size(); i++) {
+    vector<Node*>::const_iterator it =
+      upper_bound(_nodes_by_start.begin(), _nodes_by_start.end(), variables[i], StartLess());
+    nodes[i] = *(--it);
+  }
+  sort(nodes.begin(), nodes.end());
+  nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+  for (unsigned int i=0; i<nodes.size(); i++) {
+    Node* node = nodes[i];
+    node->apply_exmap(x.segment(node->start(), node->dim()));
+  }
+}
+
 void Slam::self_exmap(const Eigen::VectorXd& x) {
+  _cached_factors = 0;
   int pos = 0;
   for (list<Node*>::iterator node = _nodes.begin(); node != _nodes.end(); node++) {
     int dim = (*node)->dim();
@@ -234,23 +589,141 @@ void Slam::self_exmap(const Eigen::VectorXd& x) {
 }
 
 void Slam::linpoint_to_estimate() {
+  if (state_complete()) {
+    _state.linpoint_to_estimate();
+    return;
+  }
   for (list<Node*>::iterator node = _nodes.begin(); node!=_nodes.end(); node++) {
     (*node)->linpoint_to_estimate();
   }
 }
 
 void Slam::estimate_to_linpoint() {
+  _cached_factors = 0;
+  if (state_complete()) {
+    _state.estimate_to_linpoint();
+    return;
+  }
   for (list<Node*>::iterator node = _nodes.begin(); node!=_nodes.end(); node++) {
     (*node)->estimate_to_linpoint();
   }
 }
 
 void Slam::swap_estimates() {
+  _cached_factors = 0;
+  if (state_complete()) {
+    _state.swap_estimates();
+    return;
+  }
   for (list<Node*>::iterator node = _nodes.begin(); node!=_nodes.end(); node++) {
     (*node)->swap_estimates();
   }
 }
 
+SparseSystem Slam::jacobian_relinearized(double threshold) {
+  ISAM_TRACE("Slam::jacobian_relinearized");
+  if (threshold <= 0. || _prop.force_numerical_jacobian) {
+    estimate_to_linpoint();
+    return jacobian();
+  }
+  update_starts();
+
+  // move the linearization point of nodes that changed significantly,
+  // marked by their start index
+  vector<char> moved(_dim_nodes, 0);
+  for (list<Node*>::iterator it = _nodes.begin(); it!=_nodes.end(); it++) {
+    Node* node = *it;
+    VectorXd diff = node->vector(ESTIMATE) - node->vector(LINPOINT);
+    VectorXb is_angle = node->is_angle();
+    for (int k=0; k<diff.size(); k++) {
+      if (is_angle(k)) {
+        diff(k) = standardRad(diff(k));
+      }
+    }
+    if (diff.size()>0 && diff.lpNorm<Eigen::Infinity>() > threshold) {
+      node->estimate_to_linpoint();
+      moved[node->_start] = 1;
+    }
+  }
+
+  // relinearize new factors and factors adjacent to moved nodes, copy
+  // all others from the cache
+  DeleteOnReturn rows_ptr(new SparseVector*[_dim_measure]);
+  SparseVector** rows = rows_ptr._ptr; //[_dim_measure];
+  VectorXd rhs(_dim_measure);
+  _cached_rows.resize(_dim_measure);
+  _cached_rhs.conservativeResize(_dim_measure);
+  int row = 0;
+  unsigned int i = 0;
+  for (list<Factor*>::const_iterator it=_factors.begin(); it!=_factors.end(); it++, i++) {
+    Factor* factor = *it;
+    bool reuse = (i < _cached_factors);
+    const vector<Node*>& nodes = factor->nodes();
+    for (unsigned int k=0; reuse && k<nodes.size(); k++) {
+      reuse = !moved[nodes[k]->_start];
+    }
+    if (!reuse) {
+      Jacobian jac = factor->jacobian_internal(false);
+      VectorXd jac_rhs = jac.rhs();
+      for (int r=0; r<jac_rhs.rows(); r++) {
+        _cached_rhs(row+r) = jac_rhs(r);
+        _cached_rows[row+r] = SparseVector(jac.dimtotal());
+      }
+      for (Terms::const_iterator it=jac.terms().begin(); it!=jac.terms().end(); it++) {
+        int offset = it->node()->_start;
+        int nr = it->term().rows();
+        for (int r=0; r<nr; r++) { // 0-entries not omitted
+          _cached_rows[row+r].set(offset, it->term().row(r));
+        }
+      }
+    }
+    for (int r=0; r<factor->dim(); r++) {
+      rhs(row+r) = _cached_rhs(row+r);
+      // do not delete, will be pulled into SparseSystem below
+      rows[row+r] = new SparseVector(_cached_rows[row+r]);
+    }
+    row += factor->dim();
+  }
+  _cached_factors = i;
+  SparseSystem jac(_dim_measure, _dim_nodes, rows, rhs);
+  update_peak_jacobian(jac);
+  return jac;
+}
+
+void Slam::landmark_blocks(vector<int>& starts, vector<int>& dims) {
+  update_starts();
+  starts.clear();
+  dims.clear();
+  // a landmark sharing a factor with an earlier one is kept in the
+  // reduced system, as is one with fewer measurement rows than
+  // dimensions (such as a monocular point seen once), which could not
+  // be eliminated on its own; eliminated nodes are marked by their
+  // start index
+  vector<char> eliminated(_dim_nodes, 0);
+  for (list<Node*>::iterator it = _nodes.begin(); it!=_nodes.end(); it++) {
+    Node* node = *it;
+    if (!node->landmark()) continue;
+    bool independent = true;
+    int num_rows = 0;
+    const list<Factor*>& factors = node->factors();
+    for (list<Factor*>::const_iterator f = factors.begin(); independent && f!=factors.end(); f++) {
+      num_rows += (*f)->dim();
+      const vector<Node*>& nodes = (*f)->nodes();
+      for (unsigned int k=0; k<nodes.size(); k++) {
+        if (eliminated[nodes[k]->_start]) {
+          independent = false;
+          break;
+        }
+      }
+    }
+    if (independent && num_rows >= node->dim()) {
+      eliminated[node->_start] = 1;
+      starts.push_back(node->_start);
+      dims.push_back(node->dim());
+    }
+  }
+}
+
 VectorXd Slam::weighted_errors(Selector s) {
   VectorXd werrors(_dim_measure);
   const list<Factor*>& factors = get_factors();
@@ -302,10 +775,17 @@ SparseSystem Slam::jacobian_numerical_columnwise() {
   SparseVector** rows = rows_ptr._ptr; //[num_rows];
   int pos = 0;
   vector<int> factor_offset(get_factors().size());
+  // robust kernels: rhs and rows of each factor are reweighted together
+  VectorXd rhs(num_rows);
+  VectorXd row_weight(num_rows);
   for (list<Factor*>::const_iterator it = get_factors().begin();
       it!=get_factors().end();
       it++) {
     (*it)->_start = pos;
+    VectorXd err = (*it)->evaluate();
+    double sw = (*it)->sqrt_weight(err);
+    rhs.segment(pos, err.size()) = sw * err;
+    row_weight.segment(pos, err.size()).setConstant(sw);
     int dimtotal = 0;
     for (vector<Node*>::const_iterator it2 = (*it)->nodes().begin();
         it2!=(*it)->nodes().end();
@@ -366,17 +846,19 @@ SparseSystem Slam::jacobian_numerical_columnwise() {
         for (int r=0; r<(*it_factor)->dim(); r++, row++) {
           if (diff(row)!=0.) { // omit 0 entries
             int offset = (*it_factor)->_start;
-            rows[offset+r]->append(col, diff(row)); // faster than SparseVector.set
+            rows[offset+r]->append(col, row_weight(offset+r) * diff(row)); // faster than SparseVector.set
           }
         }
       }
     }
   }
-  VectorXd rhs = weighted_errors(LINPOINT);
-  return SparseSystem(num_rows, _dim_nodes, rows, rhs);
+  SparseSystem jac(num_rows, _dim_nodes, rows, rhs);
+  update_peak_jacobian(jac);
+  return jac;
 }
 
 SparseSystem Slam::jacobian() {
+  ISAM_TRACE("Slam::jacobian");
   if (_prop.force_numerical_jacobian) {
     // column-wise is more efficient, especially if some nodes are
     // connected to many factors
@@ -393,6 +875,7 @@ const Covariances& Slam::covariances() {
 }
 
 SparseSystem Slam::jacobian_partial(int last_n) {
+  ISAM_TRACE("Slam::jacobian_partial");
   update_starts();
   // actual assembly of Jacobian
   int num_rows = _dim_measure;
@@ -428,7 +911,34 @@ SparseSystem Slam::jacobian_partial(int last_n) {
     }
     row += factor->dim();
   }
-  return SparseSystem(num_rows, _dim_nodes, rows, rhs);
+  SparseSystem jac(num_rows, _dim_nodes, rows, rhs);
+  update_peak_jacobian(jac);
+  return jac;
+}
+
+void Slam::update_peak_jacobian(const SparseSystem& jac) {
+  _peak_jacobian = max(_peak_jacobian, jac.memory());
+}
+
+MemoryStats Slam::memory_stats() {
+  MemoryStats stats;
+  stats.R = _R.memory(&stats.R_unused);
+  stats.jacobian_cache = _cached_rows.capacity()*sizeof(SparseVector)
+    + _cached_rhs.size()*sizeof(double);
+  for (unsigned int i=0; i<_cached_rows.size(); i++) {
+    stats.jacobian_cache += _cached_rows[i].memory() - sizeof(SparseVector);
+  }
+  stats.covariances = _covariances.memory();
+  stats.optimizer = _opt.memory();
+  for (list<Node*>::const_iterator it = _nodes.begin(); it!=_nodes.end(); it++) {
+    stats.node_values += (*it)->value_memory();
+  }
+  stats.arena = _arena.reserved();
+  stats.state = _state.memory();
+  _peak_R = max(_peak_R, stats.R);
+  stats.R_peak = _peak_R;
+  stats.jacobian_peak = _peak_jacobian;
+  return stats;
 }
 
 void Slam::print_stats() {
@@ -448,6 +958,18 @@ void Slam::print_stats() {
   cout << "    max per column: " << max_per_col << endl;
   cout << "    avg per column: " << per_col << endl;
   cout << "    fill in: " << fill_in << "%" << endl;
+  MemoryStats memory = memory_stats();
+  const double MB = 1024.*1024.;
+  cout << "  Memory [MB]: " << memory.total()/MB << endl;
+  cout << "    factor R: " << memory.R/MB
+       << " (unused " << memory.R_unused/MB << ", peak " << memory.R_peak/MB << ")" << endl;
+  cout << "    largest Jacobian: " << memory.jacobian_peak/MB << endl;
+  cout << "    Jacobian cache: " << memory.jacobian_cache/MB << endl;
+  cout << "    covariance cache: " << memory.covariances/MB << endl;
+  cout << "    optimizer: " << memory.optimizer/MB << endl;
+  cout << "    node values: " << memory.node_values/MB << endl;
+  cout << "    arena: " << memory.arena/MB << endl;
+  cout << "    state buffer: " << memory.state/MB << endl;
 }
 
 }
@@ -152,6 +152,20 @@ int SparseMatrix::nnz() const {
   return nnz;
 }
 
+size_t SparseMatrix::memory(size_t* unused) const {
+  size_t bytes = sizeof(SparseMatrix) + _max_num_rows*sizeof(SparseVector_p);
+  size_t free = (_max_num_rows-_num_rows)*sizeof(SparseVector_p);
+  for (int row=0; row<_num_rows; row++) {
+    const SparseVector& r = *_rows[row];
+    bytes += r.memory();
+    free += (r.capacity()-r.nnz())*(sizeof(int)+sizeof(double));
+  }
+  if (unused) {
+    *unused = free;
+  }
+  return bytes;
+}
+
 int SparseMatrix::max_nz() const {
   int max_nz = 0;
   for (int row=0; row<_num_rows; row++) {
@@ -298,6 +312,43 @@ void SparseMatrix::remove_row() {
   _num_rows--;
 }
 
+// Kernels for runs of entries in apply_givens(), written as Eigen array
+// expressions so that they are vectorized (SSE2, or AVX etc. depending
+// on compiler flags) with the same results as the scalar code.
+
+// rotates entries present in both rows
+inline void rotate_run(const double* top, const double* bot, int num,
+    double c, double s, double* new_top, double* new_bot) {
+  Map<const ArrayXd> t(top, num);
+  Map<const ArrayXd> b(bot, num);
+  Map<ArrayXd>(new_top, num) = c*t - s*b;
+  Map<ArrayXd>(new_bot, num) = s*t + c*b;
+}
+
+// rotates entries present in only one row (the other one being 0)
+inline void scale_run(const double* vals, int num,
+    double f_top, double f_bot, double* new_top, double* new_bot) {
+  Map<const ArrayXd> v(vals, num);
+  Map<ArrayXd>(new_top, num) = f_top*v;
+  Map<ArrayXd>(new_bot, num) = f_bot*v;
+}
+
+// removes numerically zero values to keep sparsity, returns new length
+inline int compact_run(int* indices, double* vals, int num) {
+  if ((Map<ArrayXd>(vals, num).abs() >= NUMERICAL_ZERO).all()) {
+    return num;
+  }
+  int k = 0;
+  for (int i=0; i<num; i++) {
+    if (fabs(vals[i]) >= NUMERICAL_ZERO) {
+      indices[k] = indices[i];
+      vals[k] = vals[i];
+      k++;
+    }
+  }
+  return k;
+}
+
 void SparseMatrix::apply_givens(int row, int col, double* c_givens, double* s_givens) {
   requireDebug(row>=0 && row<_num_rows && col>=0 && col<_num_cols, "SparseMatrix::apply_givens: index outside matrix.");
   requireDebug(row>col, "SparseMatrix::apply_givens: can only zero entries below the diagonal.");
@@ -314,51 +365,54 @@ void SparseMatrix::apply_givens(int row, int col, double* c_givens, double* s_gi
 
   SparseVector_p new_row_top = new SparseVector(n);
   SparseVector_p new_row_bot = new SparseVector(n);
-  SparseVectorIter iter_top(row_top);
-  SparseVectorIter iter_bot(row_bot);
-  bool top_valid = iter_top.valid();
-  bool bot_valid = iter_bot.valid();
-  while (top_valid || bot_valid) {
-    double val_top = 0.;
-    double val_bot = 0.;
-    int idx_top = (top_valid)?iter_top.get(val_top):-1;
-    int idx_bot = (bot_valid)?iter_bot.get(val_bot):-1;
-    int idx;
-    if (idx_bot<0) {
-      idx = idx_top;
-    } else if (idx_top<0) {
-      idx = idx_bot;
+
+  const int* idx_top = row_top._indices;
+  const double* val_top = row_top._values;
+  const int* idx_bot = row_bot._indices;
+  const double* val_bot = row_bot._values;
+  int nnz_top = row_top._nnz;
+  int nnz_bot = row_bot._nnz;
+  int* new_idx_top = new_row_top->_indices;
+  double* new_val_top = new_row_top->_values;
+  int* new_idx_bot = new_row_bot->_indices;
+  double* new_val_bot = new_row_bot->_values;
+
+  // merge both rows run by run: entries only in the top row, only in
+  // the bottom row, or in both (common after fill-in)
+  int i_top = 0;
+  int i_bot = 0;
+  int n_top = 0;
+  int n_bot = 0;
+  while (i_top<nnz_top || i_bot<nnz_bot) {
+    int num = 1;
+    if (i_bot==nnz_bot || (i_top<nnz_top && idx_top[i_top]<idx_bot[i_bot])) {
+      int end = (i_bot<nnz_bot) ? idx_bot[i_bot] : _num_cols;
+      while (i_top+num<nnz_top && idx_top[i_top+num]<end) num++;
+      scale_run(val_top+i_top, num, c, s, new_val_top+n_top, new_val_bot+n_bot);
+      memcpy(new_idx_top+n_top, idx_top+i_top, num*sizeof(int));
+      memcpy(new_idx_bot+n_bot, idx_top+i_top, num*sizeof(int));
+      i_top += num;
+    } else if (i_top==nnz_top || idx_bot[i_bot]<idx_top[i_top]) {
+      int end = (i_top<nnz_top) ? idx_top[i_top] : _num_cols;
+      while (i_bot+num<nnz_bot && idx_bot[i_bot+num]<end) num++;
+      scale_run(val_bot+i_bot, num, -s, c, new_val_top+n_top, new_val_bot+n_bot);
+      memcpy(new_idx_top+n_top, idx_bot+i_bot, num*sizeof(int));
+      memcpy(new_idx_bot+n_bot, idx_bot+i_bot, num*sizeof(int));
+      i_bot += num;
     } else {
-      idx = min(idx_top, idx_bot);
-    }
-    if (top_valid) {
-      if (idx==idx_top) {
-        iter_top.next();
-      } else {
-        val_top = 0.;
-      }
-    }
-    if (bot_valid) {
-      if (idx==idx_bot) {
-        iter_bot.next();
-      } else {
-        val_bot = 0.;
-      }
-    }
-    double new_val_top = c*val_top - s*val_bot;
-    double new_val_bot = s*val_top + c*val_bot;
-    // remove numerically zero values to keep sparsity
-    if (fabs(new_val_top) >= NUMERICAL_ZERO) {
-      // append for O(1) operation - even O(log n) is too
-      // slow here, because this is called extremely often!
-      new_row_top->append(idx, new_val_top);
+      while (i_top+num<nnz_top && i_bot+num<nnz_bot
+          && idx_top[i_top+num]==idx_bot[i_bot+num]) num++;
+      rotate_run(val_top+i_top, val_bot+i_bot, num, c, s, new_val_top+n_top, new_val_bot+n_bot);
+      memcpy(new_idx_top+n_top, idx_top+i_top, num*sizeof(int));
+      memcpy(new_idx_bot+n_bot, idx_top+i_top, num*sizeof(int));
+      i_top += num;
+      i_bot += num;
     }
-    if (fabs(new_val_bot) >= NUMERICAL_ZERO) {
-      new_row_bot->append(idx, new_val_bot);
-    }
-    top_valid = iter_top.valid();
-    bot_valid = iter_bot.valid();
+    n_top += compact_run(new_idx_top+n_top, new_val_top+n_top, num);
+    n_bot += compact_run(new_idx_bot+n_bot, new_val_bot+n_bot, num);
   }
+  new_row_top->_nnz = n_top;
+  new_row_bot->_nnz = n_bot;
 
   delete _rows[col];
   delete _rows[row];
@@ -431,5 +485,31 @@ MatrixXd matrix_of_sparseMatrix(const SparseMatrix& s) {
   return m;
 }
 
+void csc_transp_of_sparseMatrix(const SparseMatrix& A, int* p, int* i, double* x) {
+  int n = 0;
+  *p = n;
+  for (int row=0; row<A.num_rows(); row++) {
+    const SparseVector& r = A.get_row(row);
+    int nnz = r.nnz();
+    // easy: CSparse and SparseVector indices are both 0-based
+    r.copy_raw(i, x);
+    i += nnz;
+    x += nnz;
+    n += nnz;
+    p++;
+    *p = n;
+  }
+}
+
+void rows_of_csc_transp(int num_rows, int* p, int* i, double* x, SparseVector_p* rows) {
+  for (int row = 0; row < num_rows; row++) {
+    int nnz = *(p+1) - *p;
+    rows[row] = new SparseVector(i, x, nnz);
+    i += nnz;
+    x += nnz;
+    p++;
+  }
+}
+
 }
 
@@ -92,30 +92,48 @@ void SparseSystem::add_row(const SparseVector& new_row, double new_r) {
   set_row(row, new_row);
 }
 
-int SparseSystem::add_row_givens(const SparseVector& new_row, double new_r) {
+int SparseSystem::add_row_givens(const SparseVector& new_row, double new_r,
+    vector<int>* modified_rows, int* nnz_change) {
   // set new row (also translates according to current variable ordering)
   add_row(new_row, new_r);
   int count = 0;
 
   int row = num_rows() - 1; // last row
+  // each row above is rotated at most once, so its fill-in is the
+  // difference before and after; the new row is counted at the end
+  int nnz_diff = 0;
 
   int col = get_row(row).first(); // first entry to be zeroed
   while (col>=0 && col<row) { // stop when we reach the diagonal
+    if (nnz_change) nnz_diff -= get_row(col).nnz();
     apply_givens(row, col);
+    if (nnz_change) nnz_diff += get_row(col).nnz();
+    if (modified_rows) modified_rows->push_back(col);
     count++;
     col = get_row(row).first();
   }
+  if (nnz_change) {
+    *nnz_change += nnz_diff + get_row(row).nnz();
+  }
   if (get_row(row).nnz()==0) {
     // need to remove the new row as it is now empty
     remove_row();
     // and the rhs needs to be cut accordingly
     VectorXd v = _rhs.segment(0, row); // temporary variable is necessary because of aliasing in Eigen
     _rhs = v;
+  } else if (modified_rows) {
+    modified_rows->push_back(row);
   }
 
   return count;
 }
 
+size_t SparseSystem::memory(size_t* unused) const {
+  return OrderedSparseMatrix::memory(unused)
+      + sizeof(SparseSystem) - sizeof(OrderedSparseMatrix)
+      + _rhs.size()*sizeof(double);
+}
+
 VectorXd SparseSystem::solve() const {
   requireDebug(num_rows() >= num_cols(), "SparseSystem::solve: cannot solve system, not enough constraints");
   requireDebug(num_rows() == num_cols(), "SparseSystem::solve: system not triangular");
@@ -45,13 +45,13 @@ namespace isam {
 // matrices; also influence on execution time if chosen too small (10)
 const int INITIAL_ENTRIES = 50;
 
+SparseVector::allocation_hook_t SparseVector::_allocation_hook = NULL;
+
 void SparseVector::_copy_from(const SparseVector& vec) {
   _nnz = vec._nnz;
-  _nnz_max = vec._nnz_max;
+  _allocate(vec._nnz_max);
 
-  _indices = new int[_nnz_max];
   memcpy(_indices, vec._indices, _nnz*sizeof(int));
-  _values = new double[_nnz_max];
   memcpy(_values, vec._values, _nnz*sizeof(double));
 }
 
@@ -100,23 +100,18 @@ int SparseVector::_search(int idx) const {
 }
 
 void SparseVector::_resize(int new_nnz_max) {
-  int* new_indices = new int[new_nnz_max];
-  memcpy(new_indices, _indices, _nnz*sizeof(int));
-  delete[] _indices;
-  _indices = new_indices;
-  double* new_values = new double[new_nnz_max];
-  memcpy(new_values, _values, _nnz*sizeof(double));
-  delete[] _values;
-  _values = new_values;
-  _nnz_max = new_nnz_max;
+  int* old_indices = _indices;
+  double* old_values = _values;
+  _allocate(new_nnz_max);
+  memcpy(_indices, old_indices, _nnz*sizeof(int));
+  delete[] old_indices;
+  memcpy(_values, old_values, _nnz*sizeof(double));
+  delete[] old_values;
 }
 
 SparseVector::SparseVector() {
   _nnz = 0;
-  _nnz_max = INITIAL_ENTRIES;
-
-  _indices = new int[_nnz_max];
-  _values = new double[_nnz_max];
+  _allocate(INITIAL_ENTRIES);
 }
 
 SparseVector::SparseVector(const SparseVector& vec) {
@@ -133,9 +128,7 @@ SparseVector::SparseVector(const SparseVector& vec, int num, int first) {
     }
   }
   // allocate memory accordingly
-  _nnz_max = _nnz;
-  _indices = new int[_nnz_max];
-  _values = new double[_nnz_max];
+  _allocate(_nnz);
   // copy data over, renumber indices!
   int n = 0;
   for (int i=0; i<vec._nnz; i++) {
@@ -150,10 +143,7 @@ SparseVector::SparseVector(const SparseVector& vec, int num, int first) {
 
 SparseVector::SparseVector(int* indices, double* values, int nnz) {
   _nnz = nnz;
-  _nnz_max = nnz;
-
-  _indices = new int[_nnz_max];
-  _values = new double[_nnz_max];
+  _allocate(nnz);
 
   memcpy(_indices, indices, nnz*sizeof(int));
   memcpy(_values, values, nnz*sizeof(double));
@@ -0,0 +1,148 @@
+/**
+ * @file StateBuffer.cpp
+ * @brief Contiguous storage for the estimates of all nodes in a graph.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "isam/util.h"
+#include "isam/Node.h"
+#include "isam/StateBuffer.h"
+
+using namespace std;
+
+namespace isam {
+
+StateBuffer::StateBuffer()
+  : _estimates(NULL), _linpoints(NULL), _size(0), _capacity(0), _num_nodes(0)
+{
+}
+
+StateBuffer::~StateBuffer() {
+  // nodes usually outlive the Slam object; uninitialized nodes and nodes
+  // with values of their own have no slot but still point to this buffer
+  while (!_attached.empty()) {
+    detach(*_attached.begin());
+  }
+  free(_estimates);
+  free(_linpoints);
+}
+
+void StateBuffer::attach(Node* node) {
+  requireDebug(node->_state==NULL, "StateBuffer::attach: node already attached");
+  node->_state = this;
+  _attached.insert(node);
+  if (node->initialized()) {
+    insert(node);
+  }
+}
+
+void StateBuffer::detach(Node* node) {
+  if (node->_state != this) return;
+  if (node->_state_slot >= 0) {
+    node->relocate(NULL, NULL);
+    free_slot(node);
+  }
+  node->_state = NULL;
+  _attached.erase(node);
+}
+
+void StateBuffer::insert(Node* node) {
+  size_t size = node->value_size();
+  if (size==0 || node->_state_slot>=0) return;
+  size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  if (_size + size > _capacity) {
+    // compacts the existing values, so that space of removed nodes is reused
+    size_t used = 0;
+    for (unsigned int i=0; i<_slots.size(); i++) {
+      if (_slots[i]) {
+        used += (_slots[i]->value_size() + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+      }
+    }
+    reserve(max((size_t)4096, 2*(used+size)));
+  }
+  node->_state_slot = _slots.size();
+  _slots.push_back(node);
+  node->relocate(_estimates+_size, _linpoints+_size);
+  _size += size;
+  _num_nodes++;
+}
+
+void StateBuffer::remove(Node* node) {
+  if (node->_state_slot >= 0) {
+    free_slot(node);
+  }
+  node->_state = NULL;
+  _attached.erase(node);
+}
+
+void StateBuffer::free_slot(Node* node) {
+  _slots[node->_state_slot] = NULL;
+  node->_state_slot = -1;
+  _num_nodes--;
+}
+
+void StateBuffer::reserve(size_t capacity) {
+  char* estimates = NULL;
+  char* linpoints = NULL;
+  require(posix_memalign((void**)&estimates, ALIGNMENT, capacity)==0
+          && posix_memalign((void**)&linpoints, ALIGNMENT, capacity)==0,
+          "StateBuffer::reserve: out of memory");
+  // move all values, dropping the slots of removed nodes
+  vector<Node*> slots;
+  size_t size = 0;
+  for (unsigned int i=0; i<_slots.size(); i++) {
+    Node* node = _slots[i];
+    if (node) {
+      node->relocate(estimates+size, linpoints+size);
+      node->_state_slot = slots.size();
+      slots.push_back(node);
+      size += (node->value_size() + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+  }
+  free(_estimates);
+  free(_linpoints);
+  _estimates = estimates;
+  _linpoints = linpoints;
+  _size = size;
+  _capacity = capacity;
+  _slots.swap(slots);
+}
+
+void StateBuffer::linpoint_to_estimate() {
+  memcpy(_estimates, _linpoints, _size);
+}
+
+void StateBuffer::estimate_to_linpoint() {
+  memcpy(_linpoints, _estimates, _size);
+}
+
+void StateBuffer::swap_estimates() {
+  double* estimates = (double*)_estimates;
+  double* linpoints = (double*)_linpoints;
+  swap_ranges(estimates, estimates + _size/sizeof(double), linpoints);
+}
+
+}
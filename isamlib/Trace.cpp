@@ -0,0 +1,367 @@
+/**
+ * @file Trace.cpp
+ * @brief Scoped timers recording nested execution times per thread.
+ *
+ * Copyright (C) 2009-2013 Massachusetts Institute of Technology.
+ * Michael Kaess, Hordur Johannsson, David Rosen,
+ * Nicholas Carlevaris-Bianco and John. J. Leonard
+ *
+ * This file is part of iSAM.
+ *
+ * iSAM is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * iSAM is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with iSAM.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "isam/util.h"
+#include "isam/Trace.h"
+
+using namespace std;
+
+namespace isam {
+
+namespace {
+
+// node in the tree of nested scopes, with statistics in nanoseconds
+struct TraceNode {
+  int id;
+  int parent;
+  int first_child;
+  int last_child;
+  int next_sibling;
+  long n;
+  int64_t total;
+  int64_t children;
+  int64_t min;
+  int64_t max;
+};
+
+struct TraceEvent {
+  int id;
+  int thread;
+  int64_t start;
+  int64_t duration;
+};
+
+struct OpenScope {
+  int node;
+  int64_t start;
+};
+
+// nodes and events are protected by mutex, which is only contended
+// while the export functions read them; stack is private to the thread
+struct ThreadBuffer {
+  int thread;
+  pthread_mutex_t mutex;
+  std::vector<TraceNode> nodes; // nodes[0] is the root
+  std::vector<OpenScope> stack;
+  std::vector<TraceEvent> events;
+};
+
+pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+// registered names, the buffers of all running threads and the merged
+// statistics and events of threads that have exited, protected by trace_mutex
+std::vector<std::string> trace_names;
+std::vector<ThreadBuffer*> trace_buffers;
+std::vector<TraceNode> retired_nodes;
+std::vector<TraceEvent> retired_events;
+int num_threads = 0;
+
+__thread ThreadBuffer* local_buffer = NULL;
+pthread_key_t buffer_key;
+pthread_once_t buffer_once = PTHREAD_ONCE_INIT;
+volatile bool record_events = false;
+
+inline int64_t now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+TraceNode new_node(int id, int parent) {
+  TraceNode node;
+  node.id = id;
+  node.parent = parent;
+  node.first_child = -1;
+  node.last_child = -1;
+  node.next_sibling = -1;
+  node.n = 0;
+  node.total = 0;
+  node.children = 0;
+  node.min = 0;
+  node.max = 0;
+  return node;
+}
+
+// returns the child of parent with the given id, created if necessary
+int child(std::vector<TraceNode>& nodes, int parent, int id) {
+  int c = nodes[parent].first_child;
+  while (c>=0 && nodes[c].id!=id) {
+    c = nodes[c].next_sibling;
+  }
+  if (c<0) {
+    c = nodes.size();
+    nodes.push_back(new_node(id, parent));
+    if (nodes[parent].last_child>=0) {
+      nodes[nodes[parent].last_child].next_sibling = c;
+    } else {
+      nodes[parent].first_child = c;
+    }
+    nodes[parent].last_child = c;
+  }
+  return c;
+}
+
+// true if the subtree at node contains completed scopes
+bool has_calls(const std::vector<TraceNode>& nodes, int node) {
+  if (nodes[node].n>0) return true;
+  for (int c=nodes[node].first_child; c>=0; c=nodes[c].next_sibling) {
+    if (has_calls(nodes, c)) return true;
+  }
+  return false;
+}
+
+// adds the subtree at node src to node dst of the merged tree
+void merge(const std::vector<TraceNode>& nodes, int src, std::vector<TraceNode>& merged, int dst) {
+  for (int c=nodes[src].first_child; c>=0; c=nodes[c].next_sibling) {
+    const TraceNode& from = nodes[c];
+    // a scope that is still open can contain completed ones
+    if (!has_calls(nodes, c)) continue;
+    int to = child(merged, dst, from.id);
+    TraceNode& node = merged[to];
+    if (from.n>0) {
+      if (node.n==0 || from.min<node.min) node.min = from.min;
+      if (node.n==0 || from.max>node.max) node.max = from.max;
+    }
+    node.n += from.n;
+    node.total += from.total;
+    node.children += from.children;
+    merge(nodes, c, merged, to);
+  }
+}
+
+// called on thread exit: keeps the results, frees the buffer
+void retire_buffer(void* ptr) {
+  ThreadBuffer* b = static_cast<ThreadBuffer*>(ptr);
+  pthread_mutex_lock(&trace_mutex);
+  if (retired_nodes.empty()) retired_nodes.push_back(new_node(-1, -1));
+  merge(b->nodes, 0, retired_nodes, 0);
+  retired_events.insert(retired_events.end(), b->events.begin(), b->events.end());
+  for (unsigned int i=0; i<trace_buffers.size(); i++) {
+    if (trace_buffers[i]==b) {
+      trace_buffers.erase(trace_buffers.begin()+i);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&trace_mutex);
+  pthread_mutex_destroy(&b->mutex);
+  delete b;
+  local_buffer = NULL;
+}
+
+void create_buffer_key() {
+  pthread_key_create(&buffer_key, retire_buffer);
+}
+
+ThreadBuffer* buffer() {
+  if (local_buffer==NULL) {
+    pthread_once(&buffer_once, create_buffer_key);
+    ThreadBuffer* b = new ThreadBuffer;
+    pthread_mutex_init(&b->mutex, NULL);
+    b->nodes.push_back(new_node(-1, -1));
+    pthread_mutex_lock(&trace_mutex);
+    b->thread = num_threads++;
+    trace_buffers.push_back(b);
+    pthread_mutex_unlock(&trace_mutex);
+    pthread_setspecific(buffer_key, b);
+    local_buffer = b;
+  }
+  return local_buffer;
+}
+
+void print(std::ostream& out, const std::vector<TraceNode>& nodes, int node, int depth) {
+  for (int c=nodes[node].first_child; c>=0; c=nodes[c].next_sibling) {
+    const TraceNode& n = nodes[c];
+    string name = string(2*depth, ' ') + trace_names[n.id];
+    char line[256];
+    snprintf(line, sizeof(line), "%-48s %9ld %11.6f %11.6f %11.6f %11.6f\n",
+        name.c_str(), n.n, n.total*1e-9, (n.total-n.children)*1e-9,
+        n.min*1e-9, n.max*1e-9);
+    out << line;
+    print(out, nodes, c, depth+1);
+  }
+}
+
+}
+
+int trace_id(const char* name) {
+  pthread_mutex_lock(&trace_mutex);
+  int id = 0;
+  while (id<(int)trace_names.size() && trace_names[id]!=name) {
+    id++;
+  }
+  if (id==(int)trace_names.size()) {
+    trace_names.push_back(name);
+  }
+  pthread_mutex_unlock(&trace_mutex);
+  return id;
+}
+
+void trace_begin(int id) {
+  ThreadBuffer* b = buffer();
+  OpenScope scope;
+  pthread_mutex_lock(&b->mutex);
+  scope.node = child(b->nodes, b->stack.empty() ? 0 : b->stack.back().node, id);
+  pthread_mutex_unlock(&b->mutex);
+  b->stack.push_back(scope);
+  // last, so that the bookkeeping is not timed
+  b->stack.back().start = now();
+}
+
+void trace_end() {
+  int64_t t = now();
+  ThreadBuffer* b = local_buffer;
+  requireDebug(b!=NULL && !b->stack.empty(), "trace_end: no open scope");
+  const OpenScope& scope = b->stack.back();
+  int64_t dt = t - scope.start;
+  pthread_mutex_lock(&b->mutex);
+  TraceNode& node = b->nodes[scope.node];
+  if (node.n==0 || dt<node.min) node.min = dt;
+  if (node.n==0 || dt>node.max) node.max = dt;
+  node.n++;
+  node.total += dt;
+  b->nodes[node.parent].children += dt;
+  if (record_events) {
+    TraceEvent event;
+    event.id = node.id;
+    event.thread = b->thread;
+    event.start = scope.start;
+    event.duration = dt;
+    b->events.push_back(event);
+  }
+  pthread_mutex_unlock(&b->mutex);
+  b->stack.pop_back();
+}
+
+void trace_record_events(bool record) {
+  record_events = record;
+}
+
+void trace_print_summary(std::ostream& out) {
+  pthread_mutex_lock(&trace_mutex);
+  std::vector<TraceNode> merged;
+  merged.push_back(new_node(-1, -1));
+  if (!retired_nodes.empty()) merge(retired_nodes, 0, merged, 0);
+  for (unsigned int i=0; i<trace_buffers.size(); i++) {
+    ThreadBuffer* b = trace_buffers[i];
+    pthread_mutex_lock(&b->mutex);
+    merge(b->nodes, 0, merged, 0);
+    pthread_mutex_unlock(&b->mutex);
+  }
+  char line[256];
+  snprintf(line, sizeof(line), "%-48s %9s %11s %11s %11s %11s\n", "scope",
+      "calls", "total[s]", "self[s]", "min[s]", "max[s]");
+  out << line;
+  print(out, merged, 0, 0);
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+void trace_write_chrome(const std::string& fname) {
+  ofstream out(fname.c_str());
+  require(out, "trace_write_chrome: cannot open file");
+  pthread_mutex_lock(&trace_mutex);
+  std::vector<TraceEvent> events = retired_events;
+  for (unsigned int i=0; i<trace_buffers.size(); i++) {
+    ThreadBuffer* b = trace_buffers[i];
+    pthread_mutex_lock(&b->mutex);
+    events.insert(events.end(), b->events.begin(), b->events.end());
+    pthread_mutex_unlock(&b->mutex);
+  }
+  // times relative to the first event, in microseconds
+  int64_t t0 = 0;
+  for (unsigned int k=0; k<events.size(); k++) {
+    if (k==0 || events[k].start<t0) t0 = events[k].start;
+  }
+  out << "{\"traceEvents\":[";
+  char line[512];
+  for (unsigned int k=0; k<events.size(); k++) {
+    snprintf(line, sizeof(line),
+        "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+        k==0 ? "" : ",", trace_names[events[k].id].c_str(),
+        events[k].thread, (events[k].start-t0)*1e-3,
+        events[k].duration*1e-3);
+    out << line;
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+// total time of all scopes with the given name, recursive scopes are
+// only counted once
+int64_t total_time(const std::vector<TraceNode>& nodes, const char* name) {
+  int64_t total = 0;
+  for (unsigned int k=1; k<nodes.size(); k++) {
+    if (trace_names[nodes[k].id]!=name) continue;
+    bool nested = false;
+    for (int p=nodes[k].parent; p>0 && !nested; p=nodes[p].parent) {
+      nested = (nodes[p].id==nodes[k].id);
+    }
+    if (!nested) total += nodes[k].total;
+  }
+  return total;
+}
+
+double trace_time(const char* name) {
+  pthread_mutex_lock(&trace_mutex);
+  int64_t total = total_time(retired_nodes, name);
+  for (unsigned int i=0; i<trace_buffers.size(); i++) {
+    ThreadBuffer* b = trace_buffers[i];
+    pthread_mutex_lock(&b->mutex);
+    total += total_time(b->nodes, name);
+    pthread_mutex_unlock(&b->mutex);
+  }
+  pthread_mutex_unlock(&trace_mutex);
+  return total*1e-9;
+}
+
+void trace_clear() {
+  pthread_mutex_lock(&trace_mutex);
+  retired_nodes.clear();
+  retired_events.clear();
+  for (unsigned int i=0; i<trace_buffers.size(); i++) {
+    ThreadBuffer* b = trace_buffers[i];
+    pthread_mutex_lock(&b->mutex);
+    // open scopes refer to nodes, so only the statistics are reset
+    for (unsigned int k=0; k<b->nodes.size(); k++) {
+      TraceNode& node = b->nodes[k];
+      node.n = 0;
+      node.total = 0;
+      node.children = 0;
+      node.min = 0;
+      node.max = 0;
+    }
+    b->events.clear();
+    pthread_mutex_unlock(&b->mutex);
+  }
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+}
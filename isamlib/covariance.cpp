@@ -182,4 +182,16 @@ list<double> cov_marginal(const SparseMatrix& R, CovarianceCache& cache,
   return entries;
 }
 
+void cov_marginal(const SparseMatrix& R, CovarianceCache& cache,
+                  const entry_list_t& entry_list, vector<double>& entries) {
+  prepare(R, cache);
+  entries.resize(entry_list.size());
+
+  int n = R.num_cols();
+  for (unsigned int i=0; i<entry_list.size(); i++) {
+    const pair<int, int>& index = entry_list[i];
+    entries[i] = recover(R, cache, n, index.first, index.second);
+  }
+}
+
 }
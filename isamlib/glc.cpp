@@ -27,6 +27,8 @@
  */
 
 #include <vector>
+#include <set>
+#include <map>
 
 #include "isam/glc.h"
 #include "isam/util.h"
@@ -174,67 +176,54 @@ MatrixXd glc_get_weighted_jacobian (isam::Factor *f) {
 std::vector<isam::Node*> glc_elim_clique_nodes (Node *node) {
     
   vector<isam::Node*> node_vector;
+  set<Node*> added;
   
-  int id_e = node->unique_id();
-  
-  std::list< isam::Node* > node_list;
   const list<Factor*>& factors = node->factors();
   for (list<Factor*>::const_iterator it = factors.begin(); it!=factors.end(); it++) {
       
     std::vector<Node*>& f_nodes = (*it)->nodes();
     
     for (size_t i=0; i<f_nodes.size(); i++) {
-    
-      int id_i = f_nodes[i]->unique_id();
-      
-      if (id_e != id_i) {
-          
-        // try to add second node in factor
-        if (node_list.end() == find (node_list.begin(), node_list.end(), f_nodes[i])) { // not already added
-          node_list.push_back(f_nodes[i]);
-          node_vector.push_back (f_nodes[i]);
-        }       
-      }   
+      // add other nodes of the factor, unless already added
+      if (f_nodes[i] != node && added.insert(f_nodes[i]).second) {
+        node_vector.push_back (f_nodes[i]);
+      }
     }        
   }
   
   return node_vector;
 }
 
+// factors strictly between nodes in the clique, skipping those in used
 vector<Factor*>
-glc_intra_clique_factors (vector<Node*> clique_nodes, Node *node) {
+glc_intra_clique_factors (const vector<Node*>& clique_nodes, const set<Node*>& clique,
+                          set<Factor*>& used) {
 
   vector<Factor*> ic_factors;
 
   // loop over each node
   for (size_t i=0; i<clique_nodes.size(); i++) {
     // get this nodes factors
-    const std::list<Factor*> factors = clique_nodes[i]->factors();
+    const std::list<Factor*>& factors = clique_nodes[i]->factors();
 
     for (list<Factor*>::const_iterator it = factors.begin(); it!=factors.end(); it++) {
 
       // make sure factor hasnt already been added to the list
-      if (ic_factors.end() != find (ic_factors.begin(), ic_factors.end(), (*it)))
+      if (used.count(*it))
           continue;
 
-      std::vector<Node*>& f_nodes = (*it)->nodes();
-
       // nodes in these factors can be: the marg node, nodes in the clique, or nodes ouside the clique
       // we wish to return factors strictly between nodes in the clique, not outside nor margnode
-      // is the marg node in this factor
-      if (f_nodes.end() != find (f_nodes.begin(), f_nodes.end(), node))
-          continue; // node found
-
-      // strctly include in clique
+      std::vector<Node*>& f_nodes = (*it)->nodes();
       bool ic = true;
       for (size_t j=0; j<f_nodes.size() && ic; j++) {
-        // if we find a factor node that is not in the clique
-        if (clique_nodes.end() == find (clique_nodes.begin(), clique_nodes.end(), f_nodes[j]))
-          ic = false;
+        ic = (clique.count(f_nodes[j]) > 0);
       }
 
-      if (ic)
+      if (ic) {
         ic_factors.push_back(*it);
+        used.insert(*it);
+      }
 
     }
   }
@@ -243,79 +232,65 @@ glc_intra_clique_factors (vector<Node*> clique_nodes, Node *node) {
 
 }
 
+vector<Factor*>
+glc_intra_clique_factors (vector<Node*> clique_nodes, Node *node) {
+  // the marg node is not part of the clique
+  set<Node*> clique (clique_nodes.begin(), clique_nodes.end());
+  set<Factor*> used;
+  return glc_intra_clique_factors (clique_nodes, clique, used);
+}
+
+// adds the information of a factor to L, given the offsets of its nodes in L
+void glc_add_info (Factor *f, const map<Node*, int>& offsets, MatrixXd& L) {
+
+  MatrixXd H = glc_get_weighted_jacobian (f);
+  MatrixXd dL = H.transpose()*H;
+
+  // position of each variable of the factor in the target information
+  vector<int> index;
+  vector<Node*>& f_nodes = f->nodes();
+  for (size_t i=0; i<f_nodes.size(); i++) {
+    int off = offsets.find(f_nodes[i])->second;
+    for (int d=0; d<f_nodes[i]->dim(); d++) {
+      index.push_back(off + d);
+    }
+  }
+  for (size_t a=0; a<index.size(); a++) {
+    for (size_t b=0; b<index.size(); b++) {
+      L(index[a], index[b]) += dL(a, b);
+    }
+  }
+
+#ifdef GLC_DEBUG
+  cout << "[glc]\tAdding info from " << f->name() << " factor between nodes : ";
+  for (size_t n=0; n<f_nodes.size(); n++)
+    cout << f_nodes[n]->unique_id() << " ";
+  cout << endl;
+#endif
+
+}
+
 MatrixXd glc_target_info (Node *node, vector<Node*>& clique_nodes, vector<Factor*>& ic_factors){
 
   vector<Node*> all_nodes (clique_nodes);
   all_nodes.push_back(node);
   
+  // clique nodes first then marg node at end
+  map<Node*, int> offsets;
   int n_full = 0;
-  for (size_t i=0; i<all_nodes.size(); i++) n_full += all_nodes[i]->dim();
-  MatrixXd L (n_full, n_full); // clique nodes first then marg node at end
+  for (size_t i=0; i<all_nodes.size(); i++) {
+    offsets[all_nodes[i]] = n_full;
+    n_full += all_nodes[i]->dim();
+  }
+  MatrixXd L (n_full, n_full);
   L.setZero();
   
-  const list<Factor*>& tmp = node->factors();
-  list<Factor*> factors (tmp);
-  for (size_t i=0; i<ic_factors.size(); i++)
-    factors.push_back(ic_factors[i]);
-  
-  for (list<Factor*>::iterator it = factors.begin(); it!=factors.end(); it++) {
-    
-    Factor *f = *it;
-
-    ////HACK TO THROW AWAY Z PRIORS (for comparision with compounding that also throws away z-priors)
-    //if (0 == strcmp("Pose3d_z_Factor", f->name())) {
-    //  continue;
-    //}
-
-    MatrixXd H = glc_get_weighted_jacobian (f);
-    MatrixXd dL = H.transpose()*H;
-    
-    // there is probably a better/faster way to do this
-    vector<Node*>& f_nodes = f->nodes();
-    int ioff = 0;
-    for (size_t i=0; i<f_nodes.size(); i++) {
-      Node *ni = f_nodes[i];
-      int joff = ioff;
-      for (size_t j=i; j<f_nodes.size(); j++) {
-        Node *nj = f_nodes[j];
-        
-        // find the position(s) of this block in the target information
-        int koff = 0;
-        Node *nk = NULL;
-        for (size_t k=0; k<all_nodes.size(); k++) {
-          if (ni == all_nodes[k]) {
-            nk = all_nodes[k];
-            break;
-          }
-          koff += all_nodes[k]->dim();
-        }
-        int loff = 0;
-        Node *nl = NULL;
-        for (size_t l=0; l<all_nodes.size(); l++) {
-          if (nj == all_nodes[l]) {
-            nl = all_nodes[l];
-            break;
-          }
-          loff += all_nodes[l]->dim();
-        }
-        // add information to the target informaiton
-        L.block(koff, loff, nk->dim(), nl->dim()) += dL.block(ioff, joff, ni->dim(), nj->dim());
-        if (ni != nj) // off diagonal elements 
-          L.block(loff, koff, nl->dim(), nk->dim()) += dL.block(joff, ioff, nj->dim(), ni->dim());
-        
-        joff += nj->dim();  
-      }
-      ioff += ni->dim();
-    }
-    
-#ifdef GLC_DEBUG
-    cout << "[glc]\tAdding info from " << f->name() << " factor between nodes : ";
-    for (size_t n=0; n<f_nodes.size(); n++)
-        cout << f_nodes[n]->unique_id() << " ";
-    cout << endl;
-    //cout << "L" << endl << L << endl;
-#endif
-
+  const list<Factor*>& factors = node->factors();
+  for (list<Factor*>::const_iterator it = factors.begin(); it!=factors.end(); it++) {
+    glc_add_info (*it, offsets, L);
+  }
+  for (size_t i=0; i<ic_factors.size(); i++) {
+    glc_add_info (ic_factors[i], offsets, L);
   }
   
   // marginalization
@@ -504,22 +479,169 @@ vector<Factor*> glc_remove_node(Slam& slam, Node* node, bool sparse, GLC_Reparam
   vector<Factor*> new_glc_factors;
   new_glc_factors = glc_lift_factors (L, clique_nodes, sparse, rp);
 
-  // remove node and delete all adjacent factors
-  slam.remove_node(node);  
-
-  // remove all ic factors
-  for(size_t i=0; i<ic_factors.size(); i++) {
-    slam.remove_factor(ic_factors[i]);
+  // remove node and all adjacent factors, remove all ic factors, add glc
+  // factors; keeps R valid if possible
+  slam.marginalize_nodes(vector<Node*>(1, node), ic_factors, new_glc_factors);
+#ifdef GLC_DEBUG
+  for(size_t i=0; i<new_glc_factors.size(); i++) {
+    cout << "[glc]\tAdded GLC Factor: " << new_glc_factors[i]->unique_id() << endl;
   }
+#endif
   
-  // add glc factors
-  for(size_t i=0; i<new_glc_factors.size(); i++) {
-    slam.add_factor(new_glc_factors[i]);
+
+  return new_glc_factors;
+
+}
+
+// blocks of a sparse symmetric information matrix by node index, each
+// off diagonal block is stored twice (i,j) and (j,i)
+typedef vector<map<int, MatrixXd> > InfoBlocks;
+
+void glc_add_block (InfoBlocks& blocks, int i, int j, const MatrixXd& Lij) {
+  map<int, MatrixXd>::iterator it = blocks[i].find(j);
+  if (it == blocks[i].end()) {
+    blocks[i][j] = Lij;
+  } else {
+    it->second += Lij;
+  }
+}
+
+vector<Factor*> glc_remove_nodes(Slam& slam, const vector<Node*>& nodes, bool sparse,
+                                 GLC_Reparam* rp, vector<Factor*>* removed_factors) {
+
+  set<Node*> removing (nodes.begin(), nodes.end());
+  set<Node*> visited;
+  // factors folded into the new glc factors
+  set<Factor*> used;
+  vector<Factor*> elim_factors;
+  vector<Factor*> ic_factors;
+  vector<Factor*> new_glc_factors;
+
+  for (size_t n=0; n<nodes.size(); n++) {
+    if (!visited.insert(nodes[n]).second)
+      continue;
+
+    // connected component of nodes to be removed, and all their factors
+    vector<Node*> component (1, nodes[n]);
+    vector<Factor*> factors;
+    for (size_t k=0; k<component.size(); k++) {
+      const list<Factor*>& node_factors = component[k]->factors();
+      for (list<Factor*>::const_iterator it = node_factors.begin(); it!=node_factors.end(); it++) {
+        if (!used.insert(*it).second)
+          continue;
+        factors.push_back(*it);
+        std::vector<Node*>& f_nodes = (*it)->nodes();
+        for (size_t i=0; i<f_nodes.size(); i++) {
+          if (removing.count(f_nodes[i]) && visited.insert(f_nodes[i]).second) {
+            component.push_back(f_nodes[i]);
+          }
+        }
+      }
+    }
+
+    // remaining nodes adjacent to the component, new glc factor(s) will span these nodes
+    vector<Node*> clique_nodes;
+    set<Node*> clique;
+    for (size_t f=0; f<factors.size(); f++) {
+      std::vector<Node*>& f_nodes = factors[f]->nodes();
+      for (size_t i=0; i<f_nodes.size(); i++) {
+        if (!removing.count(f_nodes[i]) && clique.insert(f_nodes[i]).second) {
+          clique_nodes.push_back(f_nodes[i]);
+        }
+      }
+    }
+    elim_factors.insert(elim_factors.end(), factors.begin(), factors.end());
+#ifdef GLC_INCLUDE_IC_FACTORS
+    // only folded into the first clique they are part of
+    vector<Factor*> ic = glc_intra_clique_factors (clique_nodes, clique, used);
+    ic_factors.insert(ic_factors.end(), ic.begin(), ic.end());
+    factors.insert(factors.end(), ic.begin(), ic.end());
+#endif
+
 #ifdef GLC_DEBUG
-    cout << "[glc]\tAdded GLC Factor: " << new_glc_factors[i]->unique_id() << endl;
+    cout << "[glc]\tRemoving " << component.size() << " connected node(s), clique of "
+         << clique_nodes.size() << " node(s)" << endl;
 #endif
+
+    // sparse target information, clique nodes first then the component
+    vector<Node*> all_nodes (clique_nodes);
+    all_nodes.insert(all_nodes.end(), component.begin(), component.end());
+    map<Node*, int> index;
+    for (size_t i=0; i<all_nodes.size(); i++) {
+      index[all_nodes[i]] = i;
+    }
+    InfoBlocks blocks (all_nodes.size());
+    for (size_t f=0; f<factors.size(); f++) {
+      MatrixXd H = glc_get_weighted_jacobian (factors[f]);
+      std::vector<Node*>& f_nodes = factors[f]->nodes();
+      int ioff = 0;
+      for (size_t i=0; i<f_nodes.size(); i++) {
+        int di = f_nodes[i]->dim();
+        int joff = 0;
+        for (size_t j=0; j<f_nodes.size(); j++) {
+          int dj = f_nodes[j]->dim();
+          glc_add_block (blocks, index[f_nodes[i]], index[f_nodes[j]],
+                         H.block(0, ioff, H.rows(), di).transpose() * H.block(0, joff, H.rows(), dj));
+          joff += dj;
+        }
+        ioff += di;
+      }
+    }
+
+    // eliminate the component one node at a time, only touching the
+    // blocks of its current neighbors
+    for (size_t k=clique_nodes.size(); k<all_nodes.size(); k++) {
+      MatrixXd Lkk_inv = posdef_pinv(blocks[k][k], GLC_EPS);
+      vector<int> neighbors;
+      for (map<int, MatrixXd>::iterator it = blocks[k].begin(); it!=blocks[k].end(); it++) {
+        if (it->first != (int)k)
+          neighbors.push_back(it->first);
+      }
+      for (size_t a=0; a<neighbors.size(); a++) {
+        int i = neighbors[a];
+        MatrixXd Lik_Lkk_inv = blocks[i][k] * Lkk_inv;
+        for (size_t b=0; b<neighbors.size(); b++) {
+          int j = neighbors[b];
+          glc_add_block (blocks, i, j, -Lik_Lkk_inv * blocks[k][j]);
+        }
+      }
+      for (size_t a=0; a<neighbors.size(); a++) {
+        blocks[neighbors[a]].erase(k);
+      }
+      blocks[k].clear();
+    }
+
+    if (clique_nodes.empty())
+      continue;
+
+    // the marginal information over the clique is dense
+    vector<int> offsets (clique_nodes.size());
+    int dim = 0;
+    for (size_t i=0; i<clique_nodes.size(); i++) {
+      offsets[i] = dim;
+      dim += clique_nodes[i]->dim();
+    }
+    MatrixXd L (dim, dim);
+    L.setZero();
+    for (size_t i=0; i<clique_nodes.size(); i++) {
+      for (map<int, MatrixXd>::iterator it = blocks[i].begin(); it!=blocks[i].end(); it++) {
+        L.block(offsets[i], offsets[it->first], it->second.rows(), it->second.cols()) = it->second;
+      }
+    }
+
+    vector<Factor*> lifted = glc_lift_factors (L, clique_nodes, sparse, rp);
+    new_glc_factors.insert(new_glc_factors.end(), lifted.begin(), lifted.end());
+  }
+
+  // one pass over the graph: remove nodes and all adjacent factors,
+  // remove all ic factors, add glc factors; the nodes are marginalized
+  // out of R instead of requiring a batch step if possible
+  slam.marginalize_nodes(nodes, ic_factors, new_glc_factors);
+
+  if (removed_factors) {
+    removed_factors->insert(removed_factors->end(), elim_factors.begin(), elim_factors.end());
+    removed_factors->insert(removed_factors->end(), ic_factors.begin(), ic_factors.end());
   }
-  
 
   return new_glc_factors;
 
@@ -27,55 +27,87 @@
 
 #include <map>
 #include <sys/time.h>
+#include <pthread.h>
 #include <cmath>
 #include <algorithm> // abs
 
 #include "isam/util.h"
+#include "isam/Trace.h"
 
 using namespace std;
 
 namespace isam {
 
-// simple class for accumulating execution timing information by name
+// simple class for accumulating execution timing information by name;
+// the library itself uses the scoped timers of Trace.h instead
 class Timing {
   class Stats {
   public:
-    double t0;
     double t;
     double t_max;
     double t_min;
     int n;
   };
   map<string, Stats> stats;
+  pthread_mutex_t mutex;
 public:
-  void add_t0(string id, double t0) {
-    stats[id].t0 = t0;
+  Timing() {
+    pthread_mutex_init(&mutex, NULL);
   }
-  double get_t0(string id) {
-    return stats[id].t0;
-  }
-  void add_dt(string id, double dt) {
+  void add_dt(const string& id, double dt) {
+    pthread_mutex_lock(&mutex);
     Stats& s = stats[id];
     s.t += dt;
     s.n++;
     if (s.n==1 || s.t_max < dt) s.t_max = dt;
     if (s.n==1 || s.t_min > dt) s.t_min = dt;
+    pthread_mutex_unlock(&mutex);
   }
   void print() {
+    pthread_mutex_lock(&mutex);
     map<string, Stats>::iterator it;
     for(it = stats.begin(); it!=stats.end(); it++) {
       Stats& s = it->second;
       printf("%s: %g (%i times, min: %g, max: %g)\n",
              it->first.c_str(), s.t, s.n, s.t_min, s.t_max);
     }
+    pthread_mutex_unlock(&mutex);
   }
-  double time(string id) {
-    Stats& s = stats[id];
-    return s.t;
+  bool time(const string& id, double& t) {
+    pthread_mutex_lock(&mutex);
+    map<string, Stats>::iterator it = stats.find(id);
+    bool found = (it!=stats.end());
+    if (found) t = it->second.t;
+    pthread_mutex_unlock(&mutex);
+    return found;
   }
 };
 Timing timing;
 
+// start times of the current thread by name, so that threads using the
+// same name do not interfere
+pthread_key_t start_times_key;
+pthread_once_t start_times_once = PTHREAD_ONCE_INIT;
+
+void delete_start_times(void* start_times) {
+  delete static_cast<map<string, double>*>(start_times);
+}
+
+void create_start_times_key() {
+  pthread_key_create(&start_times_key, delete_start_times);
+}
+
+map<string, double>& start_times() {
+  pthread_once(&start_times_once, create_start_times_key);
+  map<string, double>* t0s =
+      static_cast<map<string, double>*>(pthread_getspecific(start_times_key));
+  if (t0s==NULL) {
+    t0s = new map<string, double>;
+    pthread_setspecific(start_times_key, t0s);
+  }
+  return *t0s;
+}
+
 double tic() {
   struct timeval t;
   gettimeofday(&t, NULL);
@@ -84,7 +116,7 @@ double tic() {
 
 double tic(string id) {
   double t0 = tic();
-  timing.add_t0(id, t0);
+  start_times()[id] = t0;
   return t0;
 }
 
@@ -94,17 +126,23 @@ double toc(double t) {
 }
 
 double toc(string id) {
-  double dt = toc(timing.get_t0(id));
+  double dt = toc(start_times()[id]);
   timing.add_dt(id, dt);
   return dt;
 }
 
 void tictoc_print() {
   timing.print();
+  trace_print_summary();
 }
 
 double tictoc(string id) {
-  return (timing.time(id));
+  double t;
+  if (timing.time(id, t)) {
+    return t;
+  }
+  // scoped timers (see Trace.h)
+  return trace_time(id.c_str());
 }
 
 Eigen::MatrixXd eye(int num) {